@@ -12,6 +12,7 @@
 #include "app/app.h"
 
 #include "app/app_options.h"
+#include "app/batch_context.h"
 #include "app/check_update.h"
 #include "app/color_utils.h"
 #include "app/commands/cmd_save_file.h"
@@ -55,10 +56,12 @@
 #include "app/ui_context.h"
 #include "app/util/boundary.h"
 #include "app/webserver.h"
+#include "base/chrono.h"
 #include "base/exception.h"
 #include "base/fs.h"
 #include "base/path.h"
 #include "base/split_string.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/document_observer.h"
 #include "doc/image.h"
@@ -74,7 +77,11 @@
 #include "ui/intern.h"
 #include "ui/ui.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 
 namespace app {
 
@@ -123,12 +130,21 @@ public:
 
 App* App::m_instance = NULL;
 
+// Command instances store the given parameters, so we use clones
+// of them to process options from several threads at the same time
+// (--jobs or export jobs in server mode).
+static Command* clone_command(const char* name)
+{
+  return CommandsModule::instance()->getCommandByName(name)->clone();
+}
+
 App::App()
   : m_coreModules(NULL)
   , m_modules(NULL)
   , m_legacy(NULL)
   , m_isGui(false)
   , m_isShell(false)
+  , m_isServer(false)
   , m_exporter(NULL)
 {
   ASSERT(m_instance == NULL);
@@ -139,6 +155,7 @@ void App::initialize(const AppOptions& options)
 {
   m_isGui = options.startUI();
   m_isShell = options.startShell();
+  m_isServer = options.startServer();
   if (m_isGui)
     m_guiSystem.reset(new ui::GuiSystem);
 
@@ -149,7 +166,7 @@ void App::initialize(const AppOptions& options)
   m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
 
   if (options.hasExporterParams())
-    m_exporter.reset(new DocumentExporter);
+    m_exporter.reset(new DocumentExporter(UIContext::instance()));
 
   // Data recovery is enabled only in GUI mode
   if (isGui() && preferences().general.dataRecovery())
@@ -228,33 +245,54 @@ void App::initialize(const AppOptions& options)
 
   // Procress options
   PRINTF("Processing options...\n");
+  processOptions(options, ctx, m_exporter.get());
+  m_exporter.reset(NULL);
+}
+
+void App::processOptions(const AppOptions& options, Context* ctx, DocumentExporter* exporter)
+{
+  // Files are processed in parallel only when we don't need to
+  // generate a sprite sheet with all of them.
+  if (options.jobs() > 1 && !exporter && !isGui())
+    processOptionsInJobs(options);
+  else
+    processValues(options, ctx, exporter, 0, options.values().size());
+}
 
+// Processes the option values in the [0, end) range, but files are
+// loaded, saved (--save-as), and scaled (--scale) only if they are in
+// the [begin, end) range. Options before "begin" are just used to
+// configure the state (e.g. --trim, --crop, --filename-format, etc.).
+void App::processValues(const AppOptions& options, Context* ctx, DocumentExporter* exporter,
+                        std::size_t begin, std::size_t end)
+{
   bool ignoreEmpty = false;
   bool trim = false;
   Params cropParams;
 
   // Open file specified in the command line
   if (!options.values().empty()) {
-    Console console;
+    Console console(ctx);
     bool splitLayers = false;
     bool splitLayersSaveAs = false;
     std::string importLayer;
     std::string importLayerSaveAs;
     std::string filenameFormat;
 
-    for (const auto& value : options.values()) {
+    for (std::size_t i=0; i<end; ++i) {
+      const auto& value = options.values()[i];
       const AppOptions::Option* opt = value.option();
 
       // Special options/commands
       if (opt) {
         // --data <file.json>
         if (opt == &options.data()) {
-          if (m_exporter)
-            m_exporter->setDataFilename(value.value());
+          if (exporter)
+            exporter->setDataFilename(value.value());
         }
         // --format <format>
         else if (opt == &options.format()) {
-          if (m_exporter) {
+          if (exporter) {
             DocumentExporter::DataFormat format = DocumentExporter::DefaultDataFormat;
 
             if (value.value() == "json-hash")
@@ -262,28 +300,48 @@ void App::initialize(const AppOptions& options)
             else if (value.value() == "json-array")
               format = DocumentExporter::JsonArrayDataFormat;
 
-            m_exporter->setDataFormat(format);
+            exporter->setDataFormat(format);
           }
         }
         // --sheet <file.png>
         else if (opt == &options.sheet()) {
-          if (m_exporter)
-            m_exporter->setTextureFilename(value.value());
+          if (exporter)
+            exporter->setTextureFilename(value.value());
         }
         // --sheet-width <width>
         else if (opt == &options.sheetWidth()) {
-          if (m_exporter)
-            m_exporter->setTextureWidth(strtol(value.value().c_str(), NULL, 0));
+          if (exporter)
+            exporter->setTextureWidth(strtol(value.value().c_str(), NULL, 0));
         }
         // --sheet-height <height>
         else if (opt == &options.sheetHeight()) {
-          if (m_exporter)
-            m_exporter->setTextureHeight(strtol(value.value().c_str(), NULL, 0));
+          if (exporter)
+            exporter->setTextureHeight(strtol(value.value().c_str(), NULL, 0));
         }
         // --sheet-pack
         else if (opt == &options.sheetPack()) {
-          if (m_exporter)
-            m_exporter->setTexturePack(true);
+          if (exporter)
+            exporter->setTexturePack(true);
+        }
+        // --sheet-rotate
+        else if (opt == &options.sheetRotate()) {
+          if (exporter)
+            exporter->setTextureRotation(true);
+        }
+        // --sheet-max-size <width,height>
+        else if (opt == &options.sheetMaxSize()) {
+          std::vector<std::string> parts;
+          base::split_string(value.value(), parts, ",");
+          if (exporter && parts.size() == 2) {
+            exporter->setTextureMaxSize(
+              strtol(parts[0].c_str(), NULL, 0),
+              strtol(parts[1].c_str(), NULL, 0));
+          }
+        }
+        // --sheet-npot
+        else if (opt == &options.sheetNpot()) {
+          if (exporter)
+            exporter->setTexturePowerOfTwo(false);
         }
         // --split-layers
         else if (opt == &options.splitLayers()) {
@@ -301,18 +359,18 @@ void App::initialize(const AppOptions& options)
         }
         // --border-padding
         else if (opt == &options.borderPadding()) {
-          if (m_exporter)
-            m_exporter->setBorderPadding(strtol(value.value().c_str(), NULL, 0));
+          if (exporter)
+            exporter->setBorderPadding(strtol(value.value().c_str(), NULL, 0));
         }
         // --shape-padding
         else if (opt == &options.shapePadding()) {
-          if (m_exporter)
-            m_exporter->setShapePadding(strtol(value.value().c_str(), NULL, 0));
+          if (exporter)
+            exporter->setShapePadding(strtol(value.value().c_str(), NULL, 0));
         }
         // --inner-padding
         else if (opt == &options.innerPadding()) {
-          if (m_exporter)
-            m_exporter->setInnerPadding(strtol(value.value().c_str(), NULL, 0));
+          if (exporter)
+            exporter->setInnerPadding(strtol(value.value().c_str(), NULL, 0));
         }
         // --trim
         else if (opt == &options.trim()) {
@@ -334,7 +392,7 @@ void App::initialize(const AppOptions& options)
           filenameFormat = value.value();
         }
         // --save-as <filename>
-        else if (opt == &options.saveAs()) {
+        else if (opt == &options.saveAs() && i >= begin) {
           Document* doc = NULL;
           if (!ctx->documents().empty())
             doc = dynamic_cast<Document*>(ctx->documents().lastAdded());
@@ -347,10 +405,10 @@ void App::initialize(const AppOptions& options)
 
             std::string format = filenameFormat;
 
-            Command* saveAsCommand = CommandsModule::instance()->getCommandByName(CommandId::SaveFileCopyAs);
-            Command* trimCommand = CommandsModule::instance()->getCommandByName(CommandId::AutocropSprite);
-            Command* cropCommand = CommandsModule::instance()->getCommandByName(CommandId::CropSprite);
-            Command* undoCommand = CommandsModule::instance()->getCommandByName(CommandId::Undo);
+            base::UniquePtr<Command> saveAsCommand(clone_command(CommandId::SaveFileCopyAs));
+            base::UniquePtr<Command> trimCommand(clone_command(CommandId::AutocropSprite));
+            base::UniquePtr<Command> cropCommand(clone_command(CommandId::CropSprite));
+            base::UniquePtr<Command> undoCommand(clone_command(CommandId::Undo));
 
             if (splitLayersSaveAs) {
               std::vector<Layer*> layers;
@@ -378,7 +436,7 @@ void App::initialize(const AppOptions& options)
                 fmt = filename_formatter(format, fnInfo, false);
 
                 if (!cropParams.empty())
-                  ctx->executeCommand(cropCommand, cropParams);
+                  ctx->executeCommand(cropCommand.get(), cropParams);
 
                 // TODO --trim command with --save-as doesn't make too
                 // much sense as we lost the trim rectangle
@@ -386,15 +444,15 @@ void App::initialize(const AppOptions& options)
                 // we should trim each frame individually (a process
                 // that can be done only in fop_operate()).
                 if (trim)
-                  ctx->executeCommand(trimCommand);
+                  ctx->executeCommand(trimCommand.get());
 
                 Params params;
                 params.set("filename", fn.c_str());
                 params.set("filename-format", fmt.c_str());
-                ctx->executeCommand(saveAsCommand, params);
+                ctx->executeCommand(saveAsCommand.get(), params);
 
                 if (trim) {     // Undo trim command
-                  ctx->executeCommand(undoCommand);
+                  ctx->executeCommand(undoCommand.get());
 
                   // Just in case allow non-linear history is enabled
                   // we clear redo information
@@ -413,18 +471,18 @@ void App::initialize(const AppOptions& options)
               }
 
               if (!cropParams.empty())
-                ctx->executeCommand(cropCommand, cropParams);
+                ctx->executeCommand(cropCommand.get(), cropParams);
 
               if (trim)
-                ctx->executeCommand(trimCommand);
+                ctx->executeCommand(trimCommand.get());
 
               Params params;
               params.set("filename", value.value().c_str());
               params.set("filename-format", format.c_str());
-              ctx->executeCommand(saveAsCommand, params);
+              ctx->executeCommand(saveAsCommand.get(), params);
 
               if (trim) {       // Undo trim command
-                ctx->executeCommand(undoCommand);
+                ctx->executeCommand(undoCommand.get());
 
                 // Just in case allow non-linear history is enabled
                 // we clear redo information
@@ -434,18 +492,24 @@ void App::initialize(const AppOptions& options)
           }
         }
         // --scale <factor>
-        else if (opt == &options.scale()) {
-          Command* command = CommandsModule::instance()->getCommandByName(CommandId::SpriteSize);
+        else if (opt == &options.scale() && i >= begin) {
+          base::UniquePtr<Command> command(clone_command(CommandId::SpriteSize));
           double scale = strtod(value.value().c_str(), NULL);
-          static_cast<SpriteSizeCommand*>(command)->setScale(scale, scale);
+          static_cast<SpriteSizeCommand*>(command.get())->setScale(scale, scale);
 
           // Scale all sprites
           for (auto doc : ctx->documents()) {
             ctx->setActiveDocument(static_cast<app::Document*>(doc));
-            ctx->executeCommand(command);
+            ctx->executeCommand(command.get());
           }
         }
       }
+      // Files before "begin" are processed by other job, we just
+      // reset the options that affect only the next given file.
+      else if (i < begin) {
+        importLayer.clear();
+        splitLayers = false;
+      }
       // File names aren't associated to any option
       else {
         const std::string& filename = value.value();
@@ -463,7 +527,7 @@ void App::initialize(const AppOptions& options)
           if (isGui())
             getRecentFiles()->addRecentFile(filename.c_str());
 
-          if (m_exporter != NULL) {
+          if (exporter != NULL) {
             if (!importLayer.empty()) {
               std::vector<Layer*> layers;
               doc->sprite()->getLayersList(layers);
@@ -476,16 +540,16 @@ void App::initialize(const AppOptions& options)
                 }
               }
               if (foundLayer)
-                m_exporter->addDocument(doc, foundLayer);
+                exporter->addDocument(doc, foundLayer);
             }
             else if (splitLayers) {
               std::vector<Layer*> layers;
               doc->sprite()->getLayersList(layers);
               for (auto layer : layers)
-                m_exporter->addDocument(doc, layer);
+                exporter->addDocument(doc, layer);
             }
             else
-              m_exporter->addDocument(doc);
+              exporter->addDocument(doc);
           }
         }
 
@@ -497,27 +561,125 @@ void App::initialize(const AppOptions& options)
       }
     }
 
-    if (m_exporter && !filenameFormat.empty())
-      m_exporter->setFilenameFormat(filenameFormat);
+    if (exporter && !filenameFormat.empty())
+      exporter->setFilenameFormat(filenameFormat);
   }
 
   // Export
-  if (m_exporter) {
+  if (exporter) {
     PRINTF("Exporting sheet...\n");
 
     if (ignoreEmpty)
-      m_exporter->setIgnoreEmptyCels(true);
+      exporter->setIgnoreEmptyCels(true);
 
     if (trim)
-      m_exporter->setTrimCels(true);
+      exporter->setTrimCels(true);
 
-    base::UniquePtr<Document> spriteSheet(m_exporter->exportSheet());
-    m_exporter.reset(NULL);
+    base::UniquePtr<Document> spriteSheet(exporter->exportSheet());
 
     PRINTF("Export sprite sheet: Done\n");
   }
 }
 
+// Each file given in the command line is loaded, processed, and
+// saved by an independent job (with its own context) in a pool of
+// threads. A job starts in a file name and ends before the next file
+// (the first job includes the options before the first file). The
+// console output of each job is printed in the same order as the
+// files were given.
+void App::processOptionsInJobs(const AppOptions& options)
+{
+  const AppOptions::ValueList& values = options.values();
+
+  struct Job {
+    std::size_t begin, end;
+    std::string filename;
+    std::ostringstream output;
+    double time;
+    int peakMemSize;
+    bool done;
+    Job() : begin(0), end(0), time(0.0), peakMemSize(0), done(false) { }
+  };
+
+  std::vector<std::size_t> starts;
+  for (std::size_t i=0; i<values.size(); ++i) {
+    if (!values[i].option())
+      starts.push_back(i);
+  }
+  if (starts.empty())
+    return;
+
+  std::vector<Job> jobs(starts.size());
+  for (std::size_t k=0; k<jobs.size(); ++k) {
+    jobs[k].begin = (k == 0 ? 0: starts[k]);
+    jobs[k].end = (k+1 < starts.size() ? starts[k+1]: values.size());
+    jobs[k].filename = values[starts[k]].value();
+  }
+
+  base::Chrono chrono;
+  std::mutex outputMutex;
+  std::size_t nextOutput = 0;
+  int threads = std::min(options.jobs(), int(jobs.size()));
+
+  PRINTF("Processing %d files in %d jobs...\n", int(jobs.size()), threads);
+  {
+    base::thread_pool pool(threads);
+
+    for (Job& job : jobs) {
+      pool.execute(
+        [this, &options, &job, &jobs, &outputMutex, &nextOutput]{
+          base::Chrono jobChrono;
+          BatchContext ctx;
+          ctx.setConsoleStream(&job.output);
+
+          // Memory used by the sprites of this job (sampled after
+          // each command, e.g. --scale, and at the end of the job).
+          auto updatePeakMemSize = [&ctx, &job](){
+            int size = 0;
+            for (auto doc : ctx.documents())
+              size += doc->sprite()->getMemSize();
+            job.peakMemSize = std::max(job.peakMemSize, size);
+          };
+          ctx.AfterCommandExecution.connect(
+            [&updatePeakMemSize](Command*){ updatePeakMemSize(); });
+
+          try {
+            processValues(options, &ctx, nullptr, job.begin, job.end);
+          }
+          catch (const std::exception& ex) {
+            job.output << "Error processing \"" << job.filename << "\": "
+                       << ex.what() << "\n";
+          }
+          updatePeakMemSize();
+          job.time = jobChrono.elapsed();
+
+          // Print the output of all finished jobs that follow the
+          // order of the given files.
+          std::unique_lock<std::mutex> lock(outputMutex);
+          job.done = true;
+          while (nextOutput < jobs.size() && jobs[nextOutput].done) {
+            std::string output = jobs[nextOutput++].output.str();
+            if (!output.empty()) {
+              fputs(output.c_str(), stdout);
+              fflush(stdout);
+            }
+          }
+        });
+    }
+
+    pool.wait_all();
+  }
+
+  // Summary
+  Console console;
+  console.printf("%d files processed in %.3f seconds using %d jobs\n",
+                 int(jobs.size()), chrono.elapsed(), threads);
+  for (const Job& job : jobs) {
+    console.printf("  %8.3f s  %10.1f KB  %s\n",
+                   job.time, job.peakMemSize / 1024.0, job.filename.c_str());
+  }
+}
+
 void App::run()
 {
   // Run the GUI
@@ -542,6 +704,24 @@ void App::run()
     gui_run();
   }
 
+  // Wait export jobs from the webserver.
+  if (m_isServer) {
+#ifdef ENABLE_WEBSERVER
+    app::WebServer webServer;
+    webServer.enableExportJobs(true);
+    webServer.start();
+
+    std::cout << PACKAGE " is waiting export jobs in "
+              << webServer.url() << "export\n"
+              << "X-Aseprite-Token: " << webServer.token() << "\n"
+              << std::flush;
+
+    webServer.waitUntilStopped();
+#else
+    std::cerr << "Your version of " PACKAGE " wasn't compiled with webserver support.\n";
+#endif
+  }
+
   // Start shell to execute scripts.
   if (m_isShell) {
     if (m_modules->m_scriptingEngine.supportEval()) {
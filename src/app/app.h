@@ -28,6 +28,7 @@ namespace ui {
 namespace app {
 
   class AppOptions;
+  class Context;
   class Document;
   class DocumentExporter;
   class INotificationDelegate;
@@ -62,6 +63,13 @@ namespace app {
     void initialize(const AppOptions& options);
     void run();
 
+    // Processes the files and commands given in the options. It can
+    // be called from other threads with its own context (e.g. to
+    // process export jobs). With --jobs N (and without a sprite
+    // sheet) each file is processed in parallel with its own context.
+    void processOptions(const AppOptions& options, Context* ctx,
+                        DocumentExporter* exporter);
+
     tools::ToolBox* getToolBox() const;
     RecentFiles* getRecentFiles() const;
     MainWindow* getMainWindow() const { return m_mainWindow; }
@@ -84,6 +92,11 @@ namespace app {
     class CoreModules;
     class Modules;
 
+    void processValues(const AppOptions& options, Context* ctx,
+                       DocumentExporter* exporter,
+                       std::size_t begin, std::size_t end);
+    void processOptionsInJobs(const AppOptions& options);
+
     static App* m_instance;
 
     base::UniquePtr<ui::GuiSystem> m_guiSystem;
@@ -92,6 +105,7 @@ namespace app {
     LegacyModules* m_legacy;
     bool m_isGui;
     bool m_isShell;
+    bool m_isServer;
     base::UniquePtr<MainWindow> m_mainWindow;
     FileList m_files;
     base::UniquePtr<DocumentExporter> m_exporter;
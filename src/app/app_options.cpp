@@ -13,6 +13,7 @@
 
 #include "base/path.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
@@ -24,10 +25,15 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
   , m_verboseEnabled(false)
+  , m_hasErrors(false)
+  , m_jobsNumber(1)
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Use a specific palette by default"))
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
   , m_batch(m_po.add("batch").description("Do not start the UI"))
+  , m_server(m_po.add("server").description("Do not start the UI, wait export jobs from\nlocal HTTP requests (POST /export with the\nprinted X-Aseprite-Token header)"))
+  , m_jobs(m_po.add("jobs").requiresValue("<n>").description("Load, process, and save each given file in\nparallel using N jobs (batch mode)"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given document with other format"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previous opened documents"))
   , m_data(m_po.add("data").requiresValue("<filename.json>").description("File to store the sprite sheet metadata"))
@@ -36,6 +42,9 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_sheetWidth(m_po.add("sheet-width").requiresValue("<pixels>").description("Sprite sheet width"))
   , m_sheetHeight(m_po.add("sheet-height").requiresValue("<pixels>").description("Sprite sheet height"))
   , m_sheetPack(m_po.add("sheet-pack").description("Use a packing algorithm to avoid waste of space\nin the texture"))
+  , m_sheetRotate(m_po.add("sheet-rotate").description("Rotate frames 90 degrees when they fit better\nin the packed texture"))
+  , m_sheetMaxSize(m_po.add("sheet-max-size").requiresValue("<width,height>").description("Maximum size of the packed texture, the\nframes that don't fit are saved in more textures"))
+  , m_sheetNpot(m_po.add("sheet-npot").description("The packed texture size doesn't need to be\na power of two"))
   , m_splitLayers(m_po.add("split-layers").description("Import each layer of the next given sprite as\na separated image in the sheet"))
   , m_importLayer(m_po.add("import-layer").requiresValue("<name>").description("Import just one layer of the next given sprite"))
   , m_ignoreEmpty(m_po.add("ignore-empty").description("Do not export empty frames/cels"))
@@ -55,6 +64,10 @@ AppOptions::AppOptions(int argc, const char* argv[])
     m_verboseEnabled = m_po.enabled(m_verbose);
     m_paletteFileName = m_po.value_of(m_palette);
     m_startShell = m_po.enabled(m_shell);
+    m_startServer = m_po.enabled(m_server);
+
+    if (m_po.enabled(m_jobs))
+      m_jobsNumber = std::max(1, std::atoi(m_po.value_of(m_jobs).c_str()));
 
     if (m_po.enabled(m_help)) {
       showHelp();
@@ -65,7 +78,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
       m_startUI = false;
     }
 
-    if (m_po.enabled(m_shell) || m_po.enabled(m_batch)) {
+    if (m_po.enabled(m_shell) || m_po.enabled(m_batch) || m_po.enabled(m_server)) {
       m_startUI = false;
     }
   }
@@ -73,6 +86,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
     std::cerr << m_exeName << ": " << parseError.what() << '\n'
               << "Try \"" << m_exeName << " --help\" for more information.\n";
     m_startUI = false;
+    m_hasErrors = true;
   }
 }
 
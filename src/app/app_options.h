@@ -27,8 +27,15 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
   bool verbose() const { return m_verboseEnabled; }
 
+  // Number of parallel jobs to process the given files (--jobs).
+  int jobs() const { return m_jobsNumber; }
+
+  // Returns true if the given arguments couldn't be parsed.
+  bool hasErrors() const { return m_hasErrors; }
+
   const std::string& paletteFileName() const { return m_paletteFileName; }
 
   const ValueList& values() const {
@@ -44,6 +51,9 @@ public:
   const Option& sheetWidth() const { return m_sheetWidth; }
   const Option& sheetHeight() const { return m_sheetHeight; }
   const Option& sheetPack() const { return m_sheetPack; }
+  const Option& sheetRotate() const { return m_sheetRotate; }
+  const Option& sheetMaxSize() const { return m_sheetMaxSize; }
+  const Option& sheetNpot() const { return m_sheetNpot; }
   const Option& splitLayers() const { return m_splitLayers; }
   const Option& importLayer() const { return m_importLayer; }
   const Option& ignoreEmpty() const { return m_ignoreEmpty; }
@@ -64,12 +74,17 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
   bool m_verboseEnabled;
+  bool m_hasErrors;
+  int m_jobsNumber;
   std::string m_paletteFileName;
 
   Option& m_palette;
   Option& m_shell;
   Option& m_batch;
+  Option& m_server;
+  Option& m_jobs;
   Option& m_saveAs;
   Option& m_scale;
   Option& m_data;
@@ -78,6 +93,9 @@ private:
   Option& m_sheetWidth;
   Option& m_sheetHeight;
   Option& m_sheetPack;
+  Option& m_sheetRotate;
+  Option& m_sheetMaxSize;
+  Option& m_sheetNpot;
   Option& m_splitLayers;
   Option& m_importLayer;
   Option& m_ignoreEmpty;
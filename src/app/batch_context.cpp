@@ -0,0 +1,63 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/batch_context.h"
+
+#include "app/document.h"
+#include "doc/layer.h"
+#include "doc/site.h"
+#include "doc/sprite.h"
+
+namespace app {
+
+BatchContext::BatchContext()
+  : m_activeDoc(nullptr)
+{
+}
+
+BatchContext::~BatchContext()
+{
+  // See the comment in App::run() about why we close the document
+  // before deleting it.
+  while (!documents().empty()) {
+    doc::Document* doc = documents().back();
+    doc->close();
+    delete doc;
+  }
+}
+
+void BatchContext::setActiveDocument(Document* document)
+{
+  m_activeDoc = document;
+}
+
+void BatchContext::onGetActiveSite(doc::Site* site) const
+{
+  if (Document* doc = m_activeDoc) {
+    site->document(doc);
+    site->sprite(doc->sprite());
+    site->layer(doc->sprite()->indexToLayer(LayerIndex(0)));
+    site->frame(0);
+  }
+}
+
+void BatchContext::onAddDocument(doc::Document* doc)
+{
+  m_activeDoc = static_cast<app::Document*>(doc);
+}
+
+void BatchContext::onRemoveDocument(doc::Document* doc)
+{
+  if (doc == m_activeDoc)
+    m_activeDoc = nullptr;
+}
+
+} // namespace app
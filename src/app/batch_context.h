@@ -0,0 +1,39 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_BATCH_CONTEXT_H_INCLUDED
+#define APP_BATCH_CONTEXT_H_INCLUDED
+#pragma once
+
+#include "app/context.h"
+
+namespace app {
+
+  // Context without UI used to process command line options in other
+  // threads (parallel --jobs, or export jobs of the webserver). The
+  // active document is the last loaded one (or the one selected with
+  // setActiveDocument()), as in the UIContext in --batch mode. The
+  // documents are closed and deleted with the context.
+  class BatchContext : public app::Context {
+  public:
+    BatchContext();
+    ~BatchContext();
+
+    void setActiveDocument(Document* document) override;
+
+  protected:
+    void onGetActiveSite(doc::Site* site) const override;
+    void onAddDocument(doc::Document* doc) override;
+    void onRemoveDocument(doc::Document* doc) override;
+
+  private:
+    Document* m_activeDoc;
+  };
+
+} // namespace app
+
+#endif
@@ -30,9 +30,9 @@ CopyRect::CopyRect(Image* dst, const Image* src, const gfx::Clip& clip)
   // Fill m_data with "src" data
 
   int lineSize = src->getRowStrideSize(m_clip.size.w);
-  m_data.resize(lineSize * m_clip.size.h);
+  std::vector<uint8_t> data(lineSize * m_clip.size.h);
 
-  auto it = m_data.begin();
+  auto it = data.begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = src->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
@@ -40,6 +40,8 @@ CopyRect::CopyRect(Image* dst, const Image* src, const gfx::Clip& clip)
     std::copy(addr, addr+lineSize, it);
     it += lineSize;
   }
+
+  m_data.compress(data);
 }
 
 void CopyRect::onExecute()
@@ -64,9 +66,11 @@ void CopyRect::swap()
 
   Image* image = this->image();
   int lineSize = this->lineSize();
+  std::vector<uint8_t> data;
+  m_data.uncompress(data);
   std::vector<uint8_t> tmp(lineSize);
 
-  auto it = m_data.begin();
+  auto it = data.begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = image->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
@@ -78,6 +82,8 @@ void CopyRect::swap()
     it += lineSize;
   }
 
+  m_data.compress(data);
+
   image->incrementVersion();
 }
 
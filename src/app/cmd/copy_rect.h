@@ -11,10 +11,9 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "doc/compressed_buffer.h"
 #include "gfx/clip.h"
 
-#include <vector>
-
 namespace doc {
   class Image;
 }
@@ -33,7 +32,7 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_data.size();
+      return sizeof(*this) + m_data.compressedSize();
     }
 
   private:
@@ -41,7 +40,7 @@ namespace cmd {
     int lineSize();
 
     gfx::Clip m_clip;
-    std::vector<uint8_t> m_data;
+    CompressedBuffer m_data;
   };
 
 } // namespace cmd
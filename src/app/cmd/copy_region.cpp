@@ -22,6 +22,8 @@ CopyRegion::CopyRegion(Image* dst, Image* src,
   const gfx::Region& region, int dst_dx, int dst_dy)
   : WithImage(dst)
 {
+  std::vector<uint8_t> pixels;
+
   // Save region pixels
   for (const auto& rc : region) {
     gfx::Clip clip(
@@ -35,11 +37,12 @@ CopyRegion::CopyRegion(Image* dst, Image* src,
     m_region.createUnion(m_region, gfx::Region(clip.dstBounds()));
 
     for (int y=0; y<clip.size.h; ++y)  {
-      m_stream.write(
-        (const char*)src->getPixelAddress(clip.src.x, clip.src.y+y),
-        src->getRowStrideSize(clip.size.w));
+      const uint8_t* addr = src->getPixelAddress(clip.src.x, clip.src.y+y);
+      pixels.insert(pixels.end(), addr, addr+src->getRowStrideSize(clip.size.w));
     }
   }
+
+  m_pixels.compress(pixels);
 }
 
 void CopyRegion::onExecute()
@@ -61,26 +64,30 @@ void CopyRegion::swap()
 {
   Image* image = this->image();
 
-  // Save current image region in "tmp" stream
-  std::stringstream tmp;
-  for (const auto& rc : m_region)
-    for (int y=0; y<rc.h; ++y)
-      tmp.write(
-        (const char*)image->getPixelAddress(rc.x, rc.y+y),
-        image->getRowStrideSize(rc.w));
+  // Save current image region in "tmp"
+  std::vector<uint8_t> tmp;
+  for (const auto& rc : m_region) {
+    for (int y=0; y<rc.h; ++y) {
+      const uint8_t* addr = image->getPixelAddress(rc.x, rc.y+y);
+      tmp.insert(tmp.end(), addr, addr+image->getRowStrideSize(rc.w));
+    }
+  }
+
+  // Restore m_pixels into the image
+  std::vector<uint8_t> pixels;
+  m_pixels.uncompress(pixels);
+  ASSERT(pixels.size() == tmp.size());
 
-  // Restore m_stream into the image
+  auto it = pixels.begin();
   for (const auto& rc : m_region) {
     for (int y=0; y<rc.h; ++y) {
-      m_stream.read(
-        (char*)image->getPixelAddress(rc.x, rc.y+y),
-        image->getRowStrideSize(rc.w));
+      int lineSize = image->getRowStrideSize(rc.w);
+      std::copy(it, it+lineSize, image->getPixelAddress(rc.x, rc.y+y));
+      it += lineSize;
     }
   }
 
-  // TODO use m_stream.swap(tmp) when clang and gcc support it
-  m_stream.str(tmp.str());
-  m_stream.clear();
+  m_pixels.compress(tmp);
 
   image->incrementVersion();
 }
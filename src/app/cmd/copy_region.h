@@ -11,10 +11,9 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "doc/compressed_buffer.h"
 #include "gfx/region.h"
 
-#include <sstream>
-
 namespace app {
 namespace cmd {
   using namespace doc;
@@ -30,15 +29,18 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) +
-        (size_t)const_cast<std::stringstream*>(&m_stream)->tellp();
+      return sizeof(*this) + m_region.size()*sizeof(gfx::Rect) +
+        m_pixels.compressedSize();
     }
 
   private:
     void swap();
 
     gfx::Region m_region;
-    std::stringstream m_stream;
+
+    // Pixels of each rectangle of m_region (compressed to reduce the
+    // memory used by the undo history)
+    CompressedBuffer m_pixels;
   };
 
 } // namespace cmd
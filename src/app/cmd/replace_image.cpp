@@ -39,7 +39,7 @@ void ReplaceImage::onExecute()
   // modify/re-add this same image ID
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
-  m_copy.reset(Image::createCopy(oldImage.get()));
+  write_image(m_copy, oldImage.get());
 
   replaceImage(m_oldImageId, m_newImage);
   m_newImage.reset();
@@ -50,10 +50,14 @@ void ReplaceImage::onUndo()
   ImageRef newImage = sprite()->getImageRef(m_newImageId);
   ASSERT(newImage);
   ASSERT(!sprite()->getImageRef(m_oldImageId));
-  m_copy->setId(m_oldImageId);
+  ImageRef oldImage(read_image(m_copy, false));
+  oldImage->setId(m_oldImageId);
 
-  replaceImage(m_newImageId, m_copy);
-  m_copy.reset(Image::createCopy(newImage.get()));
+  m_copy.str(std::string());
+  m_copy.clear();
+  write_image(m_copy, newImage.get());
+
+  replaceImage(m_newImageId, oldImage);
 }
 
 void ReplaceImage::onRedo()
@@ -61,10 +65,14 @@ void ReplaceImage::onRedo()
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
   ASSERT(!sprite()->getImageRef(m_newImageId));
-  m_copy->setId(m_newImageId);
+  ImageRef newImage(read_image(m_copy, false));
+  newImage->setId(m_newImageId);
+
+  m_copy.str(std::string());
+  m_copy.clear();
+  write_image(m_copy, oldImage.get());
 
-  replaceImage(m_oldImageId, m_copy);
-  m_copy.reset(Image::createCopy(oldImage.get()));
+  replaceImage(m_oldImageId, newImage);
 }
 
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
@@ -30,7 +30,7 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) +
-        (m_copy ? m_copy->getMemSize(): 0);
+        (size_t)const_cast<std::stringstream*>(&m_copy)->tellp();
     }
 
   private:
@@ -43,7 +43,10 @@ namespace cmd {
     // ReplaceImage() ctor until the ReplaceImage::onExecute() call.
     // Then the reference is not used anymore.
     ImageRef m_newImage;
-    ImageRef m_copy;
+
+    // Copy of the replaced image (serialized with write_image(), so
+    // pixels are compressed).
+    std::stringstream m_copy;
   };
 
 } // namespace cmd
@@ -17,6 +17,12 @@ CmdSequence::CmdSequence()
 {
 }
 
+CmdSequence::~CmdSequence()
+{
+  for (auto it = m_cmds.begin(), end=m_cmds.end(); it!=end; ++it)
+    delete *it;
+}
+
 void CmdSequence::add(Cmd* cmd)
 {
   m_cmds.push_back(cmd);
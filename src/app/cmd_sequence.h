@@ -18,7 +18,9 @@ namespace app {
   class CmdSequence : public Cmd {
   public:
     CmdSequence();
+    ~CmdSequence();
 
+    // Adds a command to the sequence (the sequence owns the command).
     void add(Cmd* cmd);
 
   protected:
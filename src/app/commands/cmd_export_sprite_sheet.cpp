@@ -487,7 +487,7 @@ void ExportSpriteSheetCommand::onExecute(Context* context)
   if (sheet_w == 0) sheet_w = fit.width;
   if (sheet_h == 0) sheet_h = fit.height;
 
-  DocumentExporter exporter;
+  DocumentExporter exporter(context);
   exporter.setTextureFilename(filename);
   if (!dataFilename.empty())
     exporter.setDataFilename(dataFilename);
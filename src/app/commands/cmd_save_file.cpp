@@ -83,7 +83,7 @@ static void save_document_in_background(const Context* context,
   job.showProgressWindow();
 
   if (fop->has_error()) {
-    Console console;
+    Console console(context);
     console.printf(fop->error.c_str());
 
     // We don't know if the file was saved correctly or not. So mark
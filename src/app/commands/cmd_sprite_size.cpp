@@ -23,13 +23,16 @@
 #include "app/transaction.h"
 #include "app/ui_context.h"
 #include "base/bind.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
 #include "doc/mask.h"
+#include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
@@ -74,37 +77,78 @@ protected:
     Transaction transaction(m_writer.context(), "Sprite Size");
     DocumentApi api = m_writer.document()->getApi(transaction);
 
-    int cels_count = 0;
-    for (Cel* cel : m_sprite->uniqueCels()) { // TODO add size() member function to CelsRange
-      (void)cel;
-      ++cels_count;
-    }
-
-    // For each cel...
-    int progress = 0;
-    for (Cel* cel : m_sprite->uniqueCels()) {
-      // Change its location
-      api.setCelPosition(m_sprite, cel, scale_x(cel->x()), scale_y(cel->y()));
+    std::vector<Cel*> cels;
+    for (Cel* cel : m_sprite->uniqueCels())
+      cels.push_back(cel);
+
+    // Cel images are resized in batches: all rows of the images of
+    // each batch are resized in parallel (in bands), and then the new
+    // images are replaced in the transaction from this thread.
+    base::thread_pool pool(base::thread_pool::hardware_threads());
+    const int batchSize = 4*pool.size();
+    const int bandHeight = 64;
+    std::vector<ImageRef> newImages;
+
+    for (int i=0; i<int(cels.size()); ) {
+      // All cels in a batch must use the same palette because the
+      // sprite has only one RgbMap.
+      const Palette* palette = m_sprite->palette(cels[i]->frame());
+      const RgbMap* rgbmap = m_sprite->rgbMap(cels[i]->frame());
+      int end = i+1;
+      while (end < int(cels.size()) && end-i < batchSize &&
+             m_sprite->palette(cels[end]->frame()) == palette)
+        ++end;
+
+      newImages.assign(end-i, ImageRef());
+
+      // Fixup the transparent colors of the source images (it must be
+      // done before resizing any row of the image)
+      for (int k=i; k<end; ++k) {
+        Cel* cel = cels[k];
+        Image* image = cel->image();
+        if (!image || cel->link())
+          continue;
 
-      // Get cel's image
-      Image* image = cel->image();
-      if (image && !cel->link()) {
-        // Resize the image
         int w = scale_x(image->width());
         int h = scale_y(image->height());
-        ImageRef new_image(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
+        newImages[k-i].reset(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
 
-        doc::algorithm::fixup_image_transparent_colors(image);
-        doc::algorithm::resize_image(image, new_image.get(),
-          m_resize_method,
-          m_sprite->palette(cel->frame()),
-          m_sprite->rgbMap(cel->frame()));
+        pool.execute([image]{
+            doc::algorithm::fixup_image_transparent_colors(image);
+          });
+      }
+      pool.wait_all();
+
+      // Resize the images
+      for (int k=i; k<end; ++k) {
+        Image* image = cels[k]->image();
+        Image* newImage = newImages[k-i].get();
+        if (!newImage)
+          continue;
+
+        for (int y=0; y<newImage->height(); y+=bandHeight) {
+          int h = MIN(bandHeight, newImage->height()-y);
+          ResizeMethod method = m_resize_method;
+          pool.execute([image, newImage, y, h, method, palette, rgbmap]{
+              doc::algorithm::resize_image_rows(
+                image, newImage, y, h, method, palette, rgbmap);
+            });
+        }
+      }
+      pool.wait_all();
+
+      for (int k=i; k<end; ++k) {
+        Cel* cel = cels[k];
+
+        // Change its location
+        api.setCelPosition(m_sprite, cel, scale_x(cel->x()), scale_y(cel->y()));
 
-        api.replaceImage(m_sprite, cel->imageRef(), new_image);
+        if (newImages[k-i])
+          api.replaceImage(m_sprite, cel->imageRef(), newImages[k-i]);
       }
 
-      jobProgress((float)progress / cels_count);
-      ++progress;
+      i = end;
+      jobProgress((float)i / cels.size());
 
       // cancel all the operation?
       if (isCanceled())
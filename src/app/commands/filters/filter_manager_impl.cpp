@@ -19,6 +19,7 @@
 #include "app/modules/editors.h"
 #include "app/transaction.h"
 #include "app/ui/editor/editor.h"
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/images_collector.h"
@@ -31,8 +32,12 @@
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <set>
 
 namespace app {
@@ -40,6 +45,68 @@ namespace app {
 using namespace std;
 using namespace ui;
 
+// Number of rows processed by each task when the filter is applied in
+// parallel.
+static const int kRowsPerBand = 16;
+
+// Threads shared by all filters (preview and final apply). Each
+// apply waits only for its own bands.
+static base::thread_pool& filter_bands_pool()
+{
+  static base::thread_pool pool(base::thread_pool::hardware_threads());
+  return pool;
+}
+
+// FilterManager used to apply the filter to a band of rows from a
+// worker thread. Each band has its own row and mask iterator, the
+// rest of the information comes from the FilterManagerImpl.
+class FilterManagerImpl::RowBand : public FilterManager {
+public:
+  RowBand(FilterManagerImpl* mgr) : m_mgr(mgr), m_row(0) { }
+
+  // Applies the filter to rows [row1, row2). Returns false if it
+  // wasn't possible to apply the filter to all rows.
+  bool apply(int row1, int row2) {
+    for (m_row=row1; m_row<row2; ++m_row) {
+      if (m_mgr->m_mask && m_mgr->m_mask->bitmap()) {
+        if (!m_mgr->lockMaskRow(m_row, m_maskBits, m_maskIterator))
+          return false;
+      }
+      m_mgr->applyFilterToRow(this);
+    }
+    return true;
+  }
+
+  // FilterManager implementation
+  const void* getSourceAddress() override {
+    return m_mgr->m_src->getPixelAddress(m_mgr->m_x, m_mgr->m_y+m_row);
+  }
+  void* getDestinationAddress() override {
+    return m_mgr->m_dst->getPixelAddress(m_mgr->m_x, m_mgr->m_y+m_row);
+  }
+  int getWidth() override { return m_mgr->m_w; }
+  Target getTarget() override { return m_mgr->m_target; }
+  FilterIndexedData* getIndexedData() override { return m_mgr; }
+  bool skipPixel() override {
+    bool skip = false;
+    if (m_mgr->m_mask && m_mgr->m_mask->bitmap()) {
+      if (!*m_maskIterator)
+        skip = true;
+      ++m_maskIterator;
+    }
+    return skip;
+  }
+  const Image* getSourceImage() override { return m_mgr->m_src; }
+  int x() override { return m_mgr->m_x; }
+  int y() override { return m_mgr->m_y+m_row; }
+
+private:
+  FilterManagerImpl* m_mgr;
+  int m_row;
+  ImageBits<BitmapTraits> m_maskBits;
+  ImageBits<BitmapTraits>::iterator m_maskIterator;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_context(context)
   , m_site(context->activeSite())
@@ -156,24 +223,11 @@ bool FilterManagerImpl::applyStep()
     return false;
 
   if ((m_mask) && (m_mask->bitmap())) {
-    int x = m_x - m_mask->bounds().x + m_offset_x;
-    int y = m_y - m_mask->bounds().y + m_offset_y + m_row;
-
-    if ((m_w - x < 1) || (m_h - y < 1))
+    if (!lockMaskRow(m_row, m_maskBits, m_maskIterator))
       return false;
-
-    m_maskBits = m_mask->bitmap()
-      ->lockBits<BitmapTraits>(Image::ReadLock,
-        gfx::Rect(x, y, m_w - x, m_h - y));
-
-    m_maskIterator = m_maskBits.begin();
   }
 
-  switch (m_site.sprite()->pixelFormat()) {
-    case IMAGE_RGB:       m_filter->applyToRgba(this); break;
-    case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(this); break;
-    case IMAGE_INDEXED:   m_filter->applyToIndexed(this); break;
-  }
+  applyFilterToRow(this);
   ++m_row;
 
   return true;
@@ -184,13 +238,18 @@ void FilterManagerImpl::apply(Transaction& transaction)
   bool cancelled = false;
 
   begin();
-  while (!cancelled && applyStep()) {
-    if (m_progressDelegate) {
-      // Report progress.
-      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_h);
-
-      // Does the user cancelled the whole process?
-      cancelled = m_progressDelegate->isCancelled();
+  if (m_filter->canApplyInParallel()) {
+    cancelled = !applyInParallel();
+  }
+  else {
+    while (!cancelled && applyStep()) {
+      if (m_progressDelegate) {
+        // Report progress.
+        m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_h);
+
+        // Does the user cancelled the whole process?
+        cancelled = m_progressDelegate->isCancelled();
+      }
     }
   }
 
@@ -201,6 +260,93 @@ void FilterManagerImpl::apply(Transaction& transaction)
   }
 }
 
+// Applies the filter to bands of rows in a thread pool. Returns false
+// if the process was cancelled.
+bool FilterManagerImpl::applyInParallel()
+{
+  if (m_row < 0 || m_h < 1)
+    return true;
+
+  // Get the RgbMap from this thread (so it's regenerated here if it's
+  // needed, and then the bands can only read it).
+  if (m_site.sprite()->pixelFormat() == IMAGE_INDEXED)
+    getRgbMap();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> cancelled(false);
+  int pendingBands = 0;
+  int doneRows = 0;
+
+  base::thread_pool& pool = filter_bands_pool();
+
+  for (int row=0; row<m_h; row+=kRowsPerBand) {
+    int row2 = MIN(row+kRowsPerBand, m_h);
+    ++pendingBands;
+
+    pool.execute(
+      [this, row, row2, &mutex, &cv, &cancelled, &pendingBands, &doneRows]{
+        if (!cancelled) {
+          RowBand band(this);
+          band.apply(row, row2);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        doneRows += row2 - row;
+        --pendingBands;
+        cv.notify_all();
+      });
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (pendingBands > 0) {
+    cv.wait_for(lock, std::chrono::milliseconds(100));
+
+    if (m_progressDelegate) {
+      float progress = m_progressBase + m_progressWidth * doneRows / m_h;
+      lock.unlock();
+
+      m_progressDelegate->reportProgress(progress);
+      if (m_progressDelegate->isCancelled())
+        cancelled = true;
+
+      lock.lock();
+    }
+  }
+
+  m_row = m_h;
+  return !cancelled;
+}
+
+void FilterManagerImpl::applyFilterToRow(FilterManager* filterMgr)
+{
+  switch (m_site.sprite()->pixelFormat()) {
+    case IMAGE_RGB:       m_filter->applyToRgba(filterMgr); break;
+    case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(filterMgr); break;
+    case IMAGE_INDEXED:   m_filter->applyToIndexed(filterMgr); break;
+  }
+}
+
+// Locks the mask bits to iterate the pixels of the given row. Returns
+// false if the row is outside the mask.
+bool FilterManagerImpl::lockMaskRow(int row,
+                                    ImageBits<BitmapTraits>& maskBits,
+                                    ImageBits<BitmapTraits>::iterator& maskIterator)
+{
+  int x = m_x - m_mask->bounds().x + m_offset_x;
+  int y = m_y - m_mask->bounds().y + m_offset_y + row;
+
+  if ((m_w - x < 1) || (m_h - y < 1))
+    return false;
+
+  maskBits = m_mask->bitmap()
+    ->lockBits<BitmapTraits>(Image::ReadLock,
+      gfx::Rect(x, y, m_w - x, m_h - y));
+
+  maskIterator = maskBits.begin();
+  return true;
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   bool cancelled = false;
@@ -107,8 +107,15 @@ namespace app {
     doc::RgbMap* getRgbMap();
 
   private:
+    class RowBand;
+
     void init(const doc::Layer* layer, doc::Image* image, int offset_x, int offset_y);
     void apply(Transaction& transaction);
+    bool applyInParallel();
+    void applyFilterToRow(FilterManager* filterMgr);
+    bool lockMaskRow(int row,
+                     doc::ImageBits<doc::BitmapTraits>& maskBits,
+                     doc::ImageBits<doc::BitmapTraits>::iterator& maskIterator);
     void applyToImage(Transaction& transaction, doc::Layer* layer, doc::Image* image, int x, int y);
     bool updateMask(doc::Mask* mask, const doc::Image* image);
 
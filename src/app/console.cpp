@@ -11,6 +11,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <ostream>
 
 #include "base/bind.h"
 #include "base/memory.h"
@@ -34,11 +35,14 @@ static int console_counter = 0;
 static bool console_locked;
 static bool want_close_flag = false;
 
-Console::Console(Context* ctx)
+Console::Console(const Context* ctx)
   : m_withUI(false)
+  , m_stream(nullptr)
 {
-  if (ctx)
+  if (ctx) {
     m_withUI = (ctx->isUiAvailable());
+    m_stream = ctx->consoleStream();
+  }
   else
     m_withUI =
       (App::instance()->isGui() &&
@@ -118,6 +122,10 @@ void Console::printf(const char* format, ...)
   va_end(ap);
 
   if (!m_withUI || !wid_console) {
+    if (m_stream) {
+      *m_stream << buf;
+      return;
+    }
     fputs(buf, stdout);
     fflush(stdout);
     return;
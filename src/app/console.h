@@ -10,13 +10,14 @@
 #pragma once
 
 #include <exception>
+#include <iosfwd>
 
 namespace app {
   class Context;
 
   class Console {
   public:
-    Console(Context* ctx = nullptr);
+    Console(const Context* ctx = nullptr);
     ~Console();
 
     void printf(const char *format, ...);
@@ -25,6 +26,7 @@ namespace app {
 
   private:
     bool m_withUI;
+    std::ostream* m_stream;
   };
 
 } // namespace app
@@ -25,11 +25,13 @@ namespace app {
 
 Context::Context()
   : m_settings(NULL)
+  , m_consoleStream(NULL)
 {
 }
 
 Context::Context(ISettings* settings)
   : m_settings(settings)
+  , m_consoleStream(NULL)
 {
 }
 
@@ -51,6 +53,13 @@ app::Document* Context::activeDocument() const
   return static_cast<app::Document*>(doc::Context::activeDocument());
 }
 
+void Context::setActiveDocument(Document* document)
+{
+  // Must be implemented by contexts that can process command line
+  // options (UIContext, or the context of an export job).
+  ASSERT(false);
+}
+
 void Context::executeCommand(const char* commandName)
 {
   Command* cmd = CommandsModule::instance()->getCommandByName(commandName);
@@ -62,7 +71,7 @@ void Context::executeCommand(const char* commandName)
 
 void Context::executeCommand(Command* command, const Params& params)
 {
-  Console console;
+  Console console(this);
 
   ASSERT(command != NULL);
 
@@ -16,6 +16,7 @@
 #include "base/signal.h"
 #include "doc/context.h"
 
+#include <iosfwd>
 #include <vector>
 
 namespace app {
@@ -48,7 +49,13 @@ namespace app {
 
     void sendDocumentToTop(doc::Document* document);
 
+    // Stream where the Console prints the messages of this context
+    // when there is no UI (stdout if it's null).
+    void setConsoleStream(std::ostream* os) { m_consoleStream = os; }
+    std::ostream* consoleStream() const { return m_consoleStream; }
+
     app::Document* activeDocument() const;
+    virtual void setActiveDocument(Document* document);
 
     void executeCommand(const char* commandName);
     virtual void executeCommand(Command* command, const Params& params = Params());
@@ -63,6 +70,9 @@ namespace app {
     // Settings in this context.
     ISettings* m_settings;
 
+    // Output of Console messages when there is no UI.
+    std::ostream* m_consoleStream;
+
     // Last updated flags.
     ContextFlags m_flags;
 
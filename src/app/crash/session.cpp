@@ -20,6 +20,7 @@
 #include "app/file/file.h"
 #include "app/ui_context.h"
 #include "base/bind.h"
+#include "base/chrono.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/path.h"
@@ -135,7 +136,19 @@ void Session::removeFromDisk()
 
 void Session::saveDocumentChanges(app::Document* doc)
 {
-  DocumentReader reader(doc, 250);
+  DocumentSnapshotPtr snapshot;
+  {
+    DocumentReader reader(doc, 250);
+    base::Chrono chrono;
+
+    // Copy modified objects while the document is locked, the
+    // compression and disk I/O is done later without the lock.
+    snapshot = take_document_snapshot(doc);
+
+    TRACE("DataRecovery: Document '%d' locked %.16g seconds for the snapshot\n",
+      doc->id(), chrono.elapsed());
+  }
+
   app::Context ctx;
   std::string dir = base::join_path(m_path,
     base::convert_to<std::string>(doc->id()));
@@ -145,7 +158,7 @@ void Session::saveDocumentChanges(app::Document* doc)
     base::make_directory(dir);
 
   // Save document information
-  write_document(dir, doc);
+  write_document_snapshot(dir, snapshot.get());
 }
 
 void Session::removeDocument(app::Document* doc)
@@ -26,7 +26,9 @@
 #include "doc/frame.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tag_io.h"
+#include "doc/image.h"
 #include "doc/image_io.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
@@ -35,6 +37,8 @@
 
 #include <fstream>
 #include <map>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -55,51 +59,79 @@ namespace {
 
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
 
-class Writer {
+// Copy of an object that must be saved in the backup.
+struct ObjectSnapshot {
+  const char* prefix;
+  ObjectId id;
+  ObjectVersion version;
+  std::string data;             // Serialized object
+  ImageRef image;               // Copy of the image (for images, which
+                                // are compressed later)
+};
+
+} // anonymous namespace
+
+class DocumentSnapshot {
+public:
+  DocumentSnapshot(ObjectId docId) : m_docId(docId) { }
+
+  ObjectId docId() const { return m_docId; }
+  std::vector<ObjectSnapshot>& objects() { return m_objects; }
+
+private:
+  ObjectId m_docId;
+  std::vector<ObjectSnapshot> m_objects;
+};
+
+namespace {
+
+// Copies all modified objects of a document in a snapshot (the
+// document must be locked).
+class SnapshotTaker {
 public:
-  Writer(const std::string& dir, app::Document* doc)
-    : m_dir(dir)
-    , m_doc(doc)
+  SnapshotTaker(app::Document* doc, DocumentSnapshot* snapshot)
+    : m_doc(doc)
+    , m_snapshot(snapshot)
     , m_objVersions(g_docVersions[doc->id()]) {
   }
 
-  void saveDocument() {
+  void takeDocument() {
     Sprite* spr = m_doc->sprite();
 
     // Save from objects without children (e.g. images), to aggregated
     // objects (e.g. cels, layers, etc.)
 
     for (Palette* pal : spr->getPalettes())
-      saveObject("pal", pal, &Writer::writePalette);
+      takeObject("pal", pal, &SnapshotTaker::writePalette);
 
     for (FrameTag* frtag : spr->frameTags())
-      saveObject("frtag", frtag, &Writer::writeFrameTag);
+      takeObject("frtag", frtag, &SnapshotTaker::writeFrameTag);
 
     for (Cel* cel : spr->uniqueCels()) {
-      saveObject("img", cel->image(), &Writer::writeImage);
-      saveObject("celdata", cel->data(), &Writer::writeCelData);
+      takeImage(cel->image());
+      takeObject("celdata", cel->data(), &SnapshotTaker::writeCelData);
     }
 
     for (Cel* cel : spr->cels())
-      saveObject("cel", cel, &Writer::writeCel);
+      takeObject("cel", cel, &SnapshotTaker::writeCel);
 
     std::vector<Layer*> layers;
     spr->getLayersList(layers);
     for (Layer* lay : layers)
-      saveObject("lay", lay, &Writer::writeLayerStructure);
+      takeObject("lay", lay, &SnapshotTaker::writeLayerStructure);
 
-    saveObject("spr", spr, &Writer::writeSprite);
-    saveObject("doc", m_doc, &Writer::writeDocumentFile);
+    takeObject("spr", spr, &SnapshotTaker::writeSprite);
+    takeObject("doc", m_doc, &SnapshotTaker::writeDocumentFile);
   }
 
 private:
 
-  void writeDocumentFile(std::ofstream& s, app::Document* doc) {
+  void writeDocumentFile(std::ostream& s, app::Document* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
   }
 
-  void writeSprite(std::ofstream& s, Sprite* spr) {
+  void writeSprite(std::ostream& s, Sprite* spr) {
     write8(s, spr->pixelFormat());
     write16(s, spr->width());
     write16(s, spr->height());
@@ -123,7 +155,7 @@ private:
       write32(s, pal->id());
   }
 
-  void writeLayerStructure(std::ofstream& s, Layer* lay) {
+  void writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -141,80 +173,121 @@ private:
     }
   }
 
-  void writeCel(std::ofstream& s, Cel* cel) {
+  void writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
   }
 
-  void writeCelData(std::ofstream& s, CelData* celdata) {
+  void writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
   }
 
-  void writeImage(std::ofstream& s, Image* img) {
-    write_image(s, img);
-  }
-
-  void writePalette(std::ofstream& s, Palette* pal) {
+  void writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, pal);
   }
 
-  void writeFrameTag(std::ofstream& s, FrameTag* frameTag) {
+  void writeFrameTag(std::ostream& s, FrameTag* frameTag) {
     write_frame_tag(s, frameTag);
   }
 
   template<typename T>
-  void saveObject(const char* prefix, T* obj, void (Writer::*writeMember)(std::ofstream&, T*)) {
+  ObjectSnapshot* addObject(const char* prefix, T* obj) {
     if (!obj->version())
       obj->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
-      return;
+    if (m_objVersions[obj->id()].newer() == obj->version())
+      return nullptr;
 
-    std::string fn = prefix;
-    fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
-
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
-
-    OFSTREAM(s, fullfn);
-    write32(s, 0);                // Leave a room for the magic number
-    (this->*writeMember)(s, obj); // Write the object
-
-    // Write the magic number
-    s.seekp(0);
-    write32(s, MAGIC_NUMBER);
+    ObjectSnapshot objSnapshot;
+    objSnapshot.prefix = prefix;
+    objSnapshot.id = obj->id();
+    objSnapshot.version = obj->version();
+    m_snapshot->objects().push_back(objSnapshot);
+    return &m_snapshot->objects().back();
+  }
 
-    // Remove the older version
-    try {
-      if (versions.older() && base::is_file(oldfn))
-        base::delete_file(oldfn);
-    }
-    catch (const std::exception&) {
-      TRACE(" - Cannot delete %s #%d v%d\n", prefix, obj->id(), versions.older());
+  // Small objects are serialized right now.
+  template<typename T>
+  void takeObject(const char* prefix, T* obj, void (SnapshotTaker::*writeMember)(std::ostream&, T*)) {
+    if (ObjectSnapshot* objSnapshot = addObject(prefix, obj)) {
+      std::ostringstream s;
+      (this->*writeMember)(s, obj);
+      objSnapshot->data = s.str();
     }
+  }
 
-    // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
-
-    TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
+  // Images are just copied, they are compressed without the document
+  // lock in write_document_snapshot().
+  void takeImage(Image* img) {
+    if (ObjectSnapshot* objSnapshot = addObject("img", img))
+      objSnapshot->image.reset(Image::createCopy(img));
   }
 
-  std::string m_dir;
   app::Document* m_doc;
+  DocumentSnapshot* m_snapshot;
   ObjVersionsMap& m_objVersions;
 };
 
+void write_object(const std::string& dir, ObjectSnapshot& obj, ObjVersions& versions)
+{
+  std::string fn = obj.prefix;
+  fn.push_back('-');
+  fn += base::convert_to<std::string>(obj.id);
+
+  std::string fullfn = base::join_path(dir, fn);
+  std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
+  fullfn += "." + base::convert_to<std::string>(obj.version);
+
+  OFSTREAM(s, fullfn);
+  write32(s, 0);                // Leave a room for the magic number
+
+  // Write the object
+  if (obj.image)
+    write_image(s, obj.image.get(), obj.id);
+  else
+    s.write(obj.data.c_str(), obj.data.size());
+
+  // Write the magic number
+  s.seekp(0);
+  write32(s, MAGIC_NUMBER);
+
+  // Remove the older version
+  try {
+    if (versions.older() && base::is_file(oldfn))
+      base::delete_file(oldfn);
+  }
+  catch (const std::exception&) {
+    TRACE(" - Cannot delete %s #%d v%d\n", obj.prefix, obj.id, versions.older());
+  }
+
+  // Rotate versions and add the latest one
+  versions.rotateRevisions(obj.version);
+
+  TRACE(" - Saved %s #%d v%d\n", obj.prefix, obj.id, obj.version);
+}
+
 } // anonymous namespace
 
 //////////////////////////////////////////////////////////////////////
 // Public API
 
-void write_document(const std::string& dir, app::Document* doc)
+DocumentSnapshotPtr take_document_snapshot(app::Document* doc)
+{
+  DocumentSnapshotPtr snapshot(new DocumentSnapshot(doc->id()));
+  SnapshotTaker taker(doc, snapshot.get());
+  taker.takeDocument();
+  return snapshot;
+}
+
+void write_document_snapshot(const std::string& dir, DocumentSnapshot* snapshot)
 {
-  Writer writer(dir, doc);
-  writer.saveDocument();
+  ObjVersionsMap& objVersions = g_docVersions[snapshot->docId()];
+
+  for (ObjectSnapshot& obj : snapshot->objects()) {
+    write_object(dir, obj, objVersions[obj.id]);
+
+    // Release the memory of the image copy as soon as possible
+    obj.image.reset();
+  }
 }
 
 void delete_document_internals(app::Document* doc)
@@ -9,13 +9,27 @@
 #define APP_CRASH_WRITE_DOCUMENT_H_INCLUDED
 #pragma once
 
+#include "base/shared_ptr.h"
+
 #include <string>
 
 namespace app {
 class Document;
 namespace crash {
 
-  void write_document(const std::string& dir, app::Document* doc);
+  // Copy of the objects of a document that were modified since the
+  // last backup.
+  class DocumentSnapshot;
+  typedef base::SharedPtr<DocumentSnapshot> DocumentSnapshotPtr;
+
+  // Takes a snapshot of the modified objects. The document must be
+  // locked, but this is fast as images are only copied here.
+  DocumentSnapshotPtr take_document_snapshot(app::Document* doc);
+
+  // Compresses and writes the snapshot objects in the given
+  // directory. It doesn't need the document lock.
+  void write_document_snapshot(const std::string& dir, DocumentSnapshot* snapshot);
+
   void delete_document_internals(app::Document* doc);
 
 } // namespace crash
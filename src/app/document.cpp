@@ -21,9 +21,6 @@
 #include "app/settings/settings.h"
 #include "app/util/boundary.h"
 #include "base/memory.h"
-#include "base/mutex.h"
-#include "base/scoped_lock.h"
-#include "base/thread.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/context.h"
@@ -45,9 +42,6 @@ using namespace doc;
 Document::Document(Sprite* sprite)
   : m_undo(new DocumentUndo)
   , m_associated_to_file(false)
-  , m_mutex(new mutex)
-  , m_write_lock(false)
-  , m_read_locks(0)
     // Information about the file format used to load/save this document
   , m_format_options(NULL)
     // Extra cel
@@ -64,6 +58,7 @@ Document::Document(Sprite* sprite)
   // Boundary stuff
   m_bound.nseg = 0;
   m_bound.seg = NULL;
+  m_bound.version = 0;
 
   if (sprite)
     sprites().add(sprite);
@@ -82,6 +77,17 @@ Document::~Document()
     base_free(m_bound.seg);
 
   destroyExtraCel();
+
+#ifdef _DEBUG
+  base::rw_lock::stats stats = m_rwLock.get_stats();
+  if (stats.contentions > 0) {
+    TRACE("Document <%d> lock stats: %d reads (%.3f s), %d writes (%.3f s), "
+          "%d contentions (%.3f s waiting), %d failures\n",
+          id(), stats.read_locks, stats.read_time,
+          stats.write_locks, stats.write_time,
+          stats.contentions, stats.wait_time, stats.failures);
+  }
+#endif
 }
 
 DocumentApi Document::getApi(Transaction& transaction)
@@ -230,8 +236,15 @@ const BoundSeg* Document::getBoundariesSegments() const
   return m_bound.seg;
 }
 
+int Document::getBoundariesVersion() const
+{
+  return m_bound.version;
+}
+
 void Document::generateMaskBoundaries(Mask* mask)
 {
+  ++m_bound.version;
+
   if (m_bound.seg) {
     base_free(m_bound.seg);
     m_bound.seg = NULL;
@@ -520,104 +533,36 @@ Document* Document::duplicate(DuplicateType type) const
 
 bool Document::lock(LockType lockType, int timeout)
 {
-  while (timeout >= 0) {
-    {
-      scoped_lock lock(*m_mutex);
-      switch (lockType) {
-
-        case ReadLock:
-          // If no body is writting the sprite...
-          if (!m_write_lock) {
-            // We can read it
-            ++m_read_locks;
-            return true;
-          }
-          break;
-
-        case WriteLock:
-          // If no body is reading and writting...
-          if (m_read_locks == 0 && !m_write_lock) {
-            // We can start writting the sprite...
-            m_write_lock = true;
-            TRACE("Document::lock: Locked <%d> to write\n", id());
-            return true;
-          }
-          break;
-
-      }
-    }
-
-    if (timeout > 0) {
-      int delay = MIN(100, timeout);
-      timeout -= delay;
-
-      TRACE("Document::lock: wait 100 msecs for <%d>\n", id());
-      base::this_thread::sleep_for(double(delay) / 1000.0);
-    }
-    else
-      break;
+  if (m_rwLock.lock(base::rw_lock::lock_type(lockType), timeout)) {
+    if (lockType == WriteLock)
+      TRACE("Document::lock: Locked <%d> to write\n", id());
+    return true;
   }
 
-  TRACE("Document::lock: Cannot lock <%d> to %s (has %d read locks and %d write locks)\n",
-    id(), (lockType == ReadLock ? "read": "write"), m_read_locks, m_write_lock);
+  TRACE("Document::lock: Cannot lock <%d> to %s\n",
+    id(), (lockType == ReadLock ? "read": "write"));
   return false;
 }
 
 bool Document::lockToWrite(int timeout)
 {
-  while (timeout >= 0) {
-    {
-      scoped_lock lock(*m_mutex);
-      // this only is possible if there are just one reader
-      if (m_read_locks == 1) {
-        ASSERT(!m_write_lock);
-        m_read_locks = 0;
-        m_write_lock = true;
-        TRACE("Document::lockToWrite: Locked <%d> to write\n", id());
-        return true;
-      }
-    }
-
-    if (timeout > 0) {
-      int delay = MIN(100, timeout);
-      timeout -= delay;
-
-      TRACE("Document::lockToWrite: wait 100 msecs for <%d>\n", id());
-      base::this_thread::sleep_for(double(delay) / 1000.0);
-    }
-    else
-      break;
+  if (m_rwLock.upgrade_to_write(timeout)) {
+    TRACE("Document::lockToWrite: Locked <%d> to write\n", id());
+    return true;
   }
 
-  TRACE("Document::lockToWrite: Cannot lock <%d> to write (has %d read locks and %d write locks)\n",
-    id(), m_read_locks, m_write_lock);
+  TRACE("Document::lockToWrite: Cannot lock <%d> to write\n", id());
   return false;
 }
 
 void Document::unlockToRead()
 {
-  scoped_lock lock(*m_mutex);
-
-  ASSERT(m_read_locks == 0);
-  ASSERT(m_write_lock);
-
-  m_write_lock = false;
-  m_read_locks = 1;
+  m_rwLock.downgrade_to_read();
 }
 
 void Document::unlock()
 {
-  scoped_lock lock(*m_mutex);
-
-  if (m_write_lock) {
-    m_write_lock = false;
-  }
-  else if (m_read_locks > 0) {
-    --m_read_locks;
-  }
-  else {
-    ASSERT(false);
-  }
+  m_rwLock.unlock();
 }
 
 void Document::onContextChanged()
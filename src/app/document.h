@@ -12,6 +12,7 @@
 #include "app/file/format_options.h"
 #include "base/disable_copying.h"
 #include "base/observable.h"
+#include "base/rw_lock.h"
 #include "base/shared_ptr.h"
 #include "base/unique_ptr.h"
 #include "doc/color.h"
@@ -25,10 +26,6 @@
 
 #include <string>
 
-namespace base {
-  class mutex;
-}
-
 namespace doc {
   class Cel;
   class Layer;
@@ -58,8 +55,8 @@ namespace app {
   class Document : public doc::Document {
   public:
     enum LockType {
-      ReadLock,
-      WriteLock
+      ReadLock = base::rw_lock::ReadLock,
+      WriteLock = base::rw_lock::WriteLock
     };
 
     Document(Sprite* sprite);
@@ -118,6 +115,10 @@ namespace app {
     int getBoundariesSegmentsCount() const;
     const BoundSeg* getBoundariesSegments() const;
 
+    // Incremented each time the boundaries are generated again, so
+    // data calculated from them can be cached.
+    int getBoundariesVersion() const;
+
     void generateMaskBoundaries(Mask* mask = NULL);
 
     //////////////////////////////////////////////////////////////////////
@@ -171,7 +172,8 @@ namespace app {
     // Multi-threading ("sprite wrappers" use this)
 
     // Locks the sprite to read or write on it, returning true if the
-    // sprite can be accessed in the desired mode.
+    // sprite can be accessed in the desired mode. The thread waits
+    // (at most "timeout" milliseconds) until the lock is released.
     bool lock(LockType lockType, int timeout);
 
     // If you've locked the sprite to read, using this method you can
@@ -184,6 +186,11 @@ namespace app {
 
     void unlock();
 
+    // Wait/hold times and contention of the document lock, useful to
+    // profile ContextReader/ContextWriter hotspots.
+    base::rw_lock::stats lockStats() const { return m_rwLock.get_stats(); }
+    void resetLockStats() { m_rwLock.reset_stats(); }
+
   protected:
     virtual void onContextChanged() override;
 
@@ -198,16 +205,11 @@ namespace app {
     struct {
       int nseg;
       BoundSeg* seg;
+      int version;
     } m_bound;
 
-    // Mutex to modify the 'locked' flag.
-    base::mutex* m_mutex;
-
-    // True if some thread is writing the sprite.
-    bool m_write_lock;
-
-    // Greater than zero when one or more threads are reading the sprite.
-    int m_read_locks;
+    // Readers/writer lock to access the sprite from several threads.
+    base::rw_lock m_rwLock;
 
     // Data to save the file in the same format that it was loaded
     base::SharedPtr<FormatOptions> m_format_options;
@@ -11,64 +11,67 @@
 
 #include "app/document_exporter.h"
 
-#include "app/cmd/set_pixel_format.h"
 #include "app/console.h"
 #include "app/document.h"
 #include "app/file/file.h"
 #include "app/filename_formatter.h"
-#include "app/ui_context.h"
 #include "base/convert_to.h"
 #include "base/path.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/dithering_method.h"
 #include "doc/frame_tag.h"
 #include "doc/image.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "gfx/packing_rects.h"
 #include "gfx/size.h"
+#include "render/quantization.h"
 #include "render/render.h"
 
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 using namespace doc;
 
 namespace app {
 
+// Bounds in the texture of a sample. It's shared between samples
+// with the same image (duplicated samples).
 class SampleBounds {
 public:
   SampleBounds(Sprite* sprite) :
-    m_originalSize(sprite->width(), sprite->height()),
-    m_trimmedBounds(0, 0, sprite->width(), sprite->height()),
-    m_inTextureBounds(0, 0, sprite->width(), sprite->height()) {
+    m_inTextureBounds(0, 0, sprite->width(), sprite->height()),
+    m_rotated(false),
+    m_page(0) {
   }
 
-  bool trimmed() const {
-    return m_trimmedBounds.x > 0
-      || m_trimmedBounds.y > 0
-      || m_trimmedBounds.w != m_originalSize.w
-      || m_trimmedBounds.h != m_originalSize.h;
-  }
-
-  const gfx::Size& originalSize() const { return m_originalSize; }
-  const gfx::Rect& trimmedBounds() const { return m_trimmedBounds; }
   const gfx::Rect& inTextureBounds() const { return m_inTextureBounds; }
-
-  void setTrimmedBounds(const gfx::Rect& bounds) { m_trimmedBounds = bounds; }
-  void setInTextureBounds(const gfx::Rect& bounds) { m_inTextureBounds = bounds; }
+  bool rotated() const { return m_rotated; }
+  int page() const { return m_page; }
+
+  void setInTextureBounds(const gfx::Rect& bounds,
+                          bool rotated = false, int page = 0) {
+    m_inTextureBounds = bounds;
+    m_rotated = rotated;
+    m_page = page;
+  }
 
 private:
-  gfx::Size m_originalSize;
-  gfx::Rect m_trimmedBounds;
   gfx::Rect m_inTextureBounds;
+  bool m_rotated;               // Rotated 90 degrees clockwise
+  int m_page;                   // Texture page (frame of the texture)
 };
 
 typedef base::SharedPtr<SampleBounds> SampleBoundsPtr;
@@ -83,6 +86,8 @@ public:
     m_frame(frame),
     m_filename(filename),
     m_innerPadding(innerPadding),
+    m_originalSize(sprite->width(), sprite->height()),
+    m_trimmedBounds(0, 0, sprite->width(), sprite->height()),
     m_bounds(new SampleBounds(sprite)),
     m_isDuplicated(false) {
   }
@@ -92,30 +97,54 @@ public:
   Layer* layer() const { return m_layer; }
   frame_t frame() const { return m_frame; }
   std::string filename() const { return m_filename; }
-  const gfx::Size& originalSize() const { return m_bounds->originalSize(); }
-  const gfx::Rect& trimmedBounds() const { return m_bounds->trimmedBounds(); }
+  const gfx::Size& originalSize() const { return m_originalSize; }
+  const gfx::Rect& trimmedBounds() const { return m_trimmedBounds; }
   const gfx::Rect& inTextureBounds() const { return m_bounds->inTextureBounds(); }
+  bool rotated() const { return m_bounds->rotated(); }
+  int page() const { return m_bounds->page(); }
+
+  // Rendered sample (with the trimmed bounds)
+  const ImageRef& image() const { return m_image; }
 
   gfx::Size requiredSize() const {
-    gfx::Size size = m_bounds->trimmedBounds().getSize();
+    gfx::Size size = m_trimmedBounds.getSize();
     size.w += 2*m_innerPadding;
     size.h += 2*m_innerPadding;
     return size;
   }
 
   bool trimmed() const {
-    return m_bounds->trimmed();
+    return m_trimmedBounds.x > 0
+      || m_trimmedBounds.y > 0
+      || m_trimmedBounds.w != m_originalSize.w
+      || m_trimmedBounds.h != m_originalSize.h;
+  }
+
+  // True if the background of the sample is opaque
+  bool hasBackground() const {
+    if (m_layer)
+      return m_layer->isBackground();
+    else
+      return (m_sprite->backgroundLayer() &&
+              m_sprite->backgroundLayer()->isVisible());
   }
 
-  void setTrimmedBounds(const gfx::Rect& bounds) { m_bounds->setTrimmedBounds(bounds); }
-  void setInTextureBounds(const gfx::Rect& bounds) { m_bounds->setInTextureBounds(bounds); }
+  void setTrimmedBounds(const gfx::Rect& bounds) { m_trimmedBounds = bounds; }
+  void setInTextureBounds(const gfx::Rect& bounds,
+                          bool rotated = false, int page = 0) {
+    m_bounds->setInTextureBounds(bounds, rotated, page);
+  }
+  void setImage(const ImageRef& image) { m_image = image; }
 
   bool isDuplicated() const { return m_isDuplicated; }
   SampleBoundsPtr sharedBounds() const { return m_bounds; }
 
-  void setSharedBounds(const SampleBoundsPtr& bounds) {
+  // Shares the texture area with other sample (so this sample isn't
+  // rendered in the texture)
+  void setDuplicateOf(const Sample& other) {
     m_isDuplicated = true;
-    m_bounds = bounds;
+    m_bounds = other.m_bounds;
+    m_image = other.m_image;
   }
 
 private:
@@ -124,10 +153,11 @@ private:
   Layer* m_layer;
   frame_t m_frame;
   std::string m_filename;
-  int m_borderPadding;
-  int m_shapePadding;
   int m_innerPadding;
+  gfx::Size m_originalSize;
+  gfx::Rect m_trimmedBounds;
   SampleBoundsPtr m_bounds;
+  ImageRef m_image;
   bool m_isDuplicated;
 };
 
@@ -139,8 +169,9 @@ public:
 
   bool empty() const { return m_samples.empty(); }
 
-  void addSample(const Sample& sample) {
+  Sample& addSample(const Sample& sample) {
     m_samples.push_back(sample);
+    return m_samples.back();
   }
 
   iterator begin() { return m_samples.begin(); }
@@ -212,8 +243,17 @@ public:
 class DocumentExporter::BestFitLayoutSamples :
     public DocumentExporter::LayoutSamples {
 public:
+  BestFitLayoutSamples(bool rotation, bool powerOfTwo,
+                       int maxWidth, int maxHeight)
+    : m_rotation(rotation)
+    , m_powerOfTwo(powerOfTwo)
+    , m_maxSize(maxWidth, maxHeight) {
+  }
+
   void layoutSamples(Samples& samples, int borderPadding, int shapePadding, int& width, int& height) override {
     gfx::PackingRects pr;
+    pr.setRotation(m_rotation);
+    pr.setPowerOfTwo(m_powerOfTwo);
 
     for (auto& sample : samples) {
       if (sample.isDuplicated())
@@ -222,32 +262,54 @@ public:
       pr.add(sample.requiredSize());
     }
 
+    // With a fixed texture size, the samples that don't fit are
+    // placed in other pages of the same size.
+    if (width > 0 && height > 0)
+      pr.setMaxSize(gfx::Size(width, height));
+    else
+      pr.setMaxSize(m_maxSize);
+
+    pr.bestFit();
+
+    // All pages are frames of the same texture sprite, so they need
+    // the same size.
     if (width == 0 || height == 0) {
-      gfx::Size sz = pr.bestFit();
-      width = sz.w;
-      height = sz.h;
+      width = height = 0;
+      for (int page=0; page<pr.pages(); ++page) {
+        width = MAX(width, pr.pageBounds(page).w);
+        height = MAX(height, pr.pageBounds(page).h);
+      }
     }
-    else
-      pr.pack(gfx::Size(width, height));
 
     auto it = samples.begin();
-    for (auto& rc : pr) {
-      if (it->isDuplicated())
-        continue;
+    for (int i=0; i<int(pr.size()); ++i) {
+      while (it != samples.end() && it->isDuplicated())
+        ++it;
 
       ASSERT(it != samples.end());
-      it->setInTextureBounds(rc);
+      it->setInTextureBounds(pr[i], pr.rotated(i), pr.page(i));
       ++it;
     }
   }
+
+private:
+  bool m_rotation;
+  bool m_powerOfTwo;
+  gfx::Size m_maxSize;
 };
 
-DocumentExporter::DocumentExporter()
- : m_dataFormat(DefaultDataFormat)
+DocumentExporter::DocumentExporter(Context* context)
+ : m_context(context)
+ , m_dataFormat(DefaultDataFormat)
+ , m_dataStream(nullptr)
  , m_textureFormat(DefaultTextureFormat)
  , m_textureWidth(0)
  , m_textureHeight(0)
  , m_texturePack(false)
+ , m_textureRotation(false)
+ , m_texturePowerOfTwo(true)
+ , m_textureMaxWidth(0)
+ , m_textureMaxHeight(0)
  , m_scale(1.0)
  , m_scaleMode(DefaultScaleMode)
  , m_ignoreEmptyCels(false)
@@ -260,11 +322,12 @@ DocumentExporter::DocumentExporter()
 
 Document* DocumentExporter::exportSheet()
 {
-  // We output the metadata to std::cout if the user didn't specify a file.
+  // We output the metadata to std::cout (or the given data stream) if
+  // the user didn't specify a file.
   std::ofstream fos;
   std::streambuf* osbuf;
   if (m_dataFilename.empty())
-    osbuf = std::cout.rdbuf();
+    osbuf = (m_dataStream ? m_dataStream->rdbuf(): std::cout.rdbuf());
   else {
 #ifdef _WIN32
     fos.open(base::from_utf8(m_dataFilename).c_str(), std::ios::out);
@@ -280,14 +343,15 @@ Document* DocumentExporter::exportSheet()
   Samples samples;
   captureSamples(samples);
   if (samples.empty()) {
-    Console console;
+    Console console(m_context);
     console.printf("No documents to export");
     return nullptr;
   }
 
   // 2) Layout those samples in a texture field.
   if (m_texturePack) {
-    BestFitLayoutSamples layout;
+    BestFitLayoutSamples layout(m_textureRotation, m_texturePowerOfTwo,
+                                m_textureMaxWidth, m_textureMaxHeight);
     layout.layoutSamples(samples,
       m_borderPadding, m_shapePadding, m_textureWidth, m_textureHeight);
   }
@@ -305,24 +369,69 @@ Document* DocumentExporter::exportSheet()
   Image* textureImage = texture->folder()->getFirstLayer()
     ->cel(frame_t(0))->image();
 
-  renderTexture(samples, textureImage);
+  renderTexture(samples, texture);
+
+  // Save the image files (before the metadata, so we know the file
+  // name of each texture page).
+  std::vector<std::string> pageFilenames;
+  m_textureFilenames.clear();
+  if (!m_textureFilename.empty())
+    saveTexture(textureDocument, pageFilenames);
 
   // Save the metadata.
-  createDataFile(samples, os, textureImage);
-
-  // Save the image files.
-  if (!m_textureFilename.empty()) {
-    textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(UIContext::instance(), textureDocument.get());
-    if (ret == 0)
-      textureDocument->markAsSaved();
-  }
+  createDataFile(samples, os, textureImage, pageFilenames);
 
   return textureDocument.release();
 }
 
+void DocumentExporter::saveTexture(Document* textureDocument,
+                                   std::vector<std::string>& pageFilenames)
+{
+  textureDocument->setFilename(m_textureFilename.c_str());
+  FileOp* fop = fop_to_save_document(m_context, textureDocument,
+                                     m_textureFilename.c_str(), "");
+  if (!fop)
+    return;
+
+  // Each page is saved in its own file when the format saves frames
+  // as a sequence of files. The names are kept relative to the
+  // given texture file name (as "image" in the metadata).
+  if (fop->seq.filename_list.size() > 1) {
+    std::string path = base::get_file_path(m_textureFilename);
+    for (const std::string& fn : fop->seq.filename_list) {
+      pageFilenames.push_back(
+        path.empty() ? base::get_file_name(fn):
+                       base::join_path(path, base::get_file_name(fn)));
+    }
+  }
+
+  fop_operate(fop, NULL);
+  fop_done(fop);
+
+  if (fop->has_error()) {
+    Console console(m_context);
+    console.printf(fop->error.c_str());
+  }
+  else {
+    textureDocument->markAsSaved();
+
+    if (!pageFilenames.empty())
+      m_textureFilenames = pageFilenames;
+    else
+      m_textureFilenames.push_back(m_textureFilename);
+  }
+
+  fop_free(fop);
+}
+
 void DocumentExporter::captureSamples(Samples& samples)
 {
+  // Samples by sprite/layer/frame (to find the samples of linked cels)
+  std::map<std::pair<Layer*, frame_t>, const Sample*> layerSamples;
+
+  // Samples by hash of their rendered image (to find duplicates)
+  std::unordered_map<uint64_t, std::vector<const Sample*> > samplesByHash;
+
   for (auto& item : m_documents) {
     Document* doc = item.doc;
     Sprite* sprite = doc->sprite();
@@ -359,7 +468,6 @@ void DocumentExporter::captureSamples(Samples& samples)
       Sample sample(doc, sprite, layer, frame, filename, m_innerPadding);
       Cel* cel = nullptr;
       Cel* link = nullptr;
-      bool done = false;
 
       if (layer && layer->isImage())
         cel = layer->cel(frame);
@@ -369,49 +477,43 @@ void DocumentExporter::captureSamples(Samples& samples)
 
       // Re-use linked samples
       if (link) {
-        for (const Sample& other : samples) {
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isDuplicated());
-
-            sample.setSharedBounds(other.sharedBounds());
-            done = true;
-            break;
-          }
+        auto it = layerSamples.find(std::make_pair(layer, link->frame()));
+        if (it != layerSamples.end()) {
+          const Sample* other = it->second;
+          sample.setTrimmedBounds(other->trimmedBounds());
+          sample.setDuplicateOf(*other);
+          samples.addSample(sample);
+          continue;
         }
-        ASSERT(done);
       }
 
-      if (!done && (m_ignoreEmptyCels || m_trimCels)) {
-        // Ignore empty cels
-        if (layer && layer->isImage() && !cel)
-          continue;
+      // Ignore empty cels
+      if ((m_ignoreEmptyCels || m_trimCels) &&
+          layer && layer->isImage() && !cel)
+        continue;
 
-        base::UniquePtr<Image> sampleRender(
-          Image::create(sprite->pixelFormat(),
-            sprite->width(),
-            sprite->height(),
-            m_sampleRenderBuf));
+      // Render the sample (this render is used to trim/ignore empty
+      // cels, to find duplicated samples, and then it's copied in the
+      // texture)
+      base::UniquePtr<Image> sampleRender(
+        Image::create(sprite->pixelFormat(),
+          sprite->width(),
+          sprite->height(),
+          m_sampleRenderBuf));
 
-        sampleRender->setMaskColor(sprite->transparentColor());
-        clear_image(sampleRender, sprite->transparentColor());
-        renderSample(sample, sampleRender, 0, 0);
+      sampleRender->setMaskColor(sprite->transparentColor());
+      clear_image(sampleRender, sprite->transparentColor());
+      renderSample(sample, sampleRender, 0, 0);
 
+      if (m_ignoreEmptyCels || m_trimCels) {
         gfx::Rect frameBounds;
         doc::color_t refColor = 0;
 
         if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
+          if (sample.hasBackground())
             refColor = get_pixel(sampleRender, 0, 0);
-          }
-          else {
+          else
             refColor = sprite->transparentColor();
-          }
         }
         else if (m_ignoreEmptyCels)
           refColor = sprite->transparentColor();
@@ -426,7 +528,32 @@ void DocumentExporter::captureSamples(Samples& samples)
           sample.setTrimmedBounds(frameBounds);
       }
 
-      samples.addSample(sample);
+      const gfx::Rect& bounds = sample.trimmedBounds();
+      ImageRef image(crop_image(sampleRender,
+          bounds.x, bounds.y, bounds.w, bounds.h,
+          sprite->transparentColor()));
+      sample.setImage(image);
+
+      // Re-use a previous sample with the same image
+      uint64_t hash = calculate_image_hash(image.get());
+      std::vector<const Sample*>& sameHash = samplesByHash[hash];
+      for (const Sample* other : sameHash) {
+        if (count_diff_between_images(other->image().get(), image.get()) == 0 &&
+            other->hasBackground() == sample.hasBackground() &&
+            (image->pixelFormat() != IMAGE_INDEXED ||
+             (other->image()->maskColor() == image->maskColor() &&
+              other->sprite()->palette(other->frame())->countDiff(
+                sprite->palette(frame), NULL, NULL) == 0))) {
+          sample.setDuplicateOf(*other);
+          break;
+        }
+      }
+
+      const Sample* added = &samples.addSample(sample);
+      if (!added->isDuplicated())
+        sameHash.push_back(added);
+      if (layer)
+        layerSamples[std::make_pair(layer, frame)] = added;
     }
   }
 }
@@ -437,6 +564,7 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
   PixelFormat pixelFormat = IMAGE_INDEXED;
   gfx::Rect fullTextureBounds(0, 0, m_textureWidth, m_textureHeight);
   int maxColors = 256;
+  int pages = 1;
 
   for (Samples::const_iterator
          it = samples.begin(),
@@ -461,6 +589,8 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
 
     fullTextureBounds |=
       gfx::Rect(it->inTextureBounds()).inflate(m_borderPadding);
+
+    pages = MAX(pages, it->page()+1);
   }
 
   base::UniquePtr<Sprite> sprite(Sprite::createBasicSprite(
@@ -469,36 +599,66 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
   if (palette != NULL)
     sprite->setPalette(palette, false);
 
+  // Each texture page is a frame of the sprite (so they are saved
+  // as a sequence of files)
+  if (pages > 1) {
+    LayerImage* layer = static_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    sprite->setTotalFrames(frame_t(pages));
+
+    for (frame_t frame(1); frame<pages; ++frame) {
+      ImageRef image(Image::create(pixelFormat,
+          fullTextureBounds.w, fullTextureBounds.h));
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
   base::UniquePtr<Document> document(new Document(sprite));
   sprite.release();
 
   return document.release();
 }
 
-void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage)
+void DocumentExporter::renderTexture(const Samples& samples, Sprite* texture)
 {
-  textureImage->clear(0);
+  LayerImage* layer = static_cast<LayerImage*>(texture->folder()->getFirstLayer());
+
+  for (frame_t frame(0); frame<texture->totalFrames(); ++frame)
+    layer->cel(frame)->image()->clear(0);
 
   for (const auto& sample : samples) {
     if (sample.isDuplicated())
       continue;
 
-    // Make the sprite compatible with the texture so the render()
-    // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
-      cmd::SetPixelFormat(
-        sample.sprite(),
-        textureImage->pixelFormat(),
-        DitheringMethod::NONE).execute(UIContext::instance());
+    Image* textureImage = layer->cel(frame_t(sample.page()))->image();
+
+    // Convert the sample to the texture format (e.g. indexed samples
+    // in a RGB texture when sprites have different palettes)
+    ImageRef image = sample.image();
+    if (image->pixelFormat() != textureImage->pixelFormat()) {
+      image.reset(render::convert_pixel_format(
+          image.get(), NULL, textureImage->pixelFormat(),
+          DitheringMethod::NONE, NULL,
+          sample.sprite()->palette(sample.frame()),
+          sample.hasBackground()));
+    }
+
+    if (sample.rotated()) {
+      ImageRef rotated(Image::create(image->pixelFormat(),
+          image->height(), image->width()));
+      rotated->setMaskColor(image->maskColor());
+      doc::rotate_image(image.get(), rotated.get(), 90);
+      image = rotated;
     }
 
-    renderSample(sample, textureImage,
+    render::composite_image(textureImage, image.get(),
       sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding);
+      sample.inTextureBounds().y+m_innerPadding,
+      255, BLEND_MODE_NORMAL);
   }
 }
 
-void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage)
+void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage,
+                                      const std::vector<std::string>& pageFilenames)
 {
   std::string frames_begin;
   std::string frames_end;
@@ -530,6 +690,11 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
     gfx::Rect spriteSourceBounds = sample.trimmedBounds();
     gfx::Rect frameBounds = sample.inTextureBounds();
 
+    // The frame size is the one before the rotation (as in other
+    // sprite sheet tools)
+    if (sample.rotated())
+      std::swap(frameBounds.w, frameBounds.h);
+
     if (filename_as_key)
       os << "   \"" << sample.filename() << "\": {\n";
     else if (filename_as_attr)
@@ -541,8 +706,15 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
        << "\"y\": " << frameBounds.y << ", "
        << "\"w\": " << frameBounds.w << ", "
        << "\"h\": " << frameBounds.h << " },\n"
-       << "    \"rotated\": false,\n"
-       << "    \"trimmed\": " << (sample.trimmed() ? "true": "false") << ",\n"
+       << "    \"rotated\": " << (sample.rotated() ? "true": "false") << ",\n"
+       << "    \"page\": " << sample.page() << ",\n";
+
+    // Texture file of this frame (when pages are saved in
+    // different files)
+    if (sample.page() < int(pageFilenames.size()))
+      os << "    \"image\": \"" << pageFilenames[sample.page()] << "\",\n";
+
+    os << "    \"trimmed\": " << (sample.trimmed() ? "true": "false") << ",\n"
        << "    \"spriteSourceSize\": { "
        << "\"x\": " << spriteSourceBounds.x << ", "
        << "\"y\": " << spriteSourceBounds.y << ", "
@@ -564,7 +736,13 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
      << " \"meta\": {\n"
      << "  \"app\": \"" << WEBSITE << "\",\n"
      << "  \"version\": \"" << VERSION << "\",\n";
-  if (!m_textureFilename.empty())
+  if (!pageFilenames.empty()) {
+    os << "  \"images\": [ ";
+    for (std::size_t i=0; i<pageFilenames.size(); ++i)
+      os << (i > 0 ? ", ": "") << "\"" << pageFilenames[i] << "\"";
+    os << " ],\n";
+  }
+  else if (!m_textureFilename.empty())
     os << "  \"image\": \"" << m_textureFilename.c_str() << "\",\n";
   os << "  \"format\": \"" << (textureImage->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
      << "  \"size\": { "
@@ -578,6 +756,7 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
 void DocumentExporter::renderSample(const Sample& sample, doc::Image* dst, int x, int y)
 {
   render::Render render;
+  render.setThreads(base::thread_pool::hardware_threads());
   gfx::Clip clip(x, y, sample.trimmedBounds());
 
   if (sample.layer()) {
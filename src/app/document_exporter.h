@@ -20,9 +20,11 @@
 namespace doc {
   class Image;
   class Layer;
+  class Sprite;
 }
 
 namespace app {
+  class Context;
   class Document;
 
   class DocumentExporter {
@@ -42,15 +44,26 @@ namespace app {
       DefaultScaleMode
     };
 
-    DocumentExporter();
+    // The context is used to save the texture and report errors
+    // (it can be the context of a batch job running in other thread).
+    DocumentExporter(Context* context);
 
     void setDataFormat(DataFormat format) { m_dataFormat = format; }
     void setDataFilename(const std::string& filename) { m_dataFilename = filename; }
+    // Stream where the metadata is written when there is no data
+    // filename (std::cout by default).
+    void setDataStream(std::ostream* os) { m_dataStream = os; }
     void setTextureFormat(TextureFormat format) { m_textureFormat = format; }
     void setTextureFilename(const std::string& filename) { m_textureFilename = filename; }
     void setTextureWidth(int width) { m_textureWidth = width; }
     void setTextureHeight(int height) { m_textureHeight = height; }
     void setTexturePack(bool state) { m_texturePack = state; }
+    void setTextureRotation(bool state) { m_textureRotation = state; }
+    void setTexturePowerOfTwo(bool state) { m_texturePowerOfTwo = state; }
+    void setTextureMaxSize(int width, int height) {
+      m_textureMaxWidth = width;
+      m_textureMaxHeight = height;
+    }
     void setScale(double scale) { m_scale = scale; }
     void setScaleMode(ScaleMode mode) { m_scaleMode = mode; }
     void setIgnoreEmptyCels(bool ignore) { m_ignoreEmptyCels = ignore; }
@@ -66,6 +79,10 @@ namespace app {
 
     Document* exportSheet();
 
+    // Files where the texture was saved by exportSheet() (one for
+    // each page when they are saved as a sequence of files).
+    const std::vector<std::string>& textureFilenames() const { return m_textureFilenames; }
+
   private:
     class Sample;
     class Samples;
@@ -75,8 +92,10 @@ namespace app {
 
     void captureSamples(Samples& samples);
     Document* createEmptyTexture(const Samples& samples);
-    void renderTexture(const Samples& samples, doc::Image* textureImage);
-    void createDataFile(const Samples& samples, std::ostream& os, doc::Image* textureImage);
+    void renderTexture(const Samples& samples, doc::Sprite* texture);
+    void saveTexture(Document* textureDocument, std::vector<std::string>& pageFilenames);
+    void createDataFile(const Samples& samples, std::ostream& os, doc::Image* textureImage,
+                        const std::vector<std::string>& pageFilenames);
     void renderSample(const Sample& sample, doc::Image* dst, int x, int y);
 
     class Item {
@@ -89,13 +108,20 @@ namespace app {
     };
     typedef std::vector<Item> Items;
 
+    Context* m_context;
     DataFormat m_dataFormat;
     std::string m_dataFilename;
+    std::ostream* m_dataStream;
     TextureFormat m_textureFormat;
     std::string m_textureFilename;
+    std::vector<std::string> m_textureFilenames;
     int m_textureWidth;
     int m_textureHeight;
     bool m_texturePack;
+    bool m_textureRotation;
+    bool m_texturePowerOfTwo;
+    int m_textureMaxWidth;
+    int m_textureMaxHeight;
     double m_scale;
     ScaleMode m_scaleMode;
     bool m_ignoreEmptyCels;
@@ -25,7 +25,9 @@
 namespace app {
 
 DocumentUndo::DocumentUndo()
-  : m_ctx(NULL)
+  : m_totalUndoSize(0)
+  , m_undoHistory(this)
+  , m_ctx(NULL)
   , m_savedCounter(0)
   , m_savedStateIsLost(false)
 {
@@ -46,7 +48,23 @@ void DocumentUndo::add(CmdTransaction* cmd)
     m_undoHistory.clearRedo();
   }
 
+  // The size is saved to subtract exactly the same amount when the
+  // state is deleted (the memSize() of some commands changes after
+  // undo/redo, see onUndoRedoState()).
+  size_t size = cmd->memSize();
   m_undoHistory.add(cmd);
+  m_cmdSizes[cmd] = size;
+  m_totalUndoSize += size;
+
+  // Delete the oldest undo states to keep the memory used by the
+  // history under the limit specified by the user (in megabytes).
+  if (App::instance()) {
+    size_t sizeLimit = size_t(App::instance()->preferences().undo.sizeLimit()) * 1024 * 1024;
+    while (m_totalUndoSize > sizeLimit &&
+           m_undoHistory.deleteFirstState()) {
+      // Do nothing
+    }
+  }
 }
 
 bool DocumentUndo::canUndo() const
@@ -137,6 +155,11 @@ Cmd* DocumentUndo::lastExecutedCmd() const
     return NULL;
 }
 
+size_t DocumentUndo::memSize() const
+{
+  return m_totalUndoSize;
+}
+
 const undo::UndoState* DocumentUndo::nextUndo() const
 {
   return m_undoHistory.currentState();
@@ -151,4 +174,31 @@ const undo::UndoState* DocumentUndo::nextRedo() const
     return m_undoHistory.firstState();
 }
 
+void DocumentUndo::onDeleteUndoState(undo::UndoState* state)
+{
+  auto it = m_cmdSizes.find(state->cmd());
+  ASSERT(it != m_cmdSizes.end());
+  if (it != m_cmdSizes.end()) {
+    ASSERT(m_totalUndoSize >= it->second);
+    m_totalUndoSize -= it->second;
+    m_cmdSizes.erase(it);
+  }
+
+  delete state->cmd();
+}
+
+void DocumentUndo::onUndoRedoState(undo::UndoState* state)
+{
+  // Commands that swap compressed data (e.g. cmd::CopyRect) use a
+  // different amount of memory after undo/redo.
+  auto it = m_cmdSizes.find(state->cmd());
+  ASSERT(it != m_cmdSizes.end());
+  if (it != m_cmdSizes.end()) {
+    size_t size = static_cast<const Cmd*>(state->cmd())->memSize();
+    ASSERT(m_totalUndoSize >= it->second);
+    m_totalUndoSize = m_totalUndoSize - it->second + size;
+    it->second = size;
+  }
+}
+
 } // namespace app
@@ -15,6 +15,7 @@
 #include "undo/undo_history.h"
 
 #include <string>
+#include <unordered_map>
 
 namespace doc {
   class Context;
@@ -26,7 +27,7 @@ namespace app {
   class Cmd;
   class CmdTransaction;
 
-  class DocumentUndo {
+  class DocumentUndo : public undo::UndoHistoryDelegate {
   public:
     DocumentUndo();
 
@@ -55,10 +56,26 @@ namespace app {
 
     int* savedCounter() { return &m_savedCounter; }
 
+    // Returns the approximate amount of memory (in bytes) used by the
+    // undo history. It's a running total, updated each time a state is
+    // added, deleted, undone or redone.
+    size_t memSize() const;
+
   private:
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
 
+    // undo::UndoHistoryDelegate impl
+    void onDeleteUndoState(undo::UndoState* state) override;
+    void onUndoRedoState(undo::UndoState* state) override;
+
+    // Sum of the memSize() of all commands in the history, and the
+    // size of each command when it was added. They're declared before
+    // m_undoHistory because they are used by onDeleteUndoState() when
+    // the history is destroyed.
+    size_t m_totalUndoSize;
+    std::unordered_map<const undo::UndoCommand*, size_t> m_cmdSizes;
+
     undo::UndoHistory m_undoHistory;
     doc::Context* m_ctx;
 
@@ -16,10 +16,20 @@
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
 #include <stdio.h>
+#include <string>
+#include <vector>
 
 #define ASE_FILE_MAGIC                  0xA5E0
 #define ASE_FILE_FRAME_MAGIC            0xF1FA
@@ -70,6 +80,9 @@ struct ASE_Chunk {
   int start;
 };
 
+class CelDecoder;
+class CelEncoder;
+
 static bool ase_file_read_header(FILE* f, ASE_Header* header);
 static void ase_file_prepare_header(FILE* f, ASE_Header* header, const Sprite* sprite);
 static void ase_file_write_header(FILE* f, ASE_Header* header);
@@ -80,7 +93,8 @@ static void ase_file_prepare_frame_header(FILE* f, ASE_FrameHeader* frame_header
 static void ase_file_write_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 
 static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame);
+static void ase_file_encode_cels(CelEncoder* encoder, Layer* layer, frame_t frame);
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame, CelEncoder* encoder);
 
 static void ase_file_read_padding(FILE* f, int bytes);
 static void ase_file_write_padding(FILE* f, int bytes);
@@ -95,8 +109,8 @@ static Palette* ase_file_read_color2_chunk(FILE* f, Sprite* sprite, frame_t fram
 static void ase_file_write_color2_chunk(FILE* f, ASE_FrameHeader* frame_header, Palette* pal);
 static Layer* ase_file_read_layer_chunk(FILE* f, Sprite* sprite, Layer** previous_layer, int* current_level);
 static void ase_file_write_layer_chunk(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end);
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite);
+static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, CelDecoder* decoder, size_t chunk_end);
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder);
 static Mask* ase_file_read_mask_chunk(FILE* f);
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, ASE_FrameHeader* frame_header, Mask* mask);
@@ -119,6 +133,96 @@ private:
   ASE_Chunk m_chunk;
 };
 
+// Decompresses the pixels of compressed cels in worker threads while
+// the main thread continues reading the rest of the file.
+class CelDecoder {
+public:
+  CelDecoder(FileOp* fop, const ASE_Header* header);
+  ~CelDecoder();
+
+  // Queues the compressed pixels of the given image to be decoded.
+  // The data is moved to the decoder.
+  void add(const ImageRef& image, std::vector<uint8_t>& data);
+
+  // Waits until all queued images are decoded.
+  void wait();
+
+  // Waits until all queued images are decoded reporting the progress
+  // to the FileOp. If the operation is stopped, images that weren't
+  // decoded yet (or couldn't be decoded) are cleared. Errors are
+  // reported with fop_error().
+  void finish();
+
+  // Reports the progress of the whole load operation to the FileOp,
+  // given the current position of the main thread in the file.
+  void progress(long filePos);
+
+private:
+  // Worker threads only use "image", the reference counter of
+  // "imageRef" is modified only from the main thread (it's not
+  // thread-safe).
+  struct Item {
+    Image* image;
+    ImageRef imageRef;
+    std::vector<uint8_t> data;
+    bool decoded;
+  };
+
+  void decode(Item* item);
+
+  FileOp* m_fop;
+  const ASE_Header* m_header;
+  long m_filePos;
+  std::deque<Item> m_items;
+  std::atomic<bool> m_canceled;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  int m_pending;
+  size_t m_decodedBytes;
+  std::vector<std::string> m_errors;
+  base::thread_pool m_pool;     // Destroyed first (it joins the workers)
+};
+
+// Compresses the images of cels in worker threads so the main thread
+// only has to write the already compressed data (in the same order
+// as always).
+class CelEncoder {
+public:
+  CelEncoder();
+  ~CelEncoder();
+
+  // Queues the image of the given cel to be compressed. Only a few
+  // cels ahead of the written one are compressed at the same time,
+  // so the memory used by the compressed data doesn't depend on the
+  // size of the sprite.
+  void add(const Cel* cel);
+
+  // Writes the compressed pixels of the given cel's image in the file
+  // (waiting the worker thread if it's needed).
+  void write(FILE* f, const Cel* cel);
+
+private:
+  struct Item {
+    const Cel* cel;
+    const Image* image;
+    std::vector<uint8_t> data;
+    std::string error;
+    bool done;
+  };
+
+  void dispatch();
+  void dispatchNext();
+  void encode(Item* item);
+
+  std::deque<const Cel*> m_queue; // Cels waiting to be compressed
+  std::list<Item> m_items;        // Compressed cels (or being compressed)
+  int m_window;                   // Max number of items in m_items
+  std::atomic<bool> m_canceled;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  base::thread_pool m_pool;     // Destroyed first (it joins the workers)
+};
+
 class AseFormat : public FileFormat {
   const char* onGetName() const { return "ase"; }
   const char* onGetExtensions() const { return "ase,aseprite"; }
@@ -175,11 +279,14 @@ bool AseFormat::onLoad(FileOp* fop)
   Layer* last_layer = sprite->folder();
   int current_level = -1;
 
+  // Cel images are decompressed in background while we read the file
+  CelDecoder decoder(fop, &header);
+
   /* read frame by frame to end-of-file */
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
     /* start frame position */
     int frame_pos = ftell(f);
-    fop_progress(fop, (float)frame_pos / (float)header.size);
+    decoder.progress(frame_pos);
 
     /* read frame header */
     ASE_FrameHeader frame_header;
@@ -195,7 +302,7 @@ bool AseFormat::onLoad(FileOp* fop)
       for (int c=0; c<frame_header.chunks; c++) {
         /* start chunk position */
         int chunk_pos = ftell(f);
-        fop_progress(fop, (float)chunk_pos / (float)header.size);
+        decoder.progress(chunk_pos);
 
         // Read chunk information
         int chunk_size = fgetl(f);
@@ -232,7 +339,7 @@ bool AseFormat::onLoad(FileOp* fop)
             /* fop_error(fop, "Cel chunk\n"); */
 
             ase_file_read_cel_chunk(f, sprite, frame,
-                                    sprite->pixelFormat(), fop, &header,
+                                    sprite->pixelFormat(), fop, &decoder,
                                     chunk_pos+chunk_size);
             break;
           }
@@ -280,6 +387,8 @@ bool AseFormat::onLoad(FileOp* fop)
       break;
   }
 
+  decoder.finish();
+
   fop->createDocument(sprite);
   sprite.release();
 
@@ -304,6 +413,11 @@ bool AseFormat::onSave(FileOp* fop)
   ase_file_prepare_header(f, &header, sprite);
   ase_file_write_header(f, &header);
 
+  // Start compressing all cel images in background
+  CelEncoder encoder;
+  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame)
+    ase_file_encode_cels(&encoder, sprite->folder(), frame);
+
   // Write frames
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
     // Prepare the frame header
@@ -335,7 +449,7 @@ bool AseFormat::onSave(FileOp* fop)
     }
 
     // Write cel chunks
-    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame);
+    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame, &encoder);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -498,7 +612,26 @@ static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer*
   }
 }
 
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame)
+// Queues the cels of the given frame in the same order that
+// ase_file_write_cels() writes them.
+static void ase_file_encode_cels(CelEncoder* encoder, Layer* layer, frame_t frame)
+{
+  if (layer->isImage()) {
+    Cel* cel = layer->cel(frame);
+    if (cel && !cel->link() && cel->image())
+      encoder->add(cel);
+  }
+
+  if (layer->isFolder()) {
+    LayerIterator it = static_cast<LayerFolder*>(layer)->getLayerBegin();
+    LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
+
+    for (; it != end; ++it)
+      ase_file_encode_cels(encoder, *it, frame);
+  }
+}
+
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame, CelEncoder* encoder)
 {
   if (layer->isImage()) {
     Cel* cel = layer->cel(frame);
@@ -506,7 +639,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
 /*       fop_error(fop, "New cel in frame %d, in layer %d\n", */
 /*                   frame, sprite_layer2index(sprite, layer)); */
 
-      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite);
+      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite, encoder);
     }
   }
 
@@ -515,7 +648,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
     LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
 
     for (; it != end; ++it)
-      ase_file_write_cels(f, frame_header, sprite, *it, frame);
+      ase_file_write_cels(f, frame_header, sprite, *it, frame, encoder);
   }
 }
 
@@ -839,7 +972,7 @@ public:
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void read_raw_image(FILE* f, Image* image, FileOp* fop, ASE_Header* header)
+static void read_raw_image(FILE* f, Image* image, CelDecoder* decoder)
 {
   PixelIO<ImageTraits> pixel_io;
   int x, y;
@@ -848,7 +981,7 @@ static void read_raw_image(FILE* f, Image* image, FileOp* fop, ASE_Header* heade
     for (x=0; x<image->width(); x++)
       put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
 
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
+    decoder->progress(ftell(f));
   }
 }
 
@@ -868,7 +1001,7 @@ static void write_raw_image(FILE* f, Image* image)
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileOp* fop, ASE_Header* header)
+static void read_compressed_image(const uint8_t* data, size_t size, Image* image)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -882,68 +1015,38 @@ static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileO
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
-  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> uncompressed(image->height() * ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
-
-  while (true) {
-    size_t input_bytes;
-
-    if (ftell(f)+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - ftell(f); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
-
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else
-      input_bytes = compressed.size();
-
-    size_t bytes_read = fread(&compressed[0], 1, input_bytes, f);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
+  // One extra byte to detect streams with more pixels than expected
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  std::vector<uint8_t> uncompressed(image->height() * rowBytes + 1);
 
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+  zstream.next_in = (Bytef*)data;
+  zstream.avail_in = size;
+  zstream.next_out = (Bytef*)&uncompressed[0];
+  zstream.avail_out = uncompressed.size();
 
-      err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in inflate().", err);
+  err = inflate(&zstream, Z_NO_FLUSH);
+  size_t uncompressed_bytes = zstream.total_out;
+  inflateEnd(&zstream);
 
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
+  if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+    throw base::Exception("ZLib error %d in inflate().", err);
 
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
+  if (uncompressed_bytes > uncompressed.size()-1)
+    throw base::Exception("Bad compressed image.");
 
-        uncompressed_offset += uncompressed_bytes;
-      }
-    } while (zstream.avail_out == 0);
-
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
-  }
-
-  uncompressed_offset = 0;
+  size_t uncompressed_offset = 0;
   for (y=0; y<image->height(); y++) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)image->getPixelAddress(0, y);
 
     pixel_io.read_scanline(address, image->width(), &uncompressed[uncompressed_offset]);
 
-    uncompressed_offset += ImageTraits::getRowStrideBytes(image->width());
+    uncompressed_offset += rowBytes;
   }
-
-  err = inflateEnd(&zstream);
-  if (err != Z_OK)
-    throw base::Exception("ZLib error %d in inflateEnd().", err);
 }
 
 template<typename ImageTraits>
-static void write_compressed_image(FILE* f, Image* image)
+static void write_compressed_image(const Image* image, std::vector<uint8_t>& compressed)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -956,8 +1059,14 @@ static void write_compressed_image(FILE* f, Image* image)
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
-  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  std::vector<uint8_t> scanline(rowBytes);
+
+  // deflateBound() is big enough to compress the whole image in one
+  // pass, so we don't need to grow the output buffer.
+  compressed.resize(deflateBound(&zstream, image->height() * rowBytes));
+  zstream.next_out = (Bytef*)&compressed[0];
+  zstream.avail_out = compressed.size();
 
   for (y=0; y<image->height(); y++) {
     typename ImageTraits::address_t address =
@@ -969,36 +1078,256 @@ static void write_compressed_image(FILE* f, Image* image)
     zstream.avail_in = scanline.size();
     int flush = (y == image->height()-1 ? Z_FINISH: Z_NO_FLUSH);
 
-    do {
-      zstream.next_out = (Bytef*)&compressed[0];
-      zstream.avail_out = compressed.size();
-
-      // Compress
-      err = deflate(&zstream, flush);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in deflate().", err);
-
-      int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-      }
-    } while (zstream.avail_out == 0);
+    // Compress
+    err = deflate(&zstream, flush);
+    if (err != Z_OK && err != Z_STREAM_END) {
+      deflateEnd(&zstream);
+      throw base::Exception("ZLib error %d in deflate().", err);
+    }
   }
 
+  compressed.resize(zstream.total_out);
+
   err = deflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Parallel compression/decompression of cels
+//////////////////////////////////////////////////////////////////////
+
+CelDecoder::CelDecoder(FileOp* fop, const ASE_Header* header)
+  : m_fop(fop)
+  , m_header(header)
+  , m_filePos(0)
+  , m_canceled(false)
+  , m_pending(0)
+  , m_decodedBytes(0)
+  , m_pool(base::thread_pool::hardware_threads())
+{
+}
+
+CelDecoder::~CelDecoder()
+{
+  // Remaining tasks (e.g. if an exception was thrown) are skipped
+  m_canceled = true;
+}
+
+void CelDecoder::add(const ImageRef& image, std::vector<uint8_t>& data)
+{
+  m_items.push_back(Item());
+  Item* item = &m_items.back();
+  item->image = image.get();
+  item->imageRef = image;
+  item->data.swap(data);
+  item->decoded = false;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_pending;
+  }
+  m_pool.execute([this, item]{ decode(item); });
+}
+
+void CelDecoder::wait()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cv.wait(lock, [this]{ return m_pending == 0; });
+}
+
+void CelDecoder::finish()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_pending > 0) {
+    m_cv.wait_for(lock, std::chrono::milliseconds(100));
+
+    lock.unlock();
+    progress(m_filePos);
+    if (fop_is_stop(m_fop))
+      m_canceled = true;
+    lock.lock();
+  }
+
+  for (const auto& error : m_errors)
+    fop_error(m_fop, error.c_str());
+  m_errors.clear();
+
+  // Clear images that were skipped (the operation was stopped) or
+  // couldn't be decoded, so they don't contain uninitialized pixels.
+  for (Item& item : m_items) {
+    if (!item.decoded)
+      clear_image(item.image,
+                  item.image->pixelFormat() == IMAGE_INDEXED ?
+                  m_header->transparent_index: 0);
+  }
+}
+
+void CelDecoder::progress(long filePos)
+{
+  size_t decodedBytes;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    decodedBytes = m_decodedBytes;
+  }
+
+  // Reading the file is the first half of the work, and decoding the
+  // cels the other half.
+  m_filePos = filePos;
+  fop_progress(m_fop, float(filePos + decodedBytes) / float(2*m_header->size));
+}
+
+void CelDecoder::decode(Item* item)
+{
+  const size_t size = item->data.size();
+
+  if (!m_canceled && size > 0) {
+    Image* image = item->image;
+
+    try {
+      switch (image->pixelFormat()) {
+
+        case IMAGE_RGB:
+          read_compressed_image<RgbTraits>(&item->data[0], size, image);
+          break;
+
+        case IMAGE_GRAYSCALE:
+          read_compressed_image<GrayscaleTraits>(&item->data[0], size, image);
+          break;
+
+        case IMAGE_INDEXED:
+          read_compressed_image<IndexedTraits>(&item->data[0], size, image);
+          break;
+      }
+      item->decoded = true;
+    }
+    // OK, in case of error we can show the problem (from the main
+    // thread), but continue loading more cels.
+    catch (const std::exception& e) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_errors.push_back(e.what());
+    }
+  }
+
+  std::vector<uint8_t>().swap(item->data);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_decodedBytes += size;
+  if (--m_pending == 0)
+    m_cv.notify_all();
+}
+
+CelEncoder::CelEncoder()
+  : m_canceled(false)
+  , m_pool(base::thread_pool::hardware_threads())
+{
+  m_window = 2*m_pool.size();
+}
+
+CelEncoder::~CelEncoder()
+{
+  // If the save operation was stopped, pending cels are skipped
+  m_canceled = true;
+}
+
+void CelEncoder::add(const Cel* cel)
+{
+  m_queue.push_back(cel);
+  dispatch();
+}
+
+void CelEncoder::write(FILE* f, const Cel* cel)
+{
+  auto isCel = [cel](const Item& item){ return item.cel == cel; };
+  auto it = std::find_if(m_items.begin(), m_items.end(), isCel);
+
+  // Cels are written in the same order they were added, but just in
+  // case we compress the queued cels until we find the given one.
+  while (it == m_items.end() && !m_queue.empty()) {
+    dispatchNext();
+    if (m_items.back().cel == cel)
+      it = --m_items.end();
+  }
+
+  ASSERT(it != m_items.end());
+  if (it == m_items.end())
+    throw base::Exception("Cel image wasn't compressed.\n");
+
+  Item* item = &(*it);
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [item]{ return item->done; });
+  }
+
+  if (!item->error.empty())
+    throw base::Exception(item->error);
+
+  if ((fwrite(&item->data[0], 1, item->data.size(), f) != item->data.size())
+      || ferror(f))
+    throw base::Exception("Error writing compressed image pixels.\n");
+
+  // The item is done, so the worker thread doesn't use it anymore
+  m_items.erase(it);
+  dispatch();
+}
+
+// Starts compressing queued cels until the window is full.
+void CelEncoder::dispatch()
+{
+  while (!m_queue.empty() && int(m_items.size()) < m_window)
+    dispatchNext();
+}
+
+void CelEncoder::dispatchNext()
+{
+  const Cel* cel = m_queue.front();
+  m_queue.pop_front();
+
+  m_items.push_back(Item());
+  Item* item = &m_items.back();
+  item->cel = cel;
+  item->image = cel->image();
+  item->done = false;
+
+  m_pool.execute([this, item]{ encode(item); });
+}
+
+void CelEncoder::encode(Item* item)
+{
+  if (!m_canceled) {
+    try {
+      switch (item->image->pixelFormat()) {
+
+        case IMAGE_RGB:
+          write_compressed_image<RgbTraits>(item->image, item->data);
+          break;
+
+        case IMAGE_GRAYSCALE:
+          write_compressed_image<GrayscaleTraits>(item->image, item->data);
+          break;
+
+        case IMAGE_INDEXED:
+          write_compressed_image<IndexedTraits>(item->image, item->data);
+          break;
+      }
+    }
+    catch (const std::exception& e) {
+      item->error = e.what();
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  item->done = true;
+  m_cv.notify_all();
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
                                     PixelFormat pixelFormat,
-                                    FileOp* fop, ASE_Header* header, size_t chunk_end)
+                                    FileOp* fop, CelDecoder* decoder, size_t chunk_end)
 {
   /* read chunk data */
   LayerIndex layer_index = LayerIndex(fgetw(f));
@@ -1039,15 +1368,15 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
         switch (image->pixelFormat()) {
 
           case IMAGE_RGB:
-            read_raw_image<RgbTraits>(f, image.get(), fop, header);
+            read_raw_image<RgbTraits>(f, image.get(), decoder);
             break;
 
           case IMAGE_GRAYSCALE:
-            read_raw_image<GrayscaleTraits>(f, image.get(), fop, header);
+            read_raw_image<GrayscaleTraits>(f, image.get(), decoder);
             break;
 
           case IMAGE_INDEXED:
-            read_raw_image<IndexedTraits>(f, image.get(), fop, header);
+            read_raw_image<IndexedTraits>(f, image.get(), decoder);
             break;
         }
 
@@ -1072,6 +1401,9 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
           cel->setFrame(frame);
         }
         else {
+          // We need the pixels of the linked cel to copy them
+          decoder->wait();
+
           cel.reset(Cel::createCopy(link));
           cel->setFrame(frame);
           cel->setPosition(x, y);
@@ -1093,28 +1425,14 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
       if (w > 0 && h > 0) {
         ImageRef image(Image::create(pixelFormat, w, h));
 
-        // Try to read pixel data
-        try {
-          switch (image->pixelFormat()) {
-
-            case IMAGE_RGB:
-              read_compressed_image<RgbTraits>(f, image.get(), chunk_end, fop, header);
-              break;
+        // Read the compressed pixels, they are decoded by a worker
+        // thread of the CelDecoder.
+        long pos = ftell(f);
+        std::vector<uint8_t> compressed(chunk_end > size_t(pos) ? chunk_end - pos: 0);
+        if (!compressed.empty())
+          compressed.resize(fread(&compressed[0], 1, compressed.size(), f));
 
-            case IMAGE_GRAYSCALE:
-              read_compressed_image<GrayscaleTraits>(f, image.get(), chunk_end, fop, header);
-              break;
-
-            case IMAGE_INDEXED:
-              read_compressed_image<IndexedTraits>(f, image.get(), chunk_end, fop, header);
-              break;
-          }
-        }
-        // OK, in case of error we can show the problem, but continue
-        // loading more cels.
-        catch (const std::exception& e) {
-          fop_error(fop, e.what());
-        }
+        decoder->add(image, compressed);
 
         cel.reset(new Cel(frame, image));
         cel->setPosition(x, y);
@@ -1132,7 +1450,7 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
   return cel.release();
 }
 
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite)
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
@@ -1194,21 +1512,8 @@ static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        // Pixel data
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB:
-            write_compressed_image<RgbTraits>(f, image);
-            break;
-
-          case IMAGE_GRAYSCALE:
-            write_compressed_image<GrayscaleTraits>(f, image);
-            break;
-
-          case IMAGE_INDEXED:
-            write_compressed_image<IndexedTraits>(f, image);
-            break;
-        }
+        // Pixel data (compressed in background)
+        encoder->write(f, cel);
       }
       else {
         // Width and height
@@ -42,6 +42,10 @@ class BmpFormat : public FileFormat {
     uint32_t red_mask;          // Mask for red channel.
     uint32_t green_mask;        // Mask for green channel.
     uint32_t blue_mask;         // Mask for blue channel.
+
+    FormatOptions* clone() const override {
+      return new BmpOptions(*this);
+    }
   };
 
   const char* onGetName() const { return "bmp"; }
@@ -28,13 +28,17 @@
 #include "base/scoped_lock.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "render/quantization.h"
 #include "render/render.h"
 #include "ui/alert.h"
 
+#include <condition_variable>
 #include <cstring>
 #include <cstdarg>
+#include <mutex>
+#include <vector>
 
 namespace app {
 
@@ -42,6 +46,10 @@ using namespace base;
 
 static FileOp* fop_new(FileOpType type, Context* context);
 static void fop_prepare_for_sequence(FileOp* fop);
+#ifdef ENABLE_SAVE
+static FileOp* fop_new_for_sequence_frame(FileOp* fop, frame_t frame);
+static void fop_save_sequence(FileOp* fop);
+#endif
 
 std::string get_readable_extensions()
 {
@@ -595,41 +603,7 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
     if (fop->is_sequence()) {
       ASSERT(fop->format->support(FILE_SUPPORT_SEQUENCES));
 
-      Sprite* sprite = fop->document->sprite();
-
-      // Create a temporary bitmap
-      fop->seq.image.reset(Image::create(sprite->pixelFormat(),
-          sprite->width(),
-          sprite->height()));
-
-      fop->seq.progress_offset = 0.0f;
-      fop->seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
-
-      // For each frame in the sprite.
-      render::Render render;
-      for (frame_t frame(0); frame < sprite->totalFrames(); ++frame) {
-        // Draw the "frame" in "fop->seq.image"
-        render.renderSprite(fop->seq.image.get(), sprite, frame);
-
-        // Setup the palette.
-        sprite->palette(frame)->copyColorsTo(fop->seq.palette);
-
-        // Setup the filename to be used.
-        fop->filename = fop->seq.filename_list[frame];
-
-        // Call the "save" procedure... did it fail?
-        if (!fop->format->save(fop)) {
-          fop_error(fop, "Error saving frame %d in the file \"%s\"\n",
-            frame+1, fop->filename.c_str());
-          break;
-        }
-
-        fop->seq.progress_offset += fop->seq.progress_fraction;
-      }
-      fop->filename = *fop->seq.filename_list.begin();
-
-      // Destroy the image
-      fop->seq.image.reset(NULL);
+      fop_save_sequence(fop);
     }
     // Direct save to a file.
     else {
@@ -883,4 +857,142 @@ static void fop_prepare_for_sequence(FileOp* fop)
   fop->seq.format_options.reset();
 }
 
+#ifdef ENABLE_SAVE
+
+// Creates a FileOp to save just one frame of the "fop" sequence. It
+// has its own image and palette, so several frames can be saved at
+// the same time (the document is only read by the FileFormat).
+static FileOp* fop_new_for_sequence_frame(FileOp* fop, frame_t frame)
+{
+  Sprite* sprite = fop->document->sprite();
+  FileOp* frameFop = fop_new(FileOpSave, fop->context);
+
+  frameFop->format = fop->format;
+  frameFop->document = fop->document;
+  frameFop->filename = fop->seq.filename_list[frame];
+
+  frameFop->seq.filename_list.push_back(frameFop->filename);
+  frameFop->seq.palette = new Palette(frame, 256);
+
+  // Each frame has its own copy of the format options, the reference
+  // counter of base::SharedPtr isn't thread-safe.
+  if (fop->seq.format_options)
+    frameFop->seq.format_options.reset(fop->seq.format_options->clone());
+  frameFop->seq.image.reset(Image::create(sprite->pixelFormat(),
+      sprite->width(),
+      sprite->height()));
+
+  return frameFop;
+}
+
+// Saves each frame of the sprite in its own file. Frames are rendered
+// in this thread and encoded/written in a thread pool, so rendering
+// and saving of different frames overlap. Only a limited number of
+// frames are rendered ahead to bound the memory usage. FileOps of
+// each frame are created and freed in this thread.
+static void fop_save_sequence(FileOp* fop)
+{
+  Sprite* sprite = fop->document->sprite();
+  const frame_t frames = sprite->totalFrames();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  int pending = 0;              // Frames rendered but not saved yet
+  int saved = 0;
+  bool failed = false;
+  std::vector<FileOp*> savedFops; // Saved frames to be freed
+
+  auto freeSavedFops = [&](std::unique_lock<std::mutex>& lock){
+    std::vector<FileOp*> fops;
+    fops.swap(savedFops);
+    lock.unlock();
+    for (FileOp* frameFop : fops)
+      fop_free(frameFop);
+    lock.lock();
+  };
+
+  base::thread_pool pool(MID(1, base::thread_pool::hardware_threads(), int(frames)));
+  const int maxPending = 2*pool.size();
+
+  fop->seq.progress_offset = 0.0f;
+  fop->seq.progress_fraction = 1.0f;
+
+  render::Render render;
+  render.setThreads(base::thread_pool::hardware_threads());
+
+  for (frame_t frame(0); frame < frames; ++frame) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]{ return pending < maxPending || failed; });
+      freeSavedFops(lock);
+      if (failed)
+        break;
+    }
+
+    if (fop_is_stop(fop))
+      break;
+
+    FileOp* frameFop = fop_new_for_sequence_frame(fop, frame);
+
+    // Draw the "frame" in the image of the frame FileOp
+    render.renderSprite(frameFop->seq.image.get(), sprite, frame);
+
+    // Setup the palette.
+    sprite->palette(frame)->copyColorsTo(frameFop->seq.palette);
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ++pending;
+    }
+
+    pool.execute(
+      [fop, frameFop, frame, &mutex, &cv, &pending, &saved, &failed, &savedFops]{
+        bool ok = true;
+
+        // Frames queued before the operation was stopped are skipped
+        if (!fop_is_stop(fop)) {
+          ok = fop->format->save(frameFop);
+
+          // Errors of this frame are reported in the sequence FileOp
+          if (frameFop->has_error())
+            fop_error(fop, "%s", frameFop->error.c_str());
+
+          if (!ok)
+            fop_error(fop, "Error saving frame %d in the file \"%s\"\n",
+                      frame+1, frameFop->filename.c_str());
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        savedFops.push_back(frameFop);
+        --pending;
+        ++saved;
+        if (!ok)
+          failed = true;
+        cv.notify_all();
+      });
+
+    double progress;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      progress = double(saved) / double(frames);
+    }
+    fop_progress(fop, progress);
+  }
+
+  // Wait the frames that are being saved
+  std::unique_lock<std::mutex> lock(mutex);
+  while (pending > 0) {
+    cv.wait(lock);
+    freeSavedFops(lock);
+
+    double progress = double(saved) / double(frames);
+    lock.unlock();
+    fop_progress(fop, progress);
+    lock.lock();
+  }
+  freeSavedFops(lock);
+}
+
+#endif
+
 } // namespace app
@@ -17,6 +17,9 @@ namespace app {
   class FormatOptions {
   public:
     virtual ~FormatOptions() { }
+
+    // Returns a new copy of the options.
+    virtual FormatOptions* clone() const = 0;
   };
 
 } // namespace app
@@ -30,6 +30,10 @@ namespace app {
       , m_dithering(dithering) {
     }
 
+    FormatOptions* clone() const override {
+      return new GifOptions(*this);
+    }
+
     Quantize quantize() const { return m_quantize; }
     bool interlaced() const { return m_interlaced; }
     bool loop() const { return m_loop; }
@@ -40,6 +40,10 @@ class JpegFormat : public FileFormat {
   class JpegOptions : public FormatOptions {
   public:
     float quality;              // 1.0 maximum quality.
+
+    FormatOptions* clone() const override {
+      return new JpegOptions(*this);
+    }
   };
 
   const char* onGetName() const { return "jpeg"; }
@@ -16,35 +16,215 @@
 #include "app/document.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/resource_finder.h"
 #include "base/bind.h"
-#include "base/scoped_lock.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/path.h"
+#include "base/sha1.h"
 #include "base/thread.h"
+#include "base/thread_pool.h"
+#include "base/time.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/conversion_she.h"
 #include "doc/image.h"
-#include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "render/zoom.h"
 #include "she/system.h"
 
+#include "zlib.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
 #define MAX_THUMBNAIL_SIZE              128
+#define MAX_THUMBNAIL_THREADS           4
 
 namespace app {
 
+// Magic number of thumbnails saved in the on-disk cache
+static const uint32_t kThumbnailCacheMagic = 0x42485441; // "ATHB"
+
+// Maximum size of the on-disk cache, the oldest thumbnails are
+// deleted when it's exceeded.
+static const size_t kMaxThumbnailCacheSize = 32*1024*1024;
+
+// Returns the file in the on-disk cache for the thumbnail of the
+// given file. The name depends on the file size and modification
+// time, so a new thumbnail is generated if the file changes.
+static std::string get_thumbnail_cache_filename(const std::string& cacheDir,
+                                                const std::string& filename)
+{
+  base::Time time = base::get_modification_time(filename);
+  char buf[256];
+  std::sprintf(buf, "\n%lu\n%04d-%02d-%02d %02d:%02d:%02d\n%d",
+               (unsigned long)base::file_size(filename),
+               time.year, time.month, time.day,
+               time.hour, time.minute, time.second,
+               MAX_THUMBNAIL_SIZE);
+
+  base::Sha1 key = base::Sha1::calculateFromString(filename + buf);
+  return base::join_path(cacheDir, key.toString() + ".thumb");
+}
+
+static void write32(FILE* f, uint32_t value)
+{
+  fputc(value & 0xff, f);
+  fputc((value >> 8) & 0xff, f);
+  fputc((value >> 16) & 0xff, f);
+  fputc((value >> 24) & 0xff, f);
+}
+
+static uint32_t read32(FILE* f)
+{
+  uint32_t b1 = fgetc(f);
+  uint32_t b2 = fgetc(f);
+  uint32_t b3 = fgetc(f);
+  uint32_t b4 = fgetc(f);
+  return (b4 << 24) | (b3 << 16) | (b2 << 8) | b1;
+}
+
+// Loads a RGB thumbnail from the on-disk cache. Returns NULL if it
+// doesn't exist or it's invalid.
+static Image* load_cached_thumbnail(const std::string& cacheFilename)
+{
+  if (!base::is_file(cacheFilename))
+    return NULL;
+
+  base::FileHandle handle(base::open_file(cacheFilename, "rb"));
+  FILE* f = handle.get();
+  if (!f || read32(f) != kThumbnailCacheMagic)
+    return NULL;
+
+  int w = int(read32(f));
+  int h = int(read32(f));
+  uLong compressedSize = read32(f);
+  if (feof(f) ||
+      w < 1 || w > MAX_THUMBNAIL_SIZE ||
+      h < 1 || h > MAX_THUMBNAIL_SIZE ||
+      compressedSize < 1 ||
+      compressedSize > compressBound(w*h*4))
+    return NULL;
+
+  std::vector<uint8_t> compressed(compressedSize);
+  if (fread(&compressed[0], 1, compressedSize, f) != compressedSize)
+    return NULL;
+
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, w, h));
+  uLongf size = w*h*4;
+  if (uncompress(image->getPixelAddress(0, 0), &size,
+                 &compressed[0], compressedSize) != Z_OK ||
+      size != uLongf(w*h*4))
+    return NULL;
+
+  return image.release();
+}
+
+static void save_cached_thumbnail(const std::string& cacheFilename,
+                                  const Image* image)
+{
+  ASSERT(image->pixelFormat() == IMAGE_RGB);
+
+  uLongf size = compressBound(image->width()*image->height()*4);
+  std::vector<uint8_t> compressed(size);
+  if (compress(&compressed[0], &size,
+               image->getPixelAddress(0, 0),
+               image->width()*image->height()*4) != Z_OK)
+    return;
+
+  // The thumbnail is written in a temporary file and then renamed, so
+  // other threads (or a crash) never see a half-written file.
+  static std::atomic<int> counter(0);
+  char suffix[32];
+  std::sprintf(suffix, ".%d.tmp", counter++);
+  std::string tmpFilename = cacheFilename + suffix;
+
+  bool ok;
+  {
+    base::FileHandle handle(base::open_file(tmpFilename, "wb"));
+    FILE* f = handle.get();
+    if (!f)
+      return;
+
+    write32(f, kThumbnailCacheMagic);
+    write32(f, image->width());
+    write32(f, image->height());
+    write32(f, size);
+    ok = (fwrite(&compressed[0], 1, size, f) == size &&
+          fflush(f) == 0);
+  }
+
+  try {
+    if (ok)
+      base::move_file(tmpFilename, cacheFilename);
+    else
+      base::delete_file(tmpFilename);
+  }
+  catch (const std::exception&) {
+    // The thumbnail was already saved by other thread
+    if (base::is_file(tmpFilename))
+      base::delete_file(tmpFilename);
+  }
+}
+
+// Deletes the oldest thumbnails (and temporary files left by a crash)
+// to keep the on-disk cache under kMaxThumbnailCacheSize.
+static void prune_thumbnail_cache(const std::string& cacheDir)
+{
+  struct CacheFile {
+    std::string filename;
+    size_t size;
+    long long time;             // yyyymmddhhmmss
+  };
+  std::vector<CacheFile> files;
+
+  for (const std::string& fn : base::list_files(cacheDir)) {
+    std::string filename = base::join_path(cacheDir, fn);
+    std::string ext = base::get_file_extension(fn);
+    if (ext == "tmp") {
+      base::delete_file(filename);
+      continue;
+    }
+    if (ext != "thumb" || !base::is_file(filename))
+      continue;
+
+    base::Time t = base::get_modification_time(filename);
+    CacheFile file;
+    file.filename = filename;
+    file.size = base::file_size(filename);
+    file.time = ((((t.year*100LL + t.month)*100 + t.day)*100
+                  + t.hour)*100 + t.minute)*100 + t.second;
+    files.push_back(file);
+  }
+
+  // Newest first
+  std::sort(files.begin(), files.end(),
+            [](const CacheFile& a, const CacheFile& b) {
+              return a.time > b.time;
+            });
+
+  size_t total = 0;
+  for (const CacheFile& file : files) {
+    total += file.size;
+    if (total > kMaxThumbnailCacheSize)
+      base::delete_file(file.filename);
+  }
+}
+
 class ThumbnailGenerator::Worker {
 public:
-  Worker(FileOp* fop, IFileItem* fileitem)
+  Worker(FileOp* fop, IFileItem* fileitem, const std::string& cacheFilename)
     : m_fop(fop)
     , m_fileitem(fileitem)
-    , m_thumbnail(NULL)
-    , m_palette(NULL)
-    , m_thread(Bind<void>(&Worker::loadBgThread, this)) {
+    , m_cacheFilename(cacheFilename)
+    , m_thumbnail(NULL) {
   }
 
+  // The worker can be deleted only when it's done (see stop())
   ~Worker() {
-    fop_stop(m_fop);
-    m_thread.join();
-
+    ASSERT(isDone());
     fop_free(m_fop);
   }
 
@@ -52,57 +232,31 @@ public:
   bool isDone() const { return fop_is_done(m_fop); }
   double getProgress() const { return fop_get_progress(m_fop); }
 
-private:
-  void loadBgThread() {
+  // Stops the generation of the thumbnail. If the worker is still in
+  // the queue (it was never executed), it's marked as done.
+  void stop(bool queued) {
+    fop_stop(m_fop);
+    if (queued)
+      fop_done(m_fop);
+  }
+
+  // Called from a thread of the pool. Nothing can be accessed after
+  // fop_done() as the worker can be deleted from the GUI thread.
+  void run() {
     try {
-      fop_operate(m_fop, NULL);
-
-      // Post load
-      fop_post_load(m_fop);
-
-      // Convert the loaded document into the she::Surface.
-      const Sprite* sprite = (m_fop->document && m_fop->document->sprite()) ?
-        m_fop->document->sprite(): NULL;
-
-      if (!fop_is_stop(m_fop) && sprite) {
-        // The palette to convert the Image
-        m_palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Render first frame of the sprite in 'image'
-        base::UniquePtr<Image> image(Image::create(
-            sprite->pixelFormat(), sprite->width(), sprite->height()));
-
-        AppRender render;
-        render.setupBackground(NULL, image->pixelFormat());
-        render.setBgType(render::BgType::CHECKED);
-        render.renderSprite(image, sprite, frame_t(0));
-
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
-        int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
-        if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
-          thumb_w = image->width();
-          thumb_h = image->height();
-        }
-        thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
-        thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        m_thumbnail.reset(Image::create(image->pixelFormat(), thumb_w, thumb_h));
-        clear_image(m_thumbnail, 0);
-        algorithm::scale_image(m_thumbnail, image, 0, 0, thumb_w, thumb_h);
+      if (!fop_is_stop(m_fop)) {
+        m_thumbnail.reset(load_cached_thumbnail(m_cacheFilename));
+        if (!m_thumbnail)
+          generateThumbnail();
       }
 
-      // Close file
-      delete m_fop->document;
-
       // Set the thumbnail of the file-item.
-      if (m_thumbnail) {
+      if (m_thumbnail && !fop_is_stop(m_fop)) {
         she::Surface* thumbnail = she::instance()->createRgbaSurface(
           m_thumbnail->width(),
           m_thumbnail->height());
 
-        convert_image_to_surface(m_thumbnail, m_palette, thumbnail,
+        convert_image_to_surface(m_thumbnail, NULL, thumbnail,
           0, 0, 0, 0, m_thumbnail->width(), m_thumbnail->height());
 
         m_fileitem->setThumbnail(thumbnail);
@@ -114,11 +268,61 @@ private:
     fop_done(m_fop);
   }
 
+private:
+  void generateThumbnail() {
+    // The file-op was created with FILE_LOAD_ONE_FRAME, so just the
+    // first frame is decoded (in formats that support it).
+    fop_operate(m_fop, NULL);
+
+    // Post load
+    fop_post_load(m_fop);
+
+    // Convert the loaded document into the she::Surface.
+    const Sprite* sprite = (m_fop->document && m_fop->document->sprite()) ?
+      m_fop->document->sprite(): NULL;
+
+    if (!fop_is_stop(m_fop) && sprite) {
+      // Calculate the thumbnail size
+      int w = sprite->width();
+      int h = sprite->height();
+      int thumb_w = MAX_THUMBNAIL_SIZE * w / MAX(w, h);
+      int thumb_h = MAX_THUMBNAIL_SIZE * h / MAX(w, h);
+      if (MAX(thumb_w, thumb_h) > MAX(w, h)) {
+        thumb_w = w;
+        thumb_h = h;
+      }
+      thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
+      thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
+
+      // Render first frame of the sprite in 'image' (zoomed out if
+      // the sprite is bigger than the thumbnail, so we don't need a
+      // full size image)
+      render::Zoom zoom(1, MAX(1, MAX(w, h) / MAX_THUMBNAIL_SIZE));
+      base::UniquePtr<Image> image(Image::create(
+          IMAGE_RGB, MAX(1, zoom.apply(w)), MAX(1, zoom.apply(h))));
+
+      AppRender render;
+      render.setupBackground(NULL, image->pixelFormat());
+      render.setBgType(render::BgType::CHECKED);
+      render.renderSprite(image, sprite, frame_t(0),
+        gfx::Clip(image->bounds()), zoom);
+
+      // Stretch the 'image'
+      m_thumbnail.reset(Image::create(IMAGE_RGB, thumb_w, thumb_h));
+      clear_image(m_thumbnail, 0);
+      algorithm::scale_image(m_thumbnail, image, 0, 0, thumb_w, thumb_h);
+
+      save_cached_thumbnail(m_cacheFilename, m_thumbnail);
+    }
+
+    // Close file
+    delete m_fop->document;
+  }
+
   FileOp* m_fop;
   IFileItem* m_fileitem;
+  std::string m_cacheFilename;
   base::UniquePtr<Image> m_thumbnail;
-  base::UniquePtr<Palette> m_palette;
-  base::thread m_thread;
 };
 
 static void delete_singleton(ThumbnailGenerator* singleton)
@@ -136,9 +340,38 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
   return singleton;
 }
 
+ThumbnailGenerator::ThumbnailGenerator()
+  : m_pool(new base::thread_pool(
+             MID(1, base::thread_pool::hardware_threads()/2,
+                 MAX_THUMBNAIL_THREADS)))
+{
+  ResourceFinder rf;
+  rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+  m_cacheDir = rf.getFirstOrCreateDefault();
+
+  std::string cacheDir = m_cacheDir;
+  m_pool->execute(
+    [cacheDir]{
+      try {
+        prune_thumbnail_cache(cacheDir);
+      }
+      catch (const std::exception&) {
+        // Ignore errors, the cache will be pruned the next time
+      }
+    });
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  if (m_stopThread)
+    m_stopThread->join();
+
+  stopAllWorkersBackground();
+}
+
 ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem* fileitem, double& progress)
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::unique_lock<std::mutex> lock(m_workersAccess);
 
   for (WorkerList::iterator
          it=m_workers.begin(), end=m_workers.end(); it!=end; ++it) {
@@ -157,7 +390,7 @@ ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem*
 
 bool ThumbnailGenerator::checkWorkers()
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::unique_lock<std::mutex> lock(m_workersAccess);
   bool doingWork = !m_workers.empty();
 
   for (WorkerList::iterator
@@ -174,15 +407,37 @@ bool ThumbnailGenerator::checkWorkers()
   return doingWork;
 }
 
-void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
+void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem, Priority priority)
 {
-  double progress;
-
   if (fileitem->isBrowsable() ||
-      fileitem->getThumbnail() != NULL ||
-      getWorkerStatus(fileitem, progress) != WithoutWorker)
+      fileitem->getThumbnail() != NULL)
     return;
 
+  {
+    std::unique_lock<std::mutex> lock(m_workersAccess);
+    for (WorkerList::iterator
+           it=m_workers.begin(); it != m_workers.end(); ++it) {
+      Worker* worker = *it;
+      if (worker->getFileItem() != fileitem)
+        continue;
+
+      // The worker was stopped, we can start a new one
+      if (worker->isDone()) {
+        delete worker;
+        m_workers.erase(it);
+        break;
+      }
+
+      // Move a queued worker to the front of the queue
+      auto queueIt = std::find(m_queue.begin(), m_queue.end(), worker);
+      if (priority == HighPriority && queueIt != m_queue.end()) {
+        m_queue.erase(queueIt);
+        m_queue.push_front(worker);
+      }
+      return;
+    }
+  }
+
   FileOp* fop = fop_to_load_document(NULL,
     fileitem->getFileName().c_str(),
     FILE_LOAD_SEQUENCE_NONE |
@@ -195,15 +450,65 @@ void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
     fop_free(fop);
   }
   else {
-    Worker* worker = new Worker(fop, fileitem);
+    Worker* worker = new Worker(fop, fileitem,
+      get_thumbnail_cache_filename(m_cacheDir, fileitem->getFileName()));
     try {
-      base::scoped_lock hold(m_workersAccess);
+      std::unique_lock<std::mutex> lock(m_workersAccess);
       m_workers.push_back(worker);
+      if (priority == HighPriority)
+        m_queue.push_front(worker);
+      else
+        m_queue.push_back(worker);
     }
     catch (...) {
       delete worker;
       throw;
     }
+
+    // Each task runs the first worker in the queue (which could be
+    // a different one if its priority changes in the meantime)
+    m_pool->execute([this]{ runNextWorker(); });
+  }
+}
+
+void ThumbnailGenerator::runNextWorker()
+{
+  Worker* worker;
+  {
+    std::unique_lock<std::mutex> lock(m_workersAccess);
+    if (m_queue.empty())          // All queued workers were stopped
+      return;
+
+    worker = m_queue.front();
+    m_queue.pop_front();
+  }
+  worker->run();
+
+  // Wake up stopAllWorkersBackground() (the worker cannot be used
+  // anymore, it might be deleted)
+  {
+    std::unique_lock<std::mutex> lock(m_workersAccess);
+  }
+  m_workerDone.notify_all();
+}
+
+void ThumbnailGenerator::stopWorkersExcept(const std::vector<IFileItem*>& fileitems)
+{
+  std::unique_lock<std::mutex> lock(m_workersAccess);
+
+  for (Worker* worker : m_workers) {
+    if (worker->isDone() ||
+        std::find(fileitems.begin(), fileitems.end(),
+                  worker->getFileItem()) != fileitems.end())
+      continue;
+
+    auto it = std::find(m_queue.begin(), m_queue.end(), worker);
+    if (it != m_queue.end()) {
+      m_queue.erase(it);
+      worker->stop(true);
+    }
+    else
+      worker->stop(false);
   }
 }
 
@@ -217,15 +522,28 @@ void ThumbnailGenerator::stopAllWorkersBackground()
 {
   WorkerList workersCopy;
   {
-    base::scoped_lock hold(m_workersAccess);
+    std::unique_lock<std::mutex> lock(m_workersAccess);
     workersCopy = m_workers;
     m_workers.clear();
+
+    for (Worker* worker : workersCopy) {
+      bool queued = (std::find(m_queue.begin(), m_queue.end(), worker) != m_queue.end());
+      worker->stop(queued);
+    }
+    m_queue.clear();
   }
 
-  for (WorkerList::iterator
-         it=workersCopy.begin(), end=workersCopy.end(); it!=end; ++it) {
-    delete *it;
+  // Wait the running workers
+  {
+    std::unique_lock<std::mutex> lock(m_workersAccess);
+    for (Worker* worker : workersCopy) {
+      while (!worker->isDone())
+        m_workerDone.wait(lock);
+    }
   }
+
+  for (Worker* worker : workersCopy)
+    delete worker;
 }
 
 } // namespace app
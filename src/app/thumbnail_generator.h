@@ -9,27 +9,44 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
-#include "base/mutex.h"
 #include "base/unique_ptr.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace base {
   class thread;
+  class thread_pool;
 }
 
 namespace app {
   class IFileItem;
 
+  // Generates the thumbnails of files in a fixed number of background
+  // threads. Generated thumbnails are saved in an on-disk cache (in
+  // the user directory) so they can be reused the next time the file
+  // is displayed (if the file wasn't modified).
   class ThumbnailGenerator {
   public:
     enum WorkerStatus { WithoutWorker, WorkingOnThumbnail, ThumbnailIsDone };
 
+    // High priority requests (e.g. the selected item) are processed
+    // before the ones already queued, low priority requests
+    // (e.g. visible items) after them.
+    enum Priority { LowPriority, HighPriority };
+
+    ThumbnailGenerator();
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
     // from the GUI thread.
-    void addWorkerToGenerateThumbnail(IFileItem* fileitem);
+    void addWorkerToGenerateThumbnail(IFileItem* fileitem,
+                                      Priority priority = HighPriority);
 
     // Returns the status of the worker that is generating the thumbnail
     // for the given file.
@@ -41,6 +58,11 @@ namespace app {
     // Returns true if there are workers generating thumbnails.
     bool checkWorkers();
 
+    // Stops the workers of the file-items that are not in the given
+    // list (e.g. items that aren't visible anymore). It must be called
+    // from the GUI thread.
+    void stopWorkersExcept(const std::vector<IFileItem*>& fileitems);
+
     // Stops all workers generating thumbnails. This is an non-blocking
     // operation. The cancelation of all workers is done in a background
     // thread.
@@ -48,13 +70,23 @@ namespace app {
 
   private:
     void stopAllWorkersBackground();
+    void runNextWorker();
 
     class Worker;
     typedef std::vector<Worker*> WorkerList;
 
+    // All workers (queued, running, or done)
     WorkerList m_workers;
-    base::mutex m_workersAccess;
+    // Workers waiting for a free thread (in order of priority)
+    std::deque<Worker*> m_queue;
+    std::mutex m_workersAccess;
+    // Notified (with m_workersAccess) each time a worker finishes
+    std::condition_variable m_workerDone;
     base::UniquePtr<base::thread> m_stopThread;
+    std::string m_cacheDir;
+    // Declared at the end so it's destroyed first (its threads could
+    // be using the other members)
+    base::UniquePtr<base::thread_pool> m_pool;
   };
 } // namespace app
 
@@ -209,6 +209,9 @@ void DrawingState::destroyLoop()
   m_toolLoopManager = NULL;
   m_toolLoop = NULL;
 
+  // Free the rendering of the layers below the current one
+  Editor::renderEngine().invalidateBelowLayersCache();
+
   app_rebuild_documents_tabs();
 }
 
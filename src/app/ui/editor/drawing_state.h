@@ -34,6 +34,9 @@ namespace app {
     // already drawing (viewing the real trace).
     virtual bool requireBrushPreview() override { return false; }
 
+    // Only the current layer is modified by the tool-loop.
+    virtual bool cacheBelowLayers() override { return true; }
+
     void initToolLoop(Editor* editor, ui::MouseMessage* msg);
 
   private:
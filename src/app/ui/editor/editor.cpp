@@ -34,6 +34,7 @@
 #include "app/ui/editor/moving_pixels_state.h"
 #include "app/ui/editor/pixels_movement.h"
 #include "app/ui/editor/play_state.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scoped_cursor.h"
 #include "app/ui/editor/standby_state.h"
 #include "app/ui/main_window.h"
@@ -43,6 +44,7 @@
 #include "app/ui_context.h"
 #include "app/util/boundary.h"
 #include "base/bind.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/conversion_she.h"
 #include "doc/doc.h"
@@ -347,37 +349,56 @@ void Editor::updateEditor()
   View::getView(this)->updateView();
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw,
+                                        const std::vector<gfx::Point>& offsets)
 {
   // Clip from sprite and apply zoom
-  gfx::Rect rc = m_sprite->bounds().createIntersect(spriteRectToDraw);
-  rc = m_zoom.apply(rc);
+  gfx::Rect zoomedRc = m_sprite->bounds().createIntersect(spriteRectToDraw);
+  zoomedRc = m_zoom.apply(zoomedRc);
 
-  int dest_x = dx + m_offset_x + rc.x;
-  int dest_y = dy + m_offset_y + rc.y;
-
-  // Clip from graphics/screen
+  // Clip each copy from graphics/screen
   const gfx::Rect& clip = g->getClipBounds();
-  if (dest_x < clip.x) {
-    rc.x += clip.x - dest_x;
-    rc.w -= clip.x - dest_x;
-    dest_x = clip.x;
-  }
-  if (dest_y < clip.y) {
-    rc.y += clip.y - dest_y;
-    rc.h -= clip.y - dest_y;
-    dest_y = clip.y;
-  }
-  if (dest_x+rc.w > clip.x+clip.w) {
-    rc.w = clip.x+clip.w-dest_x;
-  }
-  if (dest_y+rc.h > clip.y+clip.h) {
-    rc.h = clip.y+clip.h-dest_y;
+  std::vector<gfx::Rect> visible;
+  std::vector<gfx::Point> dst;
+  gfx::Rect visibleBounds;
+  int visibleArea = 0;
+
+  for (const gfx::Point& offset : offsets) {
+    gfx::Point origin(offset.x + m_offset_x, offset.y + m_offset_y);
+    gfx::Rect rc = zoomedRc.createIntersect(
+      gfx::Rect(clip).offset(-origin));
+    if (rc.isEmpty())
+      continue;
+
+    visible.push_back(rc);
+    dst.push_back(origin + rc.getOrigin());
+    visibleBounds |= rc;
+    visibleArea += rc.w * rc.h;
   }
 
-  if (rc.isEmpty())
+  if (visible.empty())
     return;
 
+  // If the visible parts of the copies overlap in the sprite (e.g. a
+  // full repaint in tiled mode), we render the whole area just once
+  // and blit it several times.
+  if (visibleBounds.w * visibleBounds.h <= visibleArea) {
+    drawRenderedSpriteRect(g, visibleBounds, visible, dst);
+  }
+  // In other case (e.g. we see the right edge of one copy and the
+  // left edge of the next one) each part is rendered separately.
+  else {
+    for (std::size_t i=0; i<visible.size(); ++i)
+      drawRenderedSpriteRect(g, visible[i],
+        std::vector<gfx::Rect>(1, visible[i]),
+        std::vector<gfx::Point>(1, dst[i]));
+  }
+}
+
+void Editor::drawRenderedSpriteRect(ui::Graphics* g, const gfx::Rect& rc,
+                                    const std::vector<gfx::Rect>& areas,
+                                    const std::vector<gfx::Point>& dst)
+{
   // Generate the rendered image
   if (!m_renderBuffer)
     m_renderBuffer.reset(new doc::ImageBuffer());
@@ -408,14 +429,27 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
 
     // Create a temporary RGB bitmap to draw all to it
     rendered.reset(Image::create(IMAGE_RGB, rc.w, rc.h, m_renderBuffer));
-    m_renderEngine.setupBackground(m_document, rendered->pixelFormat());
-    m_renderEngine.setOnionskin(render::OnionskinType::NONE, 0, 0, 0, 0);
-
-    if ((m_flags & kShowOnionskin) == kShowOnionskin) {
-      DocumentPreferences& docPref = App::instance()
-        ->preferences().document(m_document);
 
-      if (docPref.onionskin.active()) {
+    DocumentPreferences& docPref = App::instance()
+      ->preferences().document(m_document);
+    bool onionskin = ((m_flags & kShowOnionskin) == kShowOnionskin &&
+                      docPref.onionskin.active());
+
+    // While the animation is playing, the frame could be already
+    // rendered in background (it doesn't include onion skin or extra
+    // cels).
+    PlaybackCache* playbackCache = m_state->playbackCache();
+    bool cached =
+      (playbackCache && !onionskin &&
+       m_document->getExtraCelType() == render::ExtraType::NONE &&
+       playbackCache->copyFrame(m_frame, m_zoom, rc, rendered));
+
+    if (!cached) {
+      m_renderEngine.setupBackground(m_document, rendered->pixelFormat());
+      m_renderEngine.setThreads(base::thread_pool::hardware_threads());
+      m_renderEngine.setOnionskin(render::OnionskinType::NONE, 0, 0, 0, 0);
+
+      if (onionskin) {
         m_renderEngine.setOnionskin(
           (docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
             render::OnionskinType::MERGE:
@@ -427,23 +461,32 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
           docPref.onionskin.opacityBase(),
           docPref.onionskin.opacityStep());
       }
-    }
 
-    if (m_document->getExtraCelType() != render::ExtraType::NONE) {
-      ASSERT(m_document->getExtraCel());
+      if (m_document->getExtraCelType() != render::ExtraType::NONE) {
+        ASSERT(m_document->getExtraCel());
 
-      m_renderEngine.setExtraImage(
-        m_document->getExtraCelType(),
-        m_document->getExtraCel(),
-        m_document->getExtraCelImage(),
-        m_document->getExtraCelBlendMode(),
-        m_layer, m_frame);
-    }
+        m_renderEngine.setExtraImage(
+          m_document->getExtraCelType(),
+          m_document->getExtraCel(),
+          m_document->getExtraCelImage(),
+          m_document->getExtraCelBlendMode(),
+          m_layer, m_frame);
+      }
 
-    m_renderEngine.renderSprite(rendered, m_sprite, m_frame,
-      gfx::Clip(0, 0, rc), m_zoom);
+      // Cache the layers below the current one for the whole visible
+      // area, so each new invalidated rectangle (e.g. each mouse
+      // movement of the tool-loop) only blends the current layer and
+      // the layers above it.
+      if (m_layer && m_state->cacheBelowLayers())
+        m_renderEngine.setBelowLayersCache(
+          m_layer, m_zoom.apply(getVisibleSpriteBounds()));
 
-    m_renderEngine.removeExtraImage();
+      m_renderEngine.renderSprite(rendered, m_sprite, m_frame,
+        gfx::Clip(0, 0, rc), m_zoom);
+
+      m_renderEngine.removeBelowLayersCache();
+      m_renderEngine.removeExtraImage();
+    }
   }
   catch (const std::exception& e) {
     Console::showException(e);
@@ -462,7 +505,12 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     if (tmp->nativeHandle()) {
       convert_image_to_surface(rendered, m_sprite->palette(m_frame),
         tmp, 0, 0, 0, 0, rc.w, rc.h);
-      g->blit(tmp, 0, 0, dest_x, dest_y, rc.w, rc.h);
+
+      for (std::size_t i=0; i<areas.size(); ++i)
+        g->blit(tmp,
+                areas[i].x - rc.x, areas[i].y - rc.y,
+                dst[i].x, dst[i].y,
+                areas[i].w, areas[i].h);
     }
     tmp->dispose();
   }
@@ -484,8 +532,10 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_zoom.apply(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
+  // Offsets of each copy of the sprite that we have to draw (in
+  // tiled mode we draw copies around the sprite).
+  std::vector<gfx::Point> offsets;
+  offsets.push_back(gfx::Point(0, 0));
 
   gfx::Region outside(client);
   outside.createSubtraction(outside, gfx::Region(spriteRect));
@@ -495,26 +545,26 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
       App::instance()->preferences().document(m_document);
 
   if (int(docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, 0);
+    offsets.push_back(gfx::Point(-spriteRect.w, 0));
+    offsets.push_back(gfx::Point(+spriteRect.w, 0));
 
     enclosingRect = gfx::Rect(spriteRect.x-spriteRect.w, spriteRect.y, spriteRect.w*3, spriteRect.h);
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
   if (int(docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, +spriteRect.h);
+    offsets.push_back(gfx::Point(0, -spriteRect.h));
+    offsets.push_back(gfx::Point(0, +spriteRect.h));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y-spriteRect.h, spriteRect.w, spriteRect.h*3);
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
   if (docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, +spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, +spriteRect.h);
+    offsets.push_back(gfx::Point(-spriteRect.w, -spriteRect.h));
+    offsets.push_back(gfx::Point(+spriteRect.w, -spriteRect.h));
+    offsets.push_back(gfx::Point(-spriteRect.w, +spriteRect.h));
+    offsets.push_back(gfx::Point(+spriteRect.w, +spriteRect.h));
 
     enclosingRect = gfx::Rect(
       spriteRect.x-spriteRect.w,
@@ -522,6 +572,10 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
+  // Draw the sprite (and its copies in tiled mode). The sprite is
+  // rendered just once for all the copies.
+  drawOneSpriteUnclippedRect(g, rc, offsets);
+
   // Fill the outside (parts of the editor that aren't covered by the
   // sprite).
   SkinTheme* theme = static_cast<SkinTheme*>(this->getTheme());
@@ -620,51 +674,29 @@ void Editor::drawMask(Graphics* g)
   if ((m_flags & kShowMask) == 0)
     return;
 
-  int x1, y1, x2, y2;
+  // The lines are calculated only when the mask or the zoom change
+  int version = m_document->getBoundariesVersion();
+  if (!m_maskBoundaries.isValid(version, m_zoom)) {
+    m_maskBoundaries.build(
+      m_document->getBoundariesSegments(),
+      m_document->getBoundariesSegmentsCount(),
+      version, m_zoom);
+  }
+
   int x = m_offset_x;
   int y = m_offset_y;
 
-  int nseg = m_document->getBoundariesSegmentsCount();
-  const BoundSeg* seg = m_document->getBoundariesSegments();
-
-  for (int c=0; c<nseg; ++c, ++seg) {
-    CheckedDrawMode checked(g, m_offset_count);
-
-    x1 = m_zoom.apply(seg->x1);
-    y1 = m_zoom.apply(seg->y1);
-    x2 = m_zoom.apply(seg->x2);
-    y2 = m_zoom.apply(seg->y2);
-
-#if 1                           // Bounds inside mask
-    if (!seg->open)
-#else                           // Bounds outside mask
-    if (seg->open)
-#endif
-    {
-      if (x1 == x2) {
-        x1--;
-        x2--;
-        y2--;
-      }
-      else {
-        y1--;
-        y2--;
-        x2--;
-      }
-    }
-    else {
-      if (x1 == x2) {
-        y2--;
-      }
-      else {
-        x2--;
-      }
-    }
-
-    // The color doesn't matter, we are using CheckedDrawMode
-    g->drawLine(gfx::rgba(0, 0, 0),
-      gfx::Point(x+x1, y+y1), gfx::Point(x+x2, y+y2));
-  }
+  // Draw only the lines in the clipping area
+  gfx::Rect bounds = g->getClipBounds();
+  bounds.offset(-x, -y);
+
+  CheckedDrawMode checked(g, m_offset_count);
+  m_maskBoundaries.forEachLine(bounds,
+    [g, x, y](const gfx::Point& a, const gfx::Point& b) {
+      // The color doesn't matter, we are using CheckedDrawMode
+      g->drawLine(gfx::rgba(0, 0, 0),
+        gfx::Point(x+a.x, y+a.y), gfx::Point(x+b.x, y+b.y));
+    });
 }
 
 void Editor::drawMaskSafe()
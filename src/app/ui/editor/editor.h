@@ -16,6 +16,7 @@
 #include "app/ui/editor/editor_observers.h"
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
+#include "app/ui/editor/mask_boundary_index.h"
 #include "base/connection.h"
 #include "doc/document_observer.h"
 #include "doc/frame.h"
@@ -27,6 +28,8 @@
 #include "ui/timer.h"
 #include "ui/widget.h"
 
+#include <vector>
+
 namespace doc {
   class Layer;
   class Site;
@@ -243,10 +246,19 @@ namespace app {
       gfx::Color color,
       PixelDelegate pixelDelegate);
 
-    // Draws the specified portion of sprite in the editor.  Warning:
-    // You should setup the clip of the screen before calling this
-    // routine.
-    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
+    // Draws the specified portion of sprite in the editor, one time
+    // for each given offset (several copies are drawn in tiled
+    // mode). Warning: You should setup the clip of the screen before
+    // calling this routine.
+    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                    const std::vector<gfx::Point>& offsets);
+
+    // Renders the "rc" area of the sprite (with the zoom applied) and
+    // blits each "areas[i]" part of it (in the same coordinates as
+    // "rc") to the "dst[i]" screen position.
+    void drawRenderedSpriteRect(ui::Graphics* g, const gfx::Rect& rc,
+                                const std::vector<gfx::Rect>& areas,
+                                const std::vector<gfx::Point>& dst);
 
     // Stack of states. The top element in the stack is the current state (m_state).
     EditorStatesHistory m_statesHistory;
@@ -283,6 +295,7 @@ namespace app {
     // Marching ants stuff
     ui::Timer m_mask_timer;
     int m_offset_count;
+    MaskBoundaryIndex m_maskBoundaries;
 
     // This slot is used to disconnect the Editor from CurrentToolChange
     // signal (because the editor can be destroyed and the application
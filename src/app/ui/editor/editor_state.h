@@ -24,6 +24,7 @@ namespace ui {
 namespace app {
   class Editor;
   class EditorDecorator;
+  class PlaybackCache;
 
   namespace tools {
     class Ink;
@@ -105,6 +106,14 @@ namespace app {
     // drawing cursor.
     virtual bool requireBrushPreview() { return false; }
 
+    // Returns true if the layers below the current one are not
+    // modified in this state, so their rendering can be cached.
+    virtual bool cacheBelowLayers() { return false; }
+
+    // Returns the frames rendered in advance in this state (e.g. to
+    // play the animation), or nullptr if there is no such cache.
+    virtual PlaybackCache* playbackCache() { return nullptr; }
+
     // Returns true if this state accept the given quicktool.
     virtual bool acceptQuickTool(tools::Tool* tool) { return true; }
 
@@ -0,0 +1,187 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/mask_boundary_index.h"
+
+#include "app/util/boundary.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+  // Maximum number of cells in the grid (the cell size is increased
+  // for big sprites or zoom levels).
+  const int kMaxCells = 256*256;
+  const int kMinCellSize = 256;
+
+  // A horizontal (or vertical) segment in the "pos" row (or column)
+  // from "from" to "to" (from <= to).
+  struct MergeSeg {
+    int pos, from, to;
+    bool open;
+
+    bool operator<(const MergeSeg& other) const {
+      if (pos != other.pos) return pos < other.pos;
+      if (open != other.open) return open < other.open;
+      return from < other.from;
+    }
+  };
+
+  // Joins contiguous segments of the same row/column and kind, so we
+  // have less lines to draw.
+  void merge_segs(std::vector<MergeSeg>& segs)
+  {
+    if (segs.empty())
+      return;
+
+    std::sort(segs.begin(), segs.end());
+
+    std::size_t j = 0;
+    for (std::size_t i=1; i<segs.size(); ++i) {
+      MergeSeg& last = segs[j];
+      const MergeSeg& seg = segs[i];
+      if (seg.pos == last.pos &&
+          seg.open == last.open &&
+          seg.from <= last.to) {
+        last.to = std::max(last.to, seg.to);
+      }
+      else
+        segs[++j] = seg;
+    }
+    segs.resize(j+1);
+  }
+
+} // anonymous namespace
+
+MaskBoundaryIndex::MaskBoundaryIndex()
+  : m_version(-1)
+  , m_zoom(1, 1)
+  , m_cellSize(kMinCellSize)
+  , m_cols(0)
+{
+}
+
+// Splits the line in the cells of the grid, calling func(cell, piece)
+// for each part of the line.
+template<typename Func>
+void MaskBoundaryIndex::forEachPiece(const Line& line, Func func) const
+{
+  int u1 = (line.a.x - m_bounds.x) / m_cellSize;
+  int v1 = (line.a.y - m_bounds.y) / m_cellSize;
+  int u2 = (line.b.x - m_bounds.x) / m_cellSize;
+  int v2 = (line.b.y - m_bounds.y) / m_cellSize;
+
+  for (int v=v1; v<=v2; ++v) {
+    for (int u=u1; u<=u2; ++u) {
+      gfx::Point cellMin(m_bounds.x + u*m_cellSize,
+                         m_bounds.y + v*m_cellSize);
+      gfx::Point cellMax(cellMin.x + m_cellSize - 1,
+                         cellMin.y + m_cellSize - 1);
+      Line piece(
+        gfx::Point(std::max(line.a.x, cellMin.x), std::max(line.a.y, cellMin.y)),
+        gfx::Point(std::min(line.b.x, cellMax.x), std::min(line.b.y, cellMax.y)));
+      func(v*m_cols + u, piece);
+    }
+  }
+}
+
+void MaskBoundaryIndex::build(const BoundSeg* segs, int nsegs,
+                              int boundariesVersion,
+                              const render::Zoom& zoom)
+{
+  m_version = boundariesVersion;
+  m_zoom = zoom;
+  m_bounds = gfx::Rect();
+  m_cellSize = kMinCellSize;
+  m_cols = 0;
+  m_cells.clear();
+  m_lines.clear();
+
+  std::vector<MergeSeg> horz, vert;
+  for (int c=0; c<nsegs; ++c) {
+    const BoundSeg& seg = segs[c];
+    MergeSeg m;
+    m.open = (seg.open ? true: false);
+    if (seg.x1 == seg.x2) {
+      m.pos = seg.x1;
+      m.from = std::min(seg.y1, seg.y2);
+      m.to = std::max(seg.y1, seg.y2);
+      vert.push_back(m);
+    }
+    else {
+      m.pos = seg.y1;
+      m.from = std::min(seg.x1, seg.x2);
+      m.to = std::max(seg.x1, seg.x2);
+      horz.push_back(m);
+    }
+  }
+  merge_segs(horz);
+  merge_segs(vert);
+
+  // Apply the zoom and adjust the lines to be drawn inside the mask
+  // (the segments are between pixels).
+  std::vector<Line> lines;
+  lines.reserve(horz.size() + vert.size());
+
+  for (const MergeSeg& m : horz) {
+    int y = zoom.apply(m.pos);
+    int x1 = zoom.apply(m.from);
+    int x2 = std::max(x1, zoom.apply(m.to)-1);
+    if (!m.open)
+      --y;
+    lines.push_back(Line(gfx::Point(x1, y), gfx::Point(x2, y)));
+  }
+
+  for (const MergeSeg& m : vert) {
+    int x = zoom.apply(m.pos);
+    int y1 = zoom.apply(m.from);
+    int y2 = std::max(y1, zoom.apply(m.to)-1);
+    if (!m.open)
+      --x;
+    lines.push_back(Line(gfx::Point(x, y1), gfx::Point(x, y2)));
+  }
+
+  if (lines.empty())
+    return;
+
+  for (const Line& line : lines)
+    m_bounds |= gfx::Rect(line.a, line.b + gfx::Point(1, 1));
+
+  // Calculate the grid size
+  int rows;
+  for (;;) {
+    m_cols = (m_bounds.w + m_cellSize - 1) / m_cellSize;
+    rows = (m_bounds.h + m_cellSize - 1) / m_cellSize;
+    if (m_cols*rows <= kMaxCells)
+      break;
+    m_cellSize *= 2;
+  }
+
+  // Count the pieces of lines in each cell, and then put them in
+  // m_lines ordered by cell.
+  m_cells.resize(m_cols*rows+1, 0);
+  for (const Line& line : lines)
+    forEachPiece(line, [this](int cell, const Line&) { ++m_cells[cell+1]; });
+
+  for (std::size_t i=1; i<m_cells.size(); ++i)
+    m_cells[i] += m_cells[i-1];
+
+  std::vector<int> next(m_cells.begin(), m_cells.end()-1);
+  m_lines.resize(m_cells.back());
+  for (const Line& line : lines)
+    forEachPiece(line, [this, &next](int cell, const Line& piece) {
+        m_lines[next[cell]++] = piece;
+      });
+}
+
+} // namespace app
@@ -0,0 +1,90 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_EDITOR_MASK_BOUNDARY_INDEX_H_INCLUDED
+#define APP_UI_EDITOR_MASK_BOUNDARY_INDEX_H_INCLUDED
+#pragma once
+
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "render/zoom.h"
+
+#include <vector>
+
+namespace app {
+  struct BoundSeg;
+
+  // Lines to draw the selection boundaries (the "marching ants") in
+  // the editor. Segments are merged, zoomed and distributed in a grid
+  // of cells only once (each time the mask or the zoom changes), so
+  // each repaint iterates only the lines in the clipping area.
+  class MaskBoundaryIndex {
+  public:
+    MaskBoundaryIndex();
+
+    // Returns true if the index was built with the given version of
+    // the document boundaries and zoom level.
+    bool isValid(int boundariesVersion, const render::Zoom& zoom) const {
+      return (m_version == boundariesVersion && m_zoom == zoom);
+    }
+
+    void build(const BoundSeg* segs, int nsegs,
+               int boundariesVersion,
+               const render::Zoom& zoom);
+
+    // Calls drawLine(a, b) for each line that intersects the given
+    // bounds. Coordinates are relative to the sprite origin with the
+    // zoom applied.
+    template<typename DrawLine>
+    void forEachLine(const gfx::Rect& bounds, DrawLine drawLine) const {
+      gfx::Rect rc = bounds.createIntersect(m_bounds);
+      if (rc.isEmpty())
+        return;
+
+      int u1 = (rc.x - m_bounds.x) / m_cellSize;
+      int v1 = (rc.y - m_bounds.y) / m_cellSize;
+      int u2 = (rc.x2() - 1 - m_bounds.x) / m_cellSize;
+      int v2 = (rc.y2() - 1 - m_bounds.y) / m_cellSize;
+
+      for (int v=v1; v<=v2; ++v) {
+        for (int u=u1; u<=u2; ++u) {
+          int cell = v*m_cols + u;
+          for (int i=m_cells[cell]; i<m_cells[cell+1]; ++i) {
+            const Line& line = m_lines[i];
+            if (line.b.x >= rc.x && line.a.x < rc.x2() &&
+                line.b.y >= rc.y && line.a.y < rc.y2())
+              drawLine(line.a, line.b);
+          }
+        }
+      }
+    }
+
+  private:
+    // Horizontal or vertical line from "a" to "b" (both inclusive,
+    // a.x <= b.x and a.y <= b.y).
+    struct Line {
+      gfx::Point a, b;
+      Line() { }
+      Line(const gfx::Point& a, const gfx::Point& b) : a(a), b(b) { }
+    };
+
+    template<typename Func>
+    void forEachPiece(const Line& line, Func func) const;
+
+    int m_version;
+    render::Zoom m_zoom;
+    gfx::Rect m_bounds;         // Bounds of all lines
+    int m_cellSize;
+    int m_cols;
+    // Lines of the cell "i" are m_lines[m_cells[i]...m_cells[i+1]-1]
+    std::vector<int> m_cells;
+    std::vector<Line> m_lines;
+  };
+
+} // namespace app
+
+#endif
@@ -22,7 +22,6 @@
 #include "app/pref/preferences.h"
 #include "app/settings/settings.h"
 #include "app/snap_to_grid.h"
-#include "app/ui/status_bar.h"
 #include "app/ui_context.h"
 #include "app/util/expand_cel_canvas.h"
 #include "base/vector2d.h"
@@ -624,9 +623,6 @@ void PixelsMovement::drawParallelogram(doc::Image* dst, doc::Image* src,
     rotAlgo = kFastRotationAlgorithm;
   }
 
-retry:;      // In case that we don't have enough memory for RotSprite
-             // we can try with the fast algorithm anyway.
-
   switch (rotAlgo) {
 
     case kFastRotationAlgorithm:
@@ -642,24 +638,15 @@ retry:;      // In case that we don't have enough memory for RotSprite
       break;
 
     case kRotSpriteRotationAlgorithm:
-      try {
-        doc::algorithm::rotsprite_image(dst, src,
-          int(corners.leftTop().x-leftTop.x),
-          int(corners.leftTop().y-leftTop.y),
-          int(corners.rightTop().x-leftTop.x),
-          int(corners.rightTop().y-leftTop.y),
-          int(corners.rightBottom().x-leftTop.x),
-          int(corners.rightBottom().y-leftTop.y),
-          int(corners.leftBottom().x-leftTop.x),
-          int(corners.leftBottom().y-leftTop.y));
-      }
-      catch (const std::bad_alloc&) {
-        StatusBar::instance()->showTip(1000,
-          "Not enough memory for RotSprite");
-
-        rotAlgo = kFastRotationAlgorithm;
-        goto retry;
-      }
+      doc::algorithm::rotsprite_image(dst, src,
+        int(corners.leftTop().x-leftTop.x),
+        int(corners.leftTop().y-leftTop.y),
+        int(corners.rightTop().x-leftTop.x),
+        int(corners.rightTop().y-leftTop.y),
+        int(corners.rightBottom().x-leftTop.x),
+        int(corners.rightBottom().y-leftTop.y),
+        int(corners.leftBottom().x-leftTop.x),
+        int(corners.leftBottom().y-leftTop.y));
       break;
 
   }
@@ -11,13 +11,19 @@
 
 #include "app/ui/editor/play_state.h"
 
+#include "app/app.h"
 #include "app/handle_anidir.h"
 #include "app/loop_tag.h"
+#include "app/pref/preferences.h"
 #include "app/ui/editor/editor.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui_context.h"
 #include "ui/system.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace ui;
@@ -29,6 +35,10 @@ PlayState::PlayState()
 {
 }
 
+PlayState::~PlayState()
+{
+}
+
 void PlayState::onAfterChangeState(Editor* editor)
 {
   StateWithWheelBehavior::onAfterChangeState(editor);
@@ -39,6 +49,13 @@ void PlayState::onAfterChangeState(Editor* editor)
   m_pingPongForward = true;
   m_refFrame = editor->frame();
 
+  int cacheSize = App::instance()->preferences().editor.playbackCacheSize();
+  if (cacheSize > 0) {
+    m_playbackCache.reset(
+      new PlaybackCache(editor->document(), std::size_t(cacheSize) * 1024 * 1024));
+    prefetchNextFrames();
+  }
+
   m_playTimer.Tick.connect(&PlayState::onPlaybackTick, this);
   m_playTimer.start();
 }
@@ -47,6 +64,7 @@ EditorState::BeforeChangeAction PlayState::onBeforeChangeState(Editor* editor, E
 {
   m_editor->setFrame(m_refFrame);
   m_playTimer.stop();
+  m_playbackCache.reset(nullptr);
   return KeepState;
 }
 
@@ -89,6 +107,11 @@ bool PlayState::onKeyUp(Editor* editor, KeyMessage* msg)
   return false;
 }
 
+PlaybackCache* PlayState::playbackCache()
+{
+  return m_playbackCache.get();
+}
+
 void PlayState::onPlaybackTick()
 {
   if (m_nextFrameTime < 0)
@@ -110,7 +133,36 @@ void PlayState::onPlaybackTick()
   }
 
   m_curFrameTick = ui::clock();
+  prefetchNextFrames();
   m_editor->invalidate();
 }
 
+void PlayState::prefetchNextFrames()
+{
+  if (!m_playbackCache)
+    return;
+
+  doc::Sprite* sprite = m_editor->sprite();
+  gfx::Rect bounds = m_editor->getVisibleSpriteBounds();
+  bounds.enlarge(1);
+  bounds = m_editor->zoom().apply(sprite->bounds().createIntersect(bounds));
+  m_playbackCache->setView(m_editor->zoom(), bounds);
+
+  // Simulate the playback to know which frames are displayed next
+  // (the current one is the first one as it wasn't painted yet).
+  doc::FrameTag* tag = get_animation_tag(sprite, m_refFrame);
+  doc::frame_t frame = m_editor->frame();
+  bool pingPongForward = m_pingPongForward;
+  int capacity = m_playbackCache->capacity();
+  std::vector<doc::frame_t> frames;
+
+  for (int i=0; i<capacity; ++i) {
+    if (std::find(frames.begin(), frames.end(), frame) == frames.end())
+      frames.push_back(frame);
+    frame = calculate_next_frame(sprite, frame, tag, pingPongForward);
+  }
+
+  m_playbackCache->prefetch(frames);
+}
+
 } // namespace app
@@ -10,14 +10,17 @@
 #pragma once
 
 #include "app/ui/editor/state_with_wheel_behavior.h"
+#include "base/unique_ptr.h"
 #include "doc/frame.h"
 #include "ui/timer.h"
 
 namespace app {
+  class PlaybackCache;
 
   class PlayState : public StateWithWheelBehavior {
   public:
     PlayState();
+    ~PlayState();
 
     void onAfterChangeState(Editor* editor) override;
     BeforeChangeAction onBeforeChangeState(Editor* editor, EditorState* newState) override;
@@ -26,9 +29,11 @@ namespace app {
     bool onMouseMove(Editor* editor, ui::MouseMessage* msg) override;
     bool onKeyDown(Editor* editor, ui::KeyMessage* msg) override;
     bool onKeyUp(Editor* editor, ui::KeyMessage* msg) override;
+    PlaybackCache* playbackCache() override;
 
   private:
     void onPlaybackTick();
+    void prefetchNextFrames();
 
     Editor* m_editor;
     ui::Timer m_playTimer;
@@ -40,6 +45,9 @@ namespace app {
 
     bool m_pingPongForward;
     doc::frame_t m_refFrame;
+
+    // Frames rendered in advance in a background thread.
+    base::UniquePtr<PlaybackCache> m_playbackCache;
   };
 
 } // namespace app
@@ -0,0 +1,220 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/playback_cache.h"
+
+#include "app/document.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "render/render.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace app {
+
+using namespace doc;
+
+PlaybackCache::PlaybackCache(Document* document, std::size_t maxMemory)
+  : m_document(document)
+  , m_maxMemory(maxMemory)
+  , m_zoom(1, 1)
+  , m_viewVersion(0)
+  , m_running(true)
+{
+  // The background is configured here because the preferences can be
+  // accessed only from the UI thread.
+  m_render.setupBackground(document, IMAGE_RGB);
+
+  m_thread = std::thread([this]{ renderThread(); });
+}
+
+PlaybackCache::~PlaybackCache()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+void PlaybackCache::setView(const render::Zoom& zoom, const gfx::Rect& bounds)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_zoom == zoom && m_bounds == bounds)
+    return;
+
+  m_zoom = zoom;
+  m_bounds = bounds;
+  m_entries.clear();
+  m_failedFrames.clear();
+  ++m_viewVersion;
+}
+
+void PlaybackCache::prefetch(const std::vector<frame_t>& frames)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_frames = frames;
+
+    // Discard frames that were already displayed
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+      if (std::find(m_frames.begin(), m_frames.end(), it->frame) == m_frames.end())
+        it = m_entries.erase(it);
+      else
+        ++it;
+    }
+    for (auto it=m_failedFrames.begin(); it!=m_failedFrames.end(); ) {
+      if (std::find(m_frames.begin(), m_frames.end(), *it) == m_frames.end())
+        it = m_failedFrames.erase(it);
+      else
+        ++it;
+    }
+  }
+  m_cv.notify_one();
+}
+
+int PlaybackCache::capacity() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::size_t frameSize = std::size_t(m_bounds.w) * m_bounds.h * 4;
+  if (frameSize == 0)
+    return 1;
+  return std::max<int>(1, int(m_maxMemory / frameSize));
+}
+
+bool PlaybackCache::copyFrame(frame_t frame,
+                              const render::Zoom& zoom,
+                              const gfx::Rect& bounds,
+                              Image* dst)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_zoom != zoom || !m_bounds.contains(bounds))
+      return false;
+
+    Entry* entry = findEntry(frame);
+    if (!entry)
+      return false;
+
+    // Check that the sprite wasn't modified after the frame was
+    // rendered (e.g. an undo while the animation is playing).
+    std::vector<uint32_t> key;
+    render::add_sprite_frame_key(m_document->sprite(), frame, key);
+    if (entry->key == key) {
+      dst->copy(entry->image.get(),
+                gfx::Clip(0, 0,
+                          bounds.x - m_bounds.x,
+                          bounds.y - m_bounds.y,
+                          bounds.w, bounds.h));
+      return true;
+    }
+
+    for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+      if (&(*it) == entry) {
+        m_entries.erase(it);
+        break;
+      }
+    }
+  }
+  m_cv.notify_one();
+  return false;
+}
+
+void PlaybackCache::renderThread()
+{
+  while (true) {
+    frame_t frame;
+    render::Zoom zoom(1, 1);
+    gfx::Rect bounds;
+    int viewVersion;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (m_running && !findFrameToRender(frame))
+        m_cv.wait(lock);
+      if (!m_running)
+        break;
+
+      zoom = m_zoom;
+      bounds = m_bounds;
+      viewVersion = m_viewVersion;
+    }
+
+    Entry entry;
+    entry.frame = frame;
+
+    // We don't wait for the lock, the UI thread could be modifying
+    // the sprite (in that case we try again later).
+    if (!m_document->lock(Document::ReadLock, 0)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+
+    bool rendered = true;
+    try {
+      const Sprite* sprite = m_document->sprite();
+      render::add_sprite_frame_key(sprite, frame, entry.key);
+      entry.image.reset(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+      m_render.renderSprite(entry.image.get(), sprite, frame,
+                            gfx::Clip(0, 0, bounds), zoom);
+    }
+    catch (const std::exception&) {
+      rendered = false;
+    }
+    m_document->unlock();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (viewVersion == m_viewVersion &&
+        std::find(m_frames.begin(), m_frames.end(), frame) != m_frames.end() &&
+        !findEntry(frame)) {
+      // The Editor will render this frame by itself.
+      if (!rendered)
+        m_failedFrames.push_back(frame);
+      else
+        m_entries.push_back(entry);
+    }
+
+    // The image reference count isn't atomic, so our reference must
+    // be released while the UI thread cannot touch the cached copy.
+    entry.image.reset();
+  }
+}
+
+bool PlaybackCache::findFrameToRender(frame_t& frame)
+{
+  if (m_bounds.isEmpty())
+    return false;
+
+  std::size_t frameSize = std::size_t(m_bounds.w) * m_bounds.h * 4;
+  std::size_t maxEntries = std::max<std::size_t>(1, m_maxMemory / frameSize);
+  if (m_entries.size() >= maxEntries)
+    return false;
+
+  for (frame_t next : m_frames) {
+    if (!findEntry(next) &&
+        std::find(m_failedFrames.begin(), m_failedFrames.end(), next) == m_failedFrames.end()) {
+      frame = next;
+      return true;
+    }
+  }
+  return false;
+}
+
+PlaybackCache::Entry* PlaybackCache::findEntry(frame_t frame)
+{
+  for (Entry& entry : m_entries)
+    if (entry.frame == frame)
+      return &entry;
+  return nullptr;
+}
+
+} // namespace app
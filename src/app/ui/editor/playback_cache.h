@@ -0,0 +1,105 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/app_render.h"
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "gfx/rect.h"
+#include "render/zoom.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+  class Document;
+
+  // Renders in a background thread the frames that will be displayed
+  // next while the animation is being played (PlayState), so the
+  // Editor only has to copy the already rendered pixels to the
+  // screen. Rendered frames are kept in a ring limited by the given
+  // amount of memory.
+  class PlaybackCache {
+  public:
+    PlaybackCache(Document* document, std::size_t maxMemory);
+    ~PlaybackCache();
+
+    // Changes the zoom and the area of the sprite (with the zoom
+    // applied) that are rendered. All rendered frames are discarded
+    // if they change.
+    void setView(const render::Zoom& zoom, const gfx::Rect& bounds);
+
+    // Sets the list of frames that will be displayed next (in order
+    // of appearance). Rendered frames that are not in the list are
+    // discarded.
+    void prefetch(const std::vector<doc::frame_t>& frames);
+
+    // Maximum number of frames that can be rendered in advance with
+    // the current view.
+    int capacity() const;
+
+    // Copies the "bounds" area (with the zoom applied) of the given
+    // frame into "dst". Returns false if the frame isn't rendered yet
+    // or if the sprite was modified after it was rendered. It must be
+    // called from the UI thread.
+    bool copyFrame(doc::frame_t frame,
+                   const render::Zoom& zoom,
+                   const gfx::Rect& bounds,
+                   doc::Image* dst);
+
+  private:
+    struct Entry {
+      doc::frame_t frame;
+      doc::ImageRef image;
+      std::vector<uint32_t> key;
+    };
+
+    void renderThread();
+    bool findFrameToRender(doc::frame_t& frame);
+    Entry* findEntry(doc::frame_t frame);
+
+    Document* m_document;
+    std::size_t m_maxMemory;
+    AppRender m_render;
+    render::Zoom m_zoom;
+    gfx::Rect m_bounds;
+
+    // Incremented each time the view changes, so frames that were
+    // being rendered with the old view are discarded.
+    int m_viewVersion;
+
+    std::vector<doc::frame_t> m_frames;
+    std::deque<Entry> m_entries;
+
+    // Frames that couldn't be rendered (the Editor renders them by
+    // itself). They are tried again when they are prefetched again
+    // after being displayed, or when the view changes.
+    std::vector<doc::frame_t> m_failedFrames;
+
+    bool m_running;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+
+    DISABLE_COPYING(PlaybackCache);
+  };
+
+} // namespace app
+
+#endif
@@ -122,15 +122,7 @@ public:
     , m_expandCelCanvas(editor->getSite(),
         m_docPref.tiled.mode(),
         m_transaction,
-        ExpandCelCanvas::Flags(
-          ExpandCelCanvas::NeedsSource |
-          // If the tool is freehand-like, we can use the modified
-          // region directly as undo information to save the modified
-          // pixels (it's faster than creating a Dirty object).
-          // See ExpandCelCanvas::commit() for details about this flag.
-          (getController()->isFreehand() ?
-            ExpandCelCanvas::UseModifiedRegionAsUndoInfo:
-            ExpandCelCanvas::None)))
+        ExpandCelCanvas::NeedsSource)
     , m_shadeTable(NULL)
   {
     // Settings
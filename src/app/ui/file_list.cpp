@@ -393,6 +393,15 @@ void FileList::onPaint(ui::PaintEvent& ev)
   }
 }
 
+void FileList::onResize(ui::ResizeEvent& ev)
+{
+  Widget::onResize(ev);
+
+  // The list was scrolled or its items changed, generate the
+  // thumbnails of the new visible items when it stops moving.
+  m_generateThumbnailTimer.start();
+}
+
 void FileList::onPreferredSize(PreferredSizeEvent& ev)
 {
   if (!m_req_valid) {
@@ -440,9 +449,45 @@ void FileList::onGenerateThumbnailTick()
 {
   m_generateThumbnailTimer.stop();
 
+  ThumbnailGenerator* generator = ThumbnailGenerator::instance();
+
+  // Stop generating thumbnails of items that aren't visible anymore
+  FileItemList visibleItems = getVisibleItems();
+  FileItemList items = visibleItems;
   IFileItem* fileitem = m_itemToGenerateThumbnail;
   if (fileitem)
-    ThumbnailGenerator::instance()->addWorkerToGenerateThumbnail(fileitem);
+    items.push_back(fileitem);
+  generator->stopWorkersExcept(items);
+
+  // The selected item is generated first
+  if (fileitem)
+    generator->addWorkerToGenerateThumbnail(fileitem);
+
+  for (IFileItem* fi : visibleItems)
+    generator->addWorkerToGenerateThumbnail(fi, ThumbnailGenerator::LowPriority);
+}
+
+FileItemList FileList::getVisibleItems()
+{
+  FileItemList items;
+  View* view = View::getView(this);
+  if (!view)
+    return items;
+
+  gfx::Rect vp = view->getViewportBounds();
+  int y = getBounds().y + getClientBounds().y;
+
+  for (IFileItem* fi : m_list) {
+    int h = getFileItemSize(fi).h;
+    if (y >= vp.y2())
+      break;
+
+    if (!fi->isFolder() && y+h > vp.y)
+      items.push_back(fi);
+
+    y += h;
+  }
+  return items;
 }
 
 gfx::Size FileList::getFileItemSize(IFileItem* fi) const
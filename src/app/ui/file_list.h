@@ -40,6 +40,7 @@ namespace app {
   protected:
     virtual bool onProcessMessage(ui::Message* msg) override;
     virtual void onPaint(ui::PaintEvent& ev) override;
+    virtual void onResize(ui::ResizeEvent& ev) override;
     virtual void onPreferredSize(ui::PreferredSizeEvent& ev) override;
     virtual void onFileSelected();
     virtual void onFileAccepted();
@@ -49,6 +50,7 @@ namespace app {
     void onGenerateThumbnailTick();
     void onMonitoringTick();
     gfx::Size getFileItemSize(IFileItem* fi) const;
+    FileItemList getVisibleItems();
     void makeSelectedFileitemVisible();
     void regenerateList();
     int getSelectedIndex();
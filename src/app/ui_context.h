@@ -29,7 +29,7 @@ namespace app {
 
     DocumentView* activeView() const;
     void setActiveView(DocumentView* documentView);
-    void setActiveDocument(Document* document);
+    void setActiveDocument(Document* document) override;
 
     DocumentView* getFirstDocumentView(Document* document) const;
 
@@ -14,6 +14,7 @@
 #include "app/app.h"
 #include "app/cmd/add_cel.h"
 #include "app/cmd/copy_region.h"
+#include "app/cmd/remove_cel.h"
 #include "app/cmd/replace_image.h"
 #include "app/cmd/set_cel_position.h"
 #include "app/context.h"
@@ -21,6 +22,7 @@
 #include "app/transaction.h"
 #include "app/util/range_utils.h"
 #include "base/unique_ptr.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
@@ -42,7 +44,8 @@ static void destroy_buffers()
 static void create_buffers()
 {
   if (!src_buffer) {
-    app::App::instance()->Exit.connect(&destroy_buffers);
+    if (app::App::instance())
+      app::App::instance()->Exit.connect(&destroy_buffers);
 
     src_buffer.reset(new doc::ImageBuffer(1));
     dst_buffer.reset(new doc::ImageBuffer(1));
@@ -142,12 +145,22 @@ void ExpandCelCanvas::commit()
     // We can temporary remove the cel.
     static_cast<LayerImage*>(m_layer)->removeCel(m_cel);
 
-    // Add a copy of m_dstImage in the sprite's image stock
-    ImageRef newImage(Image::createCopy(m_dstImage.get()));
-    m_cel->data()->setImage(newImage);
+    gfx::Rect trimBounds;
+    if (getTrimmedDestBounds(trimBounds)) {
+      // Add a copy of the non-transparent part of m_dstImage in the
+      // sprite's image stock
+      ImageRef newImage(createTrimmedDestCopy(trimBounds));
+      m_cel->data()->setImage(newImage);
+      m_cel->setPosition(m_bounds.getOrigin() + trimBounds.getOrigin());
 
-    // And finally we add the cel again in the layer.
-    m_transaction.execute(new cmd::AddCel(m_layer, m_cel));
+      // And finally we add the cel again in the layer.
+      m_transaction.execute(new cmd::AddCel(m_layer, m_cel));
+    }
+    // Nothing was painted, we don't need a new cel at all.
+    else {
+      delete m_cel;
+      m_cel = NULL;
+    }
   }
   else if (m_celImage) {
     // If the size of each image is the same, we can create an undo
@@ -159,32 +172,49 @@ void ExpandCelCanvas::commit()
       int dx = -m_bounds.x + m_origCelPos.x;
       int dy = -m_bounds.y + m_origCelPos.y;
 
-      if ((m_flags & UseModifiedRegionAsUndoInfo) != UseModifiedRegionAsUndoInfo) {
-        // TODO Reduce m_validDstRegion to modified areas between
-        //      m_celImage and m_dstImage
-      }
+      // Only the pixels that were really modified between
+      // m_celImage and m_dstImage are saved in the undo information.
+      ASSERT(dx == 0 && dy == 0);
+      gfx::Region modifiedRegion;
+      get_diff_region_between_images(
+        m_celImage.get(), m_dstImage.get(), m_validDstRegion, modifiedRegion);
 
       // Copy the destination to the cel image.
-      m_transaction.execute(new cmd::CopyRegion(
-          m_celImage.get(), m_dstImage.get(), m_validDstRegion, dx, dy));
+      if (!modifiedRegion.isEmpty())
+        m_transaction.execute(new cmd::CopyRegion(
+            m_celImage.get(), m_dstImage.get(), modifiedRegion, dx, dy));
     }
     // If the size of both images are different, we have to
     // replace the entire image.
     else {
-      if (m_cel->position() != m_origCelPos) {
-        gfx::Point newPos = m_cel->position();
+      // Validate the whole m_dstImage copying invalid areas from m_celImage
+      validateDestCanvas(gfx::Region(m_bounds));
+
+      gfx::Rect trimBounds;
+      bool empty = !getTrimmedDestBounds(trimBounds);
+
+      // The whole cel was cleared, so we remove it. Linked cels are
+      // kept because RemoveCel would remove only the cel of this
+      // frame, they share a 1x1 transparent image instead.
+      if (empty && m_cel->links() == 0) {
         m_cel->setPosition(m_origCelPos);
-        m_transaction.execute(new cmd::SetCelPosition(m_cel, newPos.x, newPos.y));
+        m_transaction.execute(new cmd::RemoveCel(m_cel));
+        m_cel = NULL;
       }
+      else {
+        if (empty)
+          trimBounds = gfx::Rect(0, 0, 1, 1);
 
-      // Validate the whole m_dstImage copying invalid areas from m_celImage
-      validateDestCanvas(gfx::Region(m_bounds));
+        gfx::Point newPos = m_bounds.getOrigin() + trimBounds.getOrigin();
+        m_cel->setPosition(m_origCelPos);
+        if (newPos != m_origCelPos)
+          m_transaction.execute(new cmd::SetCelPosition(m_cel, newPos.x, newPos.y));
 
-      // Replace the image in the stock. We need to create a copy of
-      // image because m_dstImage's ImageBuffer cannot be shared.
-      ImageRef newImage(Image::createCopy(m_dstImage.get()));
-      m_transaction.execute(new cmd::ReplaceImage(
-          m_sprite, m_celImage, newImage));
+        // Replace the image in the stock.
+        ImageRef newImage(createTrimmedDestCopy(trimBounds));
+        m_transaction.execute(new cmd::ReplaceImage(
+            m_sprite, m_celImage, newImage));
+      }
     }
   }
   else {
@@ -211,6 +241,32 @@ void ExpandCelCanvas::rollback()
   m_closed = true;
 }
 
+// Returns the bounds of the non-transparent area of m_dstImage (in
+// m_dstImage coordinates), or false if the whole image is transparent.
+// Cels in the background layer are never trimmed.
+bool ExpandCelCanvas::getTrimmedDestBounds(gfx::Rect& bounds)
+{
+  if (m_layer->isBackground()) {
+    bounds = m_dstImage->bounds();
+    return true;
+  }
+
+  return doc::algorithm::shrink_bounds(
+    m_dstImage.get(), bounds, m_dstImage->maskColor());
+}
+
+// Creates a copy of the given area of m_dstImage. We need a copy
+// because m_dstImage's ImageBuffer cannot be shared.
+ImageRef ExpandCelCanvas::createTrimmedDestCopy(const gfx::Rect& bounds)
+{
+  if (bounds == m_dstImage->bounds())
+    return ImageRef(Image::createCopy(m_dstImage.get()));
+
+  return ImageRef(crop_image(m_dstImage.get(),
+      bounds.x, bounds.y, bounds.w, bounds.h,
+      m_dstImage->maskColor()));
+}
+
 Image* ExpandCelCanvas::getSourceCanvas()
 {
   ASSERT((m_flags & NeedsSource) == NeedsSource);
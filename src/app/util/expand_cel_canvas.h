@@ -42,7 +42,6 @@ namespace app {
     enum Flags {
       None = 0,
       NeedsSource = 1,
-      UseModifiedRegionAsUndoInfo = 2,
     };
 
     ExpandCelCanvas(Site site,
@@ -51,7 +50,8 @@ namespace app {
 
     // Commit changes made in getDestCanvas() in the cel's image. Adds
     // information in the undo history so the user can undo the
-    // modifications in the canvas.
+    // modifications in the canvas. The cel's image is trimmed to its
+    // non-transparent area (or the cel is removed if it's empty).
     void commit();
 
     // Restore the cel as its original state as when ExpandCelCanvas()
@@ -70,6 +70,9 @@ namespace app {
     const Cel* getCel() const { return m_cel; }
 
   private:
+    bool getTrimmedDestBounds(gfx::Rect& bounds);
+    ImageRef createTrimmedDestCopy(const gfx::Rect& bounds);
+
     Document* m_document;
     Sprite* m_sprite;
     Layer* m_layer;
@@ -0,0 +1,167 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/context.h"
+#include "app/document.h"
+#include "app/document_undo.h"
+#include "app/transaction.h"
+#include "app/util/expand_cel_canvas.h"
+#include "base/unique_ptr.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/site.h"
+#include "doc/test_context.h"
+
+using namespace app;
+using namespace doc;
+
+typedef base::UniquePtr<app::Document> DocumentPtr;
+
+class ExpandCelCanvasTest : public ::testing::Test {
+protected:
+  ExpandCelCanvasTest()
+    : doc(static_cast<app::Document*>(ctx.documents().add(32, 16)))
+    , sprite(doc->sprite())
+    , layer(static_cast<LayerImage*>(sprite->folder()->getFirstLayer())) {
+    sprite->setTotalFrames(frame_t(3));
+  }
+
+  ~ExpandCelCanvasTest() {
+    doc->close();
+  }
+
+  Site site(frame_t frame) {
+    Site site;
+    site.document(doc);
+    site.sprite(sprite);
+    site.layer(layer);
+    site.frame(frame);
+    return site;
+  }
+
+  // Paints the given pixels (in sprite coordinates) as the tool loop
+  // does, and commits the changes.
+  void paint(frame_t frame, const gfx::Rect& rc, color_t color) {
+    Transaction transaction(&ctx, "Paint");
+    {
+      ExpandCelCanvas expand(site(frame), TiledMode::NONE,
+                             transaction, ExpandCelCanvas::None);
+      expand.validateDestCanvas(gfx::Region(sprite->bounds()));
+
+      gfx::Point origin = expand.getCel()->position();
+      if (!rc.isEmpty())
+        fill_rect(expand.getDestCanvas(),
+                  gfx::Rect(rc).offset(-origin), color);
+      expand.commit();
+    }
+    transaction.commit();
+  }
+
+  TestContextT<app::Context> ctx;
+  DocumentPtr doc;
+  Sprite* sprite;
+  LayerImage* layer;
+};
+
+TEST_F(ExpandCelCanvasTest, NewCelIsTrimmed)
+{
+  EXPECT_EQ(NULL, layer->cel(frame_t(1)));
+  paint(frame_t(1), gfx::Rect(5, 3, 6, 5), 0xff0000ff);
+
+  Cel* cel = layer->cel(frame_t(1));
+  ASSERT_TRUE(cel != NULL);
+  EXPECT_TRUE(gfx::Rect(5, 3, 6, 5) == cel->bounds());
+  EXPECT_EQ(0xff0000ff, get_pixel(cel->image(), 0, 0));
+  EXPECT_EQ(0xff0000ff, get_pixel(cel->image(), 5, 4));
+
+  doc->undoHistory()->undo();
+  EXPECT_EQ(NULL, layer->cel(frame_t(1)));
+}
+
+TEST_F(ExpandCelCanvasTest, EmptyNewCelIsNotAdded)
+{
+  paint(frame_t(1), gfx::Rect(0, 0, 0, 0), 0);
+  EXPECT_EQ(NULL, layer->cel(frame_t(1)));
+}
+
+TEST_F(ExpandCelCanvasTest, CelIsTrimmedAfterPainting)
+{
+  paint(frame_t(1), gfx::Rect(5, 3, 2, 2), 0xff0000ff);
+  paint(frame_t(1), gfx::Rect(20, 10, 1, 1), 0xff00ff00);
+
+  Cel* cel = layer->cel(frame_t(1));
+  ASSERT_TRUE(cel != NULL);
+  EXPECT_TRUE(gfx::Rect(5, 3, 16, 8) == cel->bounds());
+  EXPECT_EQ(0xff0000ff, get_pixel(cel->image(), 0, 0));
+  EXPECT_EQ(0, get_pixel(cel->image(), 2, 2));
+  EXPECT_EQ(0xff00ff00, get_pixel(cel->image(), 15, 7));
+
+  // Erase the first square
+  paint(frame_t(1), gfx::Rect(5, 3, 2, 2), 0);
+  ASSERT_EQ(cel, layer->cel(frame_t(1)));
+  EXPECT_TRUE(gfx::Rect(20, 10, 1, 1) == cel->bounds());
+
+  doc->undoHistory()->undo();
+  EXPECT_TRUE(gfx::Rect(5, 3, 16, 8) == cel->bounds());
+  EXPECT_EQ(0xff0000ff, get_pixel(cel->image(), 0, 0));
+}
+
+TEST_F(ExpandCelCanvasTest, CelOutsideSpriteIsKept)
+{
+  paint(frame_t(1), gfx::Rect(0, 0, 1, 1), 0xff0000ff);
+  Cel* cel = layer->cel(frame_t(1));
+  ASSERT_TRUE(cel != NULL);
+
+  // Move the cel partially outside the sprite, the pixels outside
+  // must be kept after painting.
+  cel->setPosition(-4, -4);
+  paint(frame_t(1), gfx::Rect(8, 8, 1, 1), 0xff00ff00);
+
+  EXPECT_TRUE(gfx::Rect(-4, -4, 13, 13) == cel->bounds());
+  EXPECT_EQ(0xff0000ff, get_pixel(cel->image(), 0, 0));
+  EXPECT_EQ(0xff00ff00, get_pixel(cel->image(), 12, 12));
+}
+
+TEST_F(ExpandCelCanvasTest, ClearedCelIsRemoved)
+{
+  paint(frame_t(1), gfx::Rect(5, 3, 2, 2), 0xff0000ff);
+  ASSERT_TRUE(layer->cel(frame_t(1)) != NULL);
+
+  paint(frame_t(1), sprite->bounds(), 0);
+  EXPECT_EQ(NULL, layer->cel(frame_t(1)));
+
+  doc->undoHistory()->undo();
+  Cel* cel = layer->cel(frame_t(1));
+  ASSERT_TRUE(cel != NULL);
+  EXPECT_TRUE(gfx::Rect(5, 3, 2, 2) == cel->bounds());
+}
+
+TEST_F(ExpandCelCanvasTest, ClearedLinkedCelsAreKept)
+{
+  paint(frame_t(1), gfx::Rect(5, 3, 2, 2), 0xff0000ff);
+
+  Cel* cel0 = layer->cel(frame_t(1));
+  Cel* cel1 = Cel::createLink(cel0);
+  cel1->setFrame(frame_t(2));
+  layer->addCel(cel1);
+
+  paint(frame_t(2), sprite->bounds(), 0);
+
+  // Both cels are still linked and transparent
+  ASSERT_EQ(cel0, layer->cel(frame_t(1)));
+  ASSERT_EQ(cel1, layer->cel(frame_t(2)));
+  EXPECT_EQ(cel0->dataRef().get(), cel1->dataRef().get());
+  EXPECT_EQ(0, get_pixel(cel0->image(), 0, 0));
+
+  doc->undoHistory()->undo();
+  EXPECT_EQ(cel0->dataRef().get(), cel1->dataRef().get());
+  EXPECT_TRUE(gfx::Rect(5, 3, 2, 2) == cel0->bounds());
+  EXPECT_EQ(0xff0000ff, get_pixel(cel0->image(), 0, 0));
+}
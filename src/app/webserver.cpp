@@ -13,19 +13,74 @@
 
 #include "app/webserver.h"
 
+#include "app/app.h"
+#include "app/app_options.h"
+#include "app/batch_context.h"
+#include "app/document_exporter.h"
+#include "app/resource_finder.h"
+#include "base/chrono.h"
 #include "base/fs.h"
 #include "base/path.h"
-#include "app/resource_finder.h"
+#include "base/split_string.h"
+#include "base/unique_ptr.h"
 #include "webserver/webserver.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
 
 #define API_VERSION 1
 
 namespace app {
 
+static std::string json_string(const std::string& str)
+{
+  std::string result = "\"";
+  for (char c : str) {
+    switch (c) {
+      case '"': result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\b': result += "\\b"; break;
+      case '\f': result += "\\f"; break;
+      case '\n': result += "\\n"; break;
+      case '\r': result += "\\r"; break;
+      case '\t': result += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char buf[8];
+          std::sprintf(buf, "\\u%04x", (unsigned char)c);
+          result += buf;
+        }
+        else
+          result.push_back(c);
+        break;
+    }
+  }
+  result.push_back('"');
+  return result;
+}
+
+static std::string random_token()
+{
+  std::random_device rd;
+  std::string token;
+  char buf[16];
+  for (int i=0; i<4; ++i) {
+    std::sprintf(buf, "%08x", (unsigned int)rd());
+    token += buf;
+  }
+  return token;
+}
+
 WebServer::WebServer()
   : m_webServer(NULL)
+  , m_token(random_token())
+  , m_exportJobs(false)
+  , m_stopped(false)
 {
   ResourceFinder rf;
   rf.includeDataDir("www");
@@ -43,11 +98,23 @@ WebServer::~WebServer()
   delete m_webServer;
 }
 
+void WebServer::waitUntilStopped()
+{
+  std::unique_lock<std::mutex> lock(m_stopMutex);
+  while (!m_stopped)
+    m_stopCond.wait(lock);
+}
+
 void WebServer::start()
 {
   m_webServer = new webserver::WebServer(this);
 }
 
+std::string WebServer::url() const
+{
+  return m_webServer->getUrl();
+}
+
 void WebServer::onProcessRequest(webserver::IRequest* request,
                                  webserver::IResponse* response)
 {
@@ -62,6 +129,21 @@ void WebServer::onProcessRequest(webserver::IRequest* request,
                           << "\"webserver\":\"" << m_webServer->getName() << "\","
                           << "\"api\":\"" << API_VERSION << "\"}";
   }
+  else if (m_exportJobs && uri == "/export") {
+    if (checkJobRequest(request, response))
+      processExportJob(request, response);
+  }
+  else if (m_exportJobs && uri == "/shutdown") {
+    if (checkJobRequest(request, response)) {
+      {
+        std::unique_lock<std::mutex> lock(m_stopMutex);
+        m_stopped = true;
+      }
+      m_stopCond.notify_all();
+
+      response->getStream() << "{\"status\":\"ok\"}";
+    }
+  }
   else {
     if (uri == "/" || uri.empty())
       uri = "/index.html";
@@ -79,6 +161,128 @@ void WebServer::onProcessRequest(webserver::IRequest* request,
   }
 }
 
+// Checks that the request comes from a local program (not from a web
+// page opened in a browser): it must be a POST request with the token
+// of this run and without an Origin header.
+bool WebServer::checkJobRequest(webserver::IRequest* request,
+                                webserver::IResponse* response)
+{
+  std::ostream& os = response->getStream();
+  response->setContentType("application/json");
+
+  if (std::strcmp(request->getRequestMethod(), "POST") != 0) {
+    response->setStatusCode(405);
+    os << "{\"status\":\"error\","
+       << "\"error\":\"Use a POST request\"}";
+    return false;
+  }
+
+  const char* token = request->getHeader("X-Aseprite-Token");
+  if (request->getHeader("Origin") || !token || m_token != token) {
+    response->setStatusCode(403);
+    os << "{\"status\":\"error\","
+       << "\"error\":\"Forbidden\"}";
+    return false;
+  }
+
+  return true;
+}
+
+// Runs an export job. The body of the request contains the arguments
+// (one per line) as they would be given in the command line (e.g.
+// "--sheet", "sheet.png", "--data", "sheet.json", "sprite.ase"). Each
+// job uses its own context, so several jobs can run concurrently in
+// the webserver threads.
+void WebServer::processExportJob(webserver::IRequest* request,
+                                 webserver::IResponse* response)
+{
+  std::ostream& os = response->getStream();
+
+  std::string body;
+  if (!request->getBody(body)) {
+    response->setStatusCode(413);
+    os << "{\"status\":\"error\","
+       << "\"error\":\"Too many arguments\"}";
+    return;
+  }
+
+  std::vector<std::string> args;
+  base::split_string(body, args, "\n");
+  for (auto& arg : args) {
+    if (!arg.empty() && arg[arg.size()-1] == '\r')
+      arg.erase(arg.size()-1);
+  }
+  args.erase(std::remove(args.begin(), args.end(), std::string()), args.end());
+
+  std::vector<const char*> argv;
+  argv.push_back(PACKAGE);
+  for (const auto& arg : args)
+    argv.push_back(arg.c_str());
+
+  AppOptions options(int(argv.size()), &argv[0]);
+  if (options.hasErrors()) {
+    response->setStatusCode(400);
+    os << "{\"status\":\"error\","
+       << "\"error\":\"Invalid arguments\"}";
+    return;
+  }
+
+  int files = 0;
+  for (const auto& value : options.values()) {
+    if (!value.option())
+      ++files;
+  }
+
+  base::Chrono chrono;
+  BatchContext ctx;
+  std::stringstream data;
+  base::UniquePtr<DocumentExporter> exporter;
+  if (options.hasExporterParams()) {
+    exporter.reset(new DocumentExporter(&ctx));
+    exporter->setDataStream(&data);
+  }
+
+  std::string error;
+  try {
+    App::instance()->processOptions(options, &ctx, exporter.get());
+  }
+  catch (const std::exception& ex) {
+    error = ex.what();
+  }
+
+  int documents = int(ctx.documents().size());
+
+  if (error.empty() && documents < files)
+    error = "Some files couldn't be loaded";
+
+  response->setStatusCode(error.empty() ? 200: 500);
+  os << "{\"status\":\"" << (error.empty() ? "ok": "error") << "\",";
+  if (!error.empty())
+    os << "\"error\":" << json_string(error) << ",";
+  os << "\"documents\":" << documents << ","
+     << "\"time\":" << chrono.elapsed();
+
+  // Files of the sprite sheet (one for each page)
+  if (exporter && !exporter->textureFilenames().empty()) {
+    os << ",\"sheet\":[";
+    bool first = true;
+    for (const auto& fn : exporter->textureFilenames()) {
+      if (!first)
+        os << ",";
+      os << json_string(fn);
+      first = false;
+    }
+    os << "]";
+  }
+
+  // Metadata of the sprite sheet (when there is no --data file)
+  std::string dataStr = data.str();
+  if (!dataStr.empty())
+    os << ",\"data\":" << dataStr;
+
+  os << "}";
+}
+
 }
 
 #endif // ENABLE_WEBSERVER
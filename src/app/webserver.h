@@ -13,6 +13,10 @@
 
 #include "webserver/webserver.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
 namespace app {
 
   class WebServer : public webserver::IDelegate {
@@ -22,13 +26,36 @@ namespace app {
 
     void start();
 
+    // Accepts export jobs (POST /export) and the request to stop the
+    // server (POST /shutdown). It's used in server mode (--server),
+    // where the program waits in waitUntilStopped().
+    void enableExportJobs(bool state) { m_exportJobs = state; }
+    void waitUntilStopped();
+    std::string url() const;
+
+    // Random token generated for this run. Export jobs and shutdown
+    // requests must include it in the X-Aseprite-Token header (web
+    // pages cannot send custom headers to the local server without
+    // a CORS preflight, which the server doesn't accept).
+    const std::string& token() const { return m_token; }
+
     // webserver::IDelegate implementation
     virtual void onProcessRequest(webserver::IRequest* request,
                                   webserver::IResponse* response) override;
 
   private:
+    bool checkJobRequest(webserver::IRequest* request,
+                         webserver::IResponse* response);
+    void processExportJob(webserver::IRequest* request,
+                          webserver::IResponse* response);
+
     webserver::WebServer* m_webServer;
     std::string m_wwwpath;
+    std::string m_token;
+    bool m_exportJobs;
+    bool m_stopped;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCond;
   };
 
 } // namespace app
@@ -0,0 +1,224 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/rw_lock.h"
+
+#include "base/debug.h"
+
+namespace base {
+
+static double seconds(std::chrono::steady_clock::duration d)
+{
+  return std::chrono::duration<double>(d).count();
+}
+
+rw_lock::stats::stats()
+  : read_locks(0)
+  , write_locks(0)
+  , contentions(0)
+  , failures(0)
+  , wait_time(0.0)
+  , read_time(0.0)
+  , write_time(0.0)
+{
+}
+
+rw_lock::rw_lock()
+  : m_write_lock(false)
+  , m_read_locks(0)
+  , m_waiting_writers(0)
+{
+}
+
+rw_lock::~rw_lock()
+{
+  ASSERT(!m_write_lock);
+  ASSERT(m_read_locks == 0);
+}
+
+bool rw_lock::lock(lock_type type, int timeout)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  switch (type) {
+
+    case ReadLock:
+      if (!wait(lock, timeout, [this]{ return can_read(); }))
+        return false;
+      add_reader();
+      ++m_stats.read_locks;
+      return true;
+
+    case WriteLock: {
+      ++m_waiting_writers;
+      bool res = wait(lock, timeout, [this]{
+          return (!m_write_lock && m_read_locks == 0);
+        });
+      --m_waiting_writers;
+
+      if (!res) {
+        // Readers that were waiting this writer can continue
+        m_cv.notify_all();
+        return false;
+      }
+      start_writing();
+      ++m_stats.write_locks;
+      return true;
+    }
+
+  }
+  return false;
+}
+
+bool rw_lock::upgrade_to_write(int timeout)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  ASSERT(m_read_locks > 0);
+
+  ++m_waiting_writers;
+  bool res = wait(lock, timeout, [this]{
+      return (!m_write_lock && m_read_locks == 1);
+    });
+  --m_waiting_writers;
+
+  if (!res) {
+    m_cv.notify_all();
+    return false;
+  }
+  remove_reader();
+  start_writing();
+  ++m_stats.write_locks;
+  return true;
+}
+
+void rw_lock::downgrade_to_read()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  ASSERT(m_write_lock);
+  ASSERT(m_read_locks == 0);
+
+  stop_writing();
+  add_reader();
+  lock.unlock();
+
+  // Other readers can enter now
+  m_cv.notify_all();
+}
+
+void rw_lock::unlock()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (m_write_lock)
+    stop_writing();
+  else if (m_read_locks > 0)
+    remove_reader();
+  else {
+    ASSERT(false);
+    return;
+  }
+  lock.unlock();
+
+  m_cv.notify_all();
+}
+
+rw_lock::stats rw_lock::get_stats() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  stats result = m_stats;
+
+  // Add the time of the current locks
+  clock::time_point now = clock::now();
+  if (m_read_locks > 0)
+    result.read_time += seconds(now - m_read_start);
+  if (m_write_lock)
+    result.write_time += seconds(now - m_write_start);
+  return result;
+}
+
+void rw_lock::reset_stats()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_stats = stats();
+
+  clock::time_point now = clock::now();
+  m_read_start = now;
+  m_write_start = now;
+}
+
+template<typename Pred>
+bool rw_lock::wait(std::unique_lock<std::mutex>& lock, int timeout, Pred pred)
+{
+  if (pred())
+    return true;
+
+  if (timeout > 0) {
+    ++m_stats.contentions;
+
+    clock::time_point start = clock::now();
+    bool res = m_cv.wait_until(lock, start + std::chrono::milliseconds(timeout), pred);
+    m_stats.wait_time += seconds(clock::now() - start);
+    if (res)
+      return true;
+  }
+
+  ++m_stats.failures;
+  return false;
+}
+
+bool rw_lock::can_read() const
+{
+  if (m_write_lock)
+    return false;
+
+  // Threads with read locks can lock again even if there are
+  // writers waiting.
+  return (m_waiting_writers == 0 ||
+          m_readers.find(std::this_thread::get_id()) != m_readers.end());
+}
+
+void rw_lock::add_reader()
+{
+  if (m_read_locks++ == 0)
+    m_read_start = clock::now();
+
+  ++m_readers[std::this_thread::get_id()];
+}
+
+void rw_lock::remove_reader()
+{
+  ASSERT(m_read_locks > 0);
+  if (--m_read_locks == 0) {
+    m_stats.read_time += seconds(clock::now() - m_read_start);
+    m_readers.clear();
+    return;
+  }
+
+  // The lock could be released from other thread
+  auto it = m_readers.find(std::this_thread::get_id());
+  if (it != m_readers.end() && --it->second == 0)
+    m_readers.erase(it);
+}
+
+void rw_lock::start_writing()
+{
+  ASSERT(!m_write_lock);
+  m_write_lock = true;
+  m_write_start = clock::now();
+}
+
+void rw_lock::stop_writing()
+{
+  ASSERT(m_write_lock);
+  m_write_lock = false;
+  m_stats.write_time += seconds(clock::now() - m_write_start);
+}
+
+} // namespace base
@@ -0,0 +1,95 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_RW_LOCK_H_INCLUDED
+#define BASE_RW_LOCK_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace base {
+
+  // A readers/writer lock where threads wait blocked until the lock
+  // is released (or the timeout expires). Writers have preference:
+  // new readers wait while there is a writer waiting for the lock
+  // (except threads that already have a read lock, so nested read
+  // locks don't produce deadlocks).
+  //
+  // All timeouts are in milliseconds, a timeout of 0 means that the
+  // function returns immediately if the lock cannot be acquired.
+  class rw_lock {
+  public:
+    enum lock_type {
+      ReadLock,
+      WriteLock
+    };
+
+    // Counters to profile the contention of the lock.
+    struct stats {
+      int read_locks;             // Acquired read locks
+      int write_locks;            // Acquired write locks (including upgrades)
+      int contentions;            // Times that a thread had to wait the lock
+      int failures;               // Locks that couldn't be acquired
+      double wait_time;           // Seconds waiting to acquire the lock
+      double read_time;           // Seconds with one or more readers
+      double write_time;          // Seconds with a writer
+      stats();
+    };
+
+    rw_lock();
+    ~rw_lock();
+
+    bool lock(lock_type type, int timeout);
+
+    // Raises the access level from read to write. It's only possible
+    // when the caller is the only reader.
+    bool upgrade_to_write(int timeout);
+
+    // Reduces the access level from write to read.
+    void downgrade_to_read();
+
+    void unlock();
+
+    stats get_stats() const;
+    void reset_stats();
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    template<typename Pred>
+    bool wait(std::unique_lock<std::mutex>& lock, int timeout, Pred pred);
+
+    bool can_read() const;
+    void add_reader();
+    void remove_reader();
+    void start_writing();
+    void stop_writing();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_write_lock;
+    int m_read_locks;
+    int m_waiting_writers;
+
+    // Number of read locks of each thread.
+    std::map<std::thread::id, int> m_readers;
+
+    stats m_stats;
+    clock::time_point m_read_start;
+    clock::time_point m_write_start;
+
+    DISABLE_COPYING(rw_lock);
+  };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,162 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/rw_lock.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace base;
+
+TEST(RWLock, MultipleReaders)
+{
+  rw_lock a;
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  EXPECT_FALSE(a.lock(rw_lock::WriteLock, 0));
+  a.unlock();
+  EXPECT_FALSE(a.lock(rw_lock::WriteLock, 0));
+  a.unlock();
+  EXPECT_TRUE(a.lock(rw_lock::WriteLock, 0));
+  EXPECT_FALSE(a.lock(rw_lock::ReadLock, 0));
+  EXPECT_FALSE(a.lock(rw_lock::WriteLock, 0));
+  a.unlock();
+
+  rw_lock::stats s = a.get_stats();
+  EXPECT_EQ(2, s.read_locks);
+  EXPECT_EQ(1, s.write_locks);
+  EXPECT_EQ(4, s.failures);
+  EXPECT_EQ(0, s.contentions);
+}
+
+TEST(RWLock, UpgradeAndDowngrade)
+{
+  rw_lock a;
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  EXPECT_FALSE(a.upgrade_to_write(0)); // Two readers
+  a.unlock();
+  EXPECT_TRUE(a.upgrade_to_write(0));
+  EXPECT_FALSE(a.lock(rw_lock::ReadLock, 0));
+  a.downgrade_to_read();
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  a.unlock();
+  a.unlock();
+  EXPECT_TRUE(a.lock(rw_lock::WriteLock, 0));
+  a.unlock();
+}
+
+TEST(RWLock, WriterWaitsReaders)
+{
+  rw_lock a;
+  std::atomic<bool> locked(false);
+
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  std::thread writer([&]{
+      EXPECT_TRUE(a.lock(rw_lock::WriteLock, 10000));
+      locked = true;
+      a.unlock();
+    });
+
+  // Wait the writer to be waiting the lock
+  while (a.get_stats().contentions == 0)
+    std::this_thread::yield();
+
+  EXPECT_FALSE(locked);
+  a.unlock();                   // Wakes up the writer
+  writer.join();
+  EXPECT_TRUE(locked);
+
+  rw_lock::stats s = a.get_stats();
+  EXPECT_EQ(1, s.contentions);
+  EXPECT_EQ(0, s.failures);
+  EXPECT_LT(0.0, s.wait_time);
+}
+
+TEST(RWLock, WriterPreference)
+{
+  rw_lock a;
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+
+  std::thread writer([&]{
+      EXPECT_TRUE(a.lock(rw_lock::WriteLock, 10000));
+      a.unlock();
+    });
+
+  while (a.get_stats().contentions == 0)
+    std::this_thread::yield();
+
+  // Other threads cannot read while the writer is waiting, but the
+  // thread that already has the read lock can lock it again.
+  std::thread reader([&]{
+      EXPECT_FALSE(a.lock(rw_lock::ReadLock, 0));
+    });
+  reader.join();
+  EXPECT_TRUE(a.lock(rw_lock::ReadLock, 0));
+  a.unlock();
+
+  a.unlock();
+  writer.join();
+}
+
+TEST(RWLock, Timeout)
+{
+  rw_lock a;
+  EXPECT_TRUE(a.lock(rw_lock::WriteLock, 0));
+
+  std::thread reader([&]{
+      EXPECT_FALSE(a.lock(rw_lock::ReadLock, 20));
+    });
+  reader.join();
+  a.unlock();
+
+  rw_lock::stats s = a.get_stats();
+  EXPECT_EQ(1, s.contentions);
+  EXPECT_EQ(1, s.failures);
+  EXPECT_LE(0.015, s.wait_time);
+}
+
+TEST(RWLock, Counter)
+{
+  rw_lock a;
+  int value = 0;
+  std::atomic<int> reads(0);
+
+  std::vector<std::thread> threads;
+  for (int i=0; i<4; ++i) {
+    threads.push_back(std::thread([&]{
+          for (int j=0; j<1000; ++j) {
+            if (j % 4 == 0) {
+              ASSERT_TRUE(a.lock(rw_lock::WriteLock, 10000));
+              ++value;
+              a.unlock();
+            }
+            else {
+              ASSERT_TRUE(a.lock(rw_lock::ReadLock, 10000));
+              ASSERT_LE(0, value);
+              ++reads;
+              a.unlock();
+            }
+          }
+        }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(4*250, value);
+  EXPECT_EQ(4*750, reads);
+  EXPECT_EQ(4*250, a.get_stats().write_locks);
+  EXPECT_EQ(4*750, a.get_stats().read_locks);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
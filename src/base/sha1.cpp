@@ -11,8 +11,9 @@
 #include "base/sha1.h"
 #include "base/sha1_rfc3174.h"
 
-#include <fstream>
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 
 namespace base {
 
@@ -53,6 +54,30 @@ Sha1 Sha1::calculateFromFile(const std::string& fileName)
   return Sha1(digest);
 }
 
+Sha1 Sha1::calculateFromString(const std::string& text)
+{
+  SHA1Context sha;
+  SHA1Reset(&sha);
+  if (!text.empty())
+    SHA1Input(&sha, (const uint8_t*)text.c_str(), (unsigned int)text.size());
+
+  std::vector<uint8_t> digest(HashSize);
+  SHA1Result(&sha, &digest[0]);
+
+  return Sha1(digest);
+}
+
+std::string Sha1::toString() const
+{
+  std::string result;
+  char buf[3];
+  for (int i=0; i<HashSize; ++i) {
+    std::sprintf(buf, "%02x", m_digest[i]);
+    result += buf;
+  }
+  return result;
+}
+
 bool Sha1::operator==(const Sha1& other) const
 {
   return m_digest == other.m_digest;
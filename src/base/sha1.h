@@ -25,6 +25,12 @@ namespace base {
     // Calculates the SHA1 of the given file.
     static Sha1 calculateFromFile(const std::string& fileName);
 
+    // Calculates the SHA1 of the given text.
+    static Sha1 calculateFromString(const std::string& text);
+
+    // Returns the digest as a string of hexadecimal digits.
+    std::string toString() const;
+
     bool operator==(const Sha1& other) const;
     bool operator!=(const Sha1& other) const;
 
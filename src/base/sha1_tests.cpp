@@ -0,0 +1,54 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/sha1.h"
+
+#include <string>
+
+using namespace base;
+
+TEST(Sha1, CalculateFromString)
+{
+  // Test vectors from RFC 3174 and FIPS 180-2
+  EXPECT_EQ("da39a3ee5e6b4b0d3255bfef95601890afd80709",
+            Sha1::calculateFromString("").toString());
+  EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d",
+            Sha1::calculateFromString("abc").toString());
+  EXPECT_EQ("84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+            Sha1::calculateFromString(
+              "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq").toString());
+  EXPECT_EQ("34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+            Sha1::calculateFromString(std::string(1000000, 'a')).toString());
+}
+
+TEST(Sha1, ToString)
+{
+  EXPECT_EQ("0000000000000000000000000000000000000000", Sha1().toString());
+
+  std::vector<uint8_t> digest(Sha1::HashSize);
+  for (int i=0; i<Sha1::HashSize; ++i)
+    digest[i] = uint8_t(i*13);
+  EXPECT_EQ("000d1a2734414e5b6875828f9ca9b6c3d0ddeaf7", Sha1(digest).toString());
+}
+
+TEST(Sha1, Compare)
+{
+  Sha1 a = Sha1::calculateFromString("abc");
+  Sha1 b = Sha1::calculateFromString("abc");
+  Sha1 c = Sha1::calculateFromString("abd");
+  EXPECT_TRUE(a == b);
+  EXPECT_FALSE(a != b);
+  EXPECT_TRUE(a != c);
+  EXPECT_FALSE(a == c);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
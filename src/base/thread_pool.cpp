@@ -0,0 +1,83 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+
+namespace base {
+
+thread_pool::thread_pool(int threads)
+  : m_running(true)
+  , m_pending(0)
+{
+  if (threads < 1)
+    threads = 1;
+
+  for (int i=0; i<threads; ++i)
+    m_threads.push_back(std::thread([this]{ worker(); }));
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cv.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+void thread_pool::execute(const task& func)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks.push(func);
+    ++m_pending;
+  }
+  m_cv.notify_one();
+}
+
+void thread_pool::wait_all()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cvDone.wait(lock, [this]{ return m_pending == 0; });
+}
+
+// static
+int thread_pool::hardware_threads()
+{
+  int n = int(std::thread::hardware_concurrency());
+  return (n > 0 ? n: 1);
+}
+
+void thread_pool::worker()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cv.wait(lock, [this]{ return !m_running || !m_tasks.empty(); });
+
+    // Pending tasks are executed before the pool is destroyed
+    if (m_tasks.empty())
+      break;
+
+    task func = m_tasks.front();
+    m_tasks.pop();
+
+    lock.unlock();
+    func();
+    lock.lock();
+
+    if (--m_pending == 0)
+      m_cvDone.notify_all();
+  }
+}
+
+} // namespace base
@@ -0,0 +1,60 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_THREAD_POOL_H_INCLUDED
+#define BASE_THREAD_POOL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+  // A fixed number of worker threads that execute the given tasks in
+  // FIFO order.
+  class thread_pool {
+  public:
+    typedef std::function<void()> task;
+
+    explicit thread_pool(int threads);
+    ~thread_pool();
+
+    int size() const { return int(m_threads.size()); }
+
+    // Adds a new task to the queue. It will be executed by the first
+    // free worker thread.
+    void execute(const task& func);
+
+    // Waits until all queued tasks were executed.
+    void wait_all();
+
+    // Returns the number of threads that can run concurrently in this
+    // machine (at least 1).
+    static int hardware_threads();
+
+  private:
+    void worker();
+
+    bool m_running;
+    int m_pending;                // Queued + running tasks
+    std::vector<std::thread> m_threads;
+    std::queue<task> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_cvDone;
+
+    DISABLE_COPYING(thread_pool);
+  };
+
+} // namespace base
+
+#endif
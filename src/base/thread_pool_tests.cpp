@@ -0,0 +1,57 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/thread_pool.h"
+
+#include <atomic>
+
+using namespace base;
+
+TEST(ThreadPool, Size)
+{
+  thread_pool a(4);
+  EXPECT_EQ(4, a.size());
+
+  thread_pool b(0);
+  EXPECT_EQ(1, b.size());
+
+  EXPECT_LE(1, thread_pool::hardware_threads());
+}
+
+TEST(ThreadPool, ExecuteAll)
+{
+  std::atomic<int> count(0);
+  thread_pool pool(3);
+
+  for (int i=0; i<1000; ++i)
+    pool.execute([&count]{ ++count; });
+
+  pool.wait_all();
+  EXPECT_EQ(1000, count);
+
+  pool.execute([&count]{ count += 10; });
+  pool.wait_all();
+  EXPECT_EQ(1010, count);
+}
+
+TEST(ThreadPool, DestructorRunsPendingTasks)
+{
+  std::atomic<int> count(0);
+  {
+    thread_pool pool(2);
+    for (int i=0; i<100; ++i)
+      pool.execute([&count]{ ++count; });
+  }
+  EXPECT_EQ(100, count);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
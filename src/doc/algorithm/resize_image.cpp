@@ -11,129 +11,306 @@
 #include "doc/algorithm/resize_image.h"
 
 #include "gfx/point.h"
+#include "doc/blend_simd.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
 #include "doc/palette.h"
+#include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 
+#include <cmath>
+#include <vector>
+
+#ifdef DOC_HAVE_BLEND_SIMD
+  #include <emmintrin.h>
+
+  #if defined(__GNUC__)
+    #define TARGET_SSE2 __attribute__((target("sse2")))
+  #else
+    #define TARGET_SSE2
+  #endif
+#endif
+
 namespace doc {
 namespace algorithm {
 
-void resize_image(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
+namespace {
+
+// Source column of each destination column (or row) for the nearest
+// neighbor method. It uses the same floating point formula of the
+// original per-pixel implementation so the result is the same.
+void nearest_map(int srcSize, int dstSize, std::vector<int>& map)
 {
-  switch (method) {
+  double ratio = srcSize / (double)dstSize;
+  map.resize(dstSize);
+  for (int i=0; i<dstSize; ++i) {
+    map[i] = (int)floor(i * ratio);
+    ASSERT(map[i] >= 0 && map[i] < srcSize);
+  }
+}
+
+template<typename ImageTraits>
+void resize_nearest(const Image* src, Image* dst, int y1, int y2,
+                    const std::vector<int>& xmap,
+                    const std::vector<int>& ymap)
+{
+  typedef typename ImageTraits::const_address_t const_address_t;
+  typedef typename ImageTraits::address_t address_t;
+  const int w = dst->width();
+  const int* xs = &xmap[0];
+
+  for (int y=y1; y<y2; ++y) {
+    const_address_t srcRow = (const_address_t)src->getPixelAddress(0, ymap[y]);
+    address_t dstRow = (address_t)dst->getPixelAddress(0, y);
+    for (int x=0; x<w; ++x)
+      dstRow[x] = srcRow[xs[x]];
+  }
+}
+
+template<>
+void resize_nearest<BitmapTraits>(const Image* src, Image* dst, int y1, int y2,
+                                  const std::vector<int>& xmap,
+                                  const std::vector<int>& ymap)
+{
+  const int w = dst->width();
+  for (int y=y1; y<y2; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel_fast<BitmapTraits>(
+        dst, x, y, get_pixel_fast<BitmapTraits>(src, xmap[x], ymap[y]));
+}
+
+// Bilinear sample position in fixed point: the pixels "a" and "b"
+// (b = a+1 or a on the last pixel), and the weight of "b" rounded to
+// 7 bits of precision (0-128).
+struct Sample {
+  int a, b;
+  int f;
+};
+
+void bilinear_map(int srcSize, int dstSize, std::vector<Sample>& map)
+{
+  map.resize(dstSize);
+  for (int i=0; i<dstSize; ++i) {
+    // 16.16 position of the sample (the first and last destination
+    // pixels match the first and last source pixels)
+    int64_t pos = 0;
+    if (dstSize > 1)
+      pos = int64_t(i) * (srcSize-1) * 65536 / (dstSize-1);
+
+    Sample& s = map[i];
+    s.a = MIN(int(pos >> 16), srcSize-1);
+    s.b = MIN(s.a+1, srcSize-1);
+    s.f = (s.b == s.a ? 0: int(((pos & 0xffff) + 256) >> 9));
+  }
+}
+
+// Interpolates one 8-bit channel of four pixels:
+//   (c00*(128-fu) + c01*fu)*(128-fv) + (c10*(128-fu) + c11*fu)*fv
+// The vertical interpolation is done first to match the SSE2 version.
+inline int bilinear_channel(int c00, int c01, int c10, int c11, int fu, int fv)
+{
+  int t0 = c00*(128-fv) + c10*fv;
+  int t1 = c01*(128-fv) + c11*fv;
+  return (t0*(128-fu) + t1*fu) >> 14;
+}
+
+void rgba_bilinear_row(uint32_t* dst, const uint32_t* row0, const uint32_t* row1,
+                       int fv, const Sample* xs, int w)
+{
+  for (int x=0; x<w; ++x) {
+    const Sample& s = xs[x];
+    color_t c00 = row0[s.a], c01 = row0[s.b];
+    color_t c10 = row1[s.a], c11 = row1[s.b];
+    dst[x] = rgba(
+      bilinear_channel(rgba_getr(c00), rgba_getr(c01), rgba_getr(c10), rgba_getr(c11), s.f, fv),
+      bilinear_channel(rgba_getg(c00), rgba_getg(c01), rgba_getg(c10), rgba_getg(c11), s.f, fv),
+      bilinear_channel(rgba_getb(c00), rgba_getb(c01), rgba_getb(c10), rgba_getb(c11), s.f, fv),
+      bilinear_channel(rgba_geta(c00), rgba_geta(c01), rgba_geta(c10), rgba_geta(c11), s.f, fv));
+  }
+}
+
+#ifdef DOC_HAVE_BLEND_SIMD
+
+// Same as rgba_bilinear_row() with the four channels of each pixel
+// in 16-bit lanes. The vertical step (t0/t1) fits in 16 bits
+// (255*128), and madd_epi16 does the horizontal step in 32 bits.
+TARGET_SSE2
+void rgba_bilinear_row_sse2(uint32_t* dst, const uint32_t* row0, const uint32_t* row1,
+                            int fv, const Sample* xs, int w)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wv0 = _mm_set1_epi16(short(128-fv));
+  const __m128i wv1 = _mm_set1_epi16(short(fv));
+
+  for (int x=0; x<w; ++x) {
+    const Sample& s = xs[x];
+
+    // c00/c01 and c10/c11 pixels in the low/high 64-bits
+    __m128i top = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(int(row0[s.a])),
+                         _mm_cvtsi32_si128(int(row0[s.b]))), zero);
+    __m128i bot = _mm_unpacklo_epi8(
+      _mm_unpacklo_epi32(_mm_cvtsi32_si128(int(row1[s.a])),
+                         _mm_cvtsi32_si128(int(row1[s.b]))), zero);
+
+    // t0 (4 channels) in the low 64-bits, t1 in the high 64-bits
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(top, wv0),
+                              _mm_mullo_epi16(bot, wv1));
+
+    // Interleave t0/t1 of each channel and multiply them by the
+    // horizontal weights (128-fu, fu)
+    __m128i tt = _mm_unpacklo_epi16(t, _mm_srli_si128(t, 8));
+    __m128i wu = _mm_set1_epi32(((s.f & 0xffff) << 16) | (128-s.f));
+    __m128i c = _mm_srli_epi32(_mm_madd_epi16(tt, wu), 14);
+
+    c = _mm_packs_epi32(c, c);
+    c = _mm_packus_epi16(c, c);
+    dst[x] = uint32_t(_mm_cvtsi128_si32(c));
+  }
+}
+
+#endif
+
+typedef void (*RGBA_BILINEAR_ROW)(uint32_t*, const uint32_t*, const uint32_t*,
+                                  int, const Sample*, int);
+
+RGBA_BILINEAR_ROW get_rgba_bilinear_row()
+{
+#ifdef DOC_HAVE_BLEND_SIMD
+  static RGBA_BILINEAR_ROW func =
+    (cpu_has_sse2() ? rgba_bilinear_row_sse2: rgba_bilinear_row);
+  return func;
+#else
+  return rgba_bilinear_row;
+#endif
+}
+
+void resize_bilinear(const Image* src, Image* dst, int y1, int y2,
+                     const Palette* pal, const RgbMap* rgbmap)
+{
+  const int w = dst->width();
+  std::vector<Sample> xmap, ymap;
+  bilinear_map(src->width(), w, xmap);
+  bilinear_map(src->height(), dst->height(), ymap);
+
+  switch (dst->pixelFormat()) {
 
-    // TODO optimize this
-    case RESIZE_METHOD_NEAREST_NEIGHBOR:
-    {
-      int o_width = src->width(), o_height = src->height();
-      int n_width = dst->width(), n_height = dst->height();
-      double x_ratio = o_width / (double)n_width;
-      double y_ratio = o_height / (double)n_height;
-      double px, py;
-      int i;
-
-      for (int y = 0; y < n_height; y++) {
-        for (int x = 0; x < n_width; x++) {
-          px = floor(x * x_ratio);
-          py = floor(y * y_ratio);
-          i = (int)(py * o_width + px);
-          dst->putPixel(x, y, src->getPixel(i % o_width, i / o_width));
+    case IMAGE_RGB: {
+      RGBA_BILINEAR_ROW row_func = get_rgba_bilinear_row();
+      for (int y=y1; y<y2; ++y) {
+        const Sample& s = ymap[y];
+        row_func((uint32_t*)dst->getPixelAddress(0, y),
+                 (const uint32_t*)src->getPixelAddress(0, s.a),
+                 (const uint32_t*)src->getPixelAddress(0, s.b),
+                 s.f, &xmap[0], w);
+      }
+      break;
+    }
+
+    case IMAGE_GRAYSCALE: {
+      for (int y=y1; y<y2; ++y) {
+        const Sample& sy = ymap[y];
+        const uint16_t* row0 = (const uint16_t*)src->getPixelAddress(0, sy.a);
+        const uint16_t* row1 = (const uint16_t*)src->getPixelAddress(0, sy.b);
+        uint16_t* dstRow = (uint16_t*)dst->getPixelAddress(0, y);
+
+        for (int x=0; x<w; ++x) {
+          const Sample& s = xmap[x];
+          color_t c00 = row0[s.a], c01 = row0[s.b];
+          color_t c10 = row1[s.a], c11 = row1[s.b];
+          dstRow[x] = graya(
+            bilinear_channel(graya_getv(c00), graya_getv(c01), graya_getv(c10), graya_getv(c11), s.f, sy.f),
+            bilinear_channel(graya_geta(c00), graya_geta(c01), graya_geta(c10), graya_geta(c11), s.f, sy.f));
         }
       }
       break;
     }
 
-    // TODO optimize this
-    case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
-
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)floor(u);
-          v_floor = (int)floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              int r = int((rgba_getr(pal->getEntry(color[0]))*u2 + rgba_getr(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getr(pal->getEntry(color[2]))*u2 + rgba_getr(pal->getEntry(color[3]))*u1)*v1);
-              int g = int((rgba_getg(pal->getEntry(color[0]))*u2 + rgba_getg(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getg(pal->getEntry(color[2]))*u2 + rgba_getg(pal->getEntry(color[3]))*u1)*v1);
-              int b = int((rgba_getb(pal->getEntry(color[0]))*u2 + rgba_getb(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getb(pal->getEntry(color[2]))*u2 + rgba_getb(pal->getEntry(color[3]))*u1)*v1);
-              int a = int(((color[0] == 0 ? 0: 255)*u2 + (color[1] == 0 ? 0: 255)*u1)*v2 +
-                          ((color[2] == 0 ? 0: 255)*u2 + (color[3] == 0 ? 0: 255)*u1)*v1);
-              dst_color = a > 127 ? rgbmap->mapColor(r, g, b): 0;
-              break;
-            }
-          }
+    // Indexed images are interpolated in RGBA (the entry 0 is the
+    // transparent color), and then each pixel is mapped again to the
+    // palette.
+    case IMAGE_INDEXED: {
+      uint32_t entries[256];
+      for (int i=0; i<256; ++i) {
+        color_t c = (i < pal->size() ? pal->getEntry(i): 0);
+        entries[i] = rgba(rgba_getr(c), rgba_getg(c), rgba_getb(c), i == 0 ? 0: 255);
+      }
+
+      RGBA_BILINEAR_ROW row_func = get_rgba_bilinear_row();
+      std::vector<uint32_t> row0(src->width()), row1(src->width()), dstRgba(w);
 
-          dst->putPixel(x, y, dst_color);
-          u += du;
+      for (int y=y1; y<y2; ++y) {
+        const Sample& s = ymap[y];
+        const uint8_t* src0 = (const uint8_t*)src->getPixelAddress(0, s.a);
+        const uint8_t* src1 = (const uint8_t*)src->getPixelAddress(0, s.b);
+        for (int x=0; x<src->width(); ++x) {
+          row0[x] = entries[src0[x]];
+          row1[x] = entries[src1[x]];
+        }
+
+        row_func(&dstRgba[0], &row0[0], &row1[0], s.f, &xmap[0], w);
+
+        uint8_t* dstRow = (uint8_t*)dst->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x) {
+          color_t c = dstRgba[x];
+          dstRow[x] = (rgba_geta(c) > 127 ?
+                       rgbmap->mapColor(rgba_getr(c), rgba_getg(c), rgba_getb(c)): 0);
         }
-        u = 0.0;
-        v += dv;
       }
       break;
     }
 
+    // Bitmaps are interpolated as 0/255 values
+    case IMAGE_BITMAP: {
+      for (int y=y1; y<y2; ++y) {
+        const Sample& sy = ymap[y];
+        for (int x=0; x<w; ++x) {
+          const Sample& s = xmap[x];
+          int v = bilinear_channel(
+            get_pixel_fast<BitmapTraits>(src, s.a, sy.a) ? 255: 0,
+            get_pixel_fast<BitmapTraits>(src, s.b, sy.a) ? 255: 0,
+            get_pixel_fast<BitmapTraits>(src, s.a, sy.b) ? 255: 0,
+            get_pixel_fast<BitmapTraits>(src, s.b, sy.b) ? 255: 0,
+            s.f, sy.f);
+          put_pixel_fast<BitmapTraits>(dst, x, y, v > 127 ? 1: 0);
+        }
+      }
+      break;
+    }
+  }
+}
+
+} // anonymous namespace
+
+void resize_image(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
+{
+  resize_image_rows(src, dst, 0, dst->height(), method, pal, rgbmap);
+}
+
+void resize_image_rows(const Image* src, Image* dst, int y, int h, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
+{
+  ASSERT(src->pixelFormat() == dst->pixelFormat());
+  ASSERT(y >= 0 && y+h <= dst->height());
+
+  switch (method) {
+
+    case RESIZE_METHOD_NEAREST_NEIGHBOR: {
+      std::vector<int> xmap, ymap;
+      nearest_map(src->width(), dst->width(), xmap);
+      nearest_map(src->height(), dst->height(), ymap);
+
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:       resize_nearest<RgbTraits>(src, dst, y, y+h, xmap, ymap); break;
+        case IMAGE_GRAYSCALE: resize_nearest<GrayscaleTraits>(src, dst, y, y+h, xmap, ymap); break;
+        case IMAGE_INDEXED:   resize_nearest<IndexedTraits>(src, dst, y, y+h, xmap, ymap); break;
+        case IMAGE_BITMAP:    resize_nearest<BitmapTraits>(src, dst, y, y+h, xmap, ymap); break;
+      }
+      break;
+    }
+
+    case RESIZE_METHOD_BILINEAR:
+      resize_bilinear(src, dst, y, y+h, pal, rgbmap);
+      break;
   }
 }
 
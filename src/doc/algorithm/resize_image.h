@@ -29,6 +29,11 @@ namespace doc {
     // over the source image 'src' BEFORE using this routine.
     void resize_image(const Image* src, Image* dst, ResizeMethod method, const Palette* palette, const RgbMap* rgbmap);
 
+    // Resizes only the rows [y, y+h) of the destination image. It can
+    // be used to resize different parts of the same image from
+    // several threads.
+    void resize_image_rows(const Image* src, Image* dst, int y, int h, ResizeMethod method, const Palette* palette, const RgbMap* rgbmap);
+
     // It does not modify the image to the human eye, but internally
     // tries to fixup all colors that are completelly transparent
     // (alpha = 0) with the average of its 4-neighbors.  Useful if you
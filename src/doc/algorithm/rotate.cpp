@@ -17,7 +17,10 @@
 #include "doc/image_bits.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "gfx/point.h"
+#include "gfx/rect.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace doc {
@@ -255,6 +258,63 @@ public:
   }
 };
 
+// Delegate to get the sprite coordinates of some pixels (one pixel
+// of each step*step block of the given area) instead of drawing them.
+class SamplesDelegate {
+public:
+  SamplesDelegate(int step, const gfx::Rect& area,
+                  std::vector<gfx::Point>* samples)
+    : m_step(step), m_area(area), m_samples(samples) {
+  }
+
+  int step() const { return m_step; }
+  const gfx::Rect& area() const { return m_area; }
+
+  void setSample(int u, int v, int spr_x, int spr_y) {
+    (*m_samples)[(v-m_area.y)*m_area.w + (u-m_area.x)] =
+      gfx::Point(spr_x, spr_y);
+  }
+
+private:
+  int m_step;
+  gfx::Rect m_area;
+  std::vector<gfx::Point>* m_samples;
+};
+
+// Only pixels that are multiple of the step (and are inside the
+// delegate area) are visited. The sprite position is the same as the
+// one accumulated for each pixel in the generic draw_scanline().
+template<class Traits>
+static void draw_scanline(Image *bmp, Image *spr,
+  fixed l_bmp_x, int bmp_y_i,
+  fixed r_bmp_x,
+  fixed l_spr_x, fixed l_spr_y,
+  fixed spr_dx, fixed spr_dy,
+  SamplesDelegate& delegate)
+{
+  const int step = delegate.step();
+  const gfx::Rect& area = delegate.area();
+  int v = bmp_y_i / step;
+  if ((bmp_y_i % step) != 0 || v < area.y || v >= area.y2())
+    return;
+
+  int l = (l_bmp_x >> 16);
+  int r = (r_bmp_x >> 16);
+  int u = std::max((l + step - 1) / step, area.x);
+  int u2 = std::min(r / step, area.x2()-1);
+  if (u > u2)
+    return;
+
+  l_spr_x += (u*step - l) * spr_dx;
+  l_spr_y += (u*step - l) * spr_dy;
+
+  for (; u<=u2; ++u) {
+    delegate.setSample(u, v, l_spr_x>>16, l_spr_y>>16);
+    l_spr_x += step * spr_dx;
+    l_spr_y += step * spr_dy;
+  }
+}
+
 /* _parallelogram_map:
  *  Worker routine for drawing rotated and/or scaled and/or flipped sprites:
  *  It actually maps the sprite to any parallelogram-shaped area of the
@@ -281,7 +341,9 @@ public:
  */
 template<class Traits, class Delegate>
 static void ase_parallelogram_map(
-  Image *bmp, Image *spr, fixed xs[4], fixed ys[4],
+  Image *bmp, Image *spr,
+  int bmp_w, int bmp_h, int spr_w, int spr_h,
+  fixed xs[4], fixed ys[4],
   int sub_pixel_accuracy, Delegate delegate)
 {
   /* Index in xs[] and ys[] to topmost point. */
@@ -357,11 +419,11 @@ static void ase_parallelogram_map(
       corner_spr_y[i] = 0;
     else
       /* Need `- 1' since otherwise it would be outside sprite. */
-      corner_spr_y[i] = (spr->height() << 16) - 1;
+      corner_spr_y[i] = (spr_h << 16) - 1;
     if ((index == 0) || (index == 3))
       corner_spr_x[i] = 0;
     else
-      corner_spr_x[i] = (spr->width() << 16) - 1;
+      corner_spr_x[i] = (spr_w << 16) - 1;
     index = (index + right_index) & 3;
   }
 
@@ -387,7 +449,7 @@ static void ase_parallelogram_map(
 
   /* Calculate left and right clipping. */
   clip_left = 0;
-  clip_right = (bmp->width() << 16) - 1;
+  clip_right = (bmp_w << 16) - 1;
 
   /* Quit if we're totally outside. */
   if ((left_bmp_x > clip_right) &&
@@ -405,8 +467,8 @@ static void ase_parallelogram_map(
   else
     clip_bottom_i = (bottom_bmp_y + 0x8000) >> 16;
 
-  if (clip_bottom_i > bmp->height())
-    clip_bottom_i = bmp->height();
+  if (clip_bottom_i > bmp_h)
+    clip_bottom_i = bmp_h;
 
   /* Calculate y coordinate of first scanline. */
   if (sub_pixel_accuracy)
@@ -467,10 +529,10 @@ static void ase_parallelogram_map(
      We'd better use double to get this as exact as possible, since any
      errors will be accumulated along the scanline.
   */
-  spr_dx = (fixed)((ys[3] - ys[0]) * 65536.0 * (65536.0 * spr->width()) /
+  spr_dx = (fixed)((ys[3] - ys[0]) * 65536.0 * (65536.0 * spr_w) /
                    ((xs[1] - xs[0]) * (double)(ys[3] - ys[0]) -
                     (xs[3] - xs[0]) * (double)(ys[1] - ys[0])));
-  spr_dy = (fixed)((ys[1] - ys[0]) * 65536.0 * (65536.0 * spr->height()) /
+  spr_dy = (fixed)((ys[1] - ys[0]) * 65536.0 * (65536.0 * spr_h) /
                    ((xs[3] - xs[0]) * (double)(ys[1] - ys[0]) -
                     (xs[1] - xs[0]) * (double)(ys[3] - ys[0])));
 
@@ -577,7 +639,7 @@ static void ase_parallelogram_map(
            Drawing a sprite with that routine took about 25% longer time
            though.
         */
-        if ((unsigned)(l_spr_x_rounded >> 16) >= (unsigned)spr->width()) {
+        if ((unsigned)(l_spr_x_rounded >> 16) >= (unsigned)spr_w) {
           if (((l_spr_x_rounded < 0) && (spr_dx <= 0)) ||
               ((l_spr_x_rounded > 0) && (spr_dx >= 0))) {
             /* This can happen. */
@@ -591,14 +653,14 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(l_spr_x_rounded >> 16) >=
-                     (unsigned)spr->width());
+                     (unsigned)spr_w);
 
           }
         }
         right_edge_test = l_spr_x_rounded +
           ((r_bmp_x_rounded - l_bmp_x_rounded) >> 16) *
           spr_dx;
-        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr->width()) {
+        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr_w) {
           if (((right_edge_test < 0) && (spr_dx <= 0)) ||
               ((right_edge_test > 0) && (spr_dx >= 0))) {
             /* This can happen. */
@@ -608,14 +670,14 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(right_edge_test >> 16) >=
-                     (unsigned)spr->width());
+                     (unsigned)spr_w);
           }
           else {
             /* I don't think this can happen, but I can't prove it. */
             goto skip_draw;
           }
         }
-        if ((unsigned)(l_spr_y_rounded >> 16) >= (unsigned)spr->height()) {
+        if ((unsigned)(l_spr_y_rounded >> 16) >= (unsigned)spr_h) {
           if (((l_spr_y_rounded < 0) && (spr_dy <= 0)) ||
               ((l_spr_y_rounded > 0) && (spr_dy >= 0))) {
             /* This can happen. */
@@ -629,13 +691,13 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while (((unsigned)l_spr_y_rounded >> 16) >=
-                     (unsigned)spr->height());
+                     (unsigned)spr_h);
           }
         }
         right_edge_test = l_spr_y_rounded +
           ((r_bmp_x_rounded - l_bmp_x_rounded) >> 16) *
           spr_dy;
-        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr->height()) {
+        if ((unsigned)(right_edge_test >> 16) >= (unsigned)spr_h) {
           if (((right_edge_test < 0) && (spr_dy <= 0)) ||
               ((right_edge_test > 0) && (spr_dy >= 0))) {
             /* This can happen. */
@@ -645,7 +707,7 @@ static void ase_parallelogram_map(
               if (l_bmp_x_rounded > r_bmp_x_rounded)
                 goto skip_draw;
             } while ((unsigned)(right_edge_test >> 16) >=
-                     (unsigned)spr->height());
+                     (unsigned)spr_h);
           }
           else {
             /* I don't think this can happen, but I can't prove it. */
@@ -653,7 +715,7 @@ static void ase_parallelogram_map(
           }
         }
       }
-      draw_scanline<Traits, Delegate>(bmp, spr,
+      draw_scanline<Traits>(bmp, spr,
         l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
         l_spr_x_rounded, l_spr_y_rounded,
         spr_dx, spr_dy, delegate);
@@ -691,30 +753,61 @@ static void ase_parallelogram_map_standard(Image *bmp, Image *sprite,
 
     case IMAGE_RGB: {
       RgbDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, xs, ys, false, delegate);
+      ase_parallelogram_map<RgbTraits, RgbDelegate>(
+        bmp, sprite, bmp->width(), bmp->height(),
+        sprite->width(), sprite->height(), xs, ys, false, delegate);
       break;
     }
 
     case IMAGE_GRAYSCALE: {
       GrayscaleDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, xs, ys, false, delegate);
+      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(
+        bmp, sprite, bmp->width(), bmp->height(),
+        sprite->width(), sprite->height(), xs, ys, false, delegate);
       break;
     }
 
     case IMAGE_INDEXED: {
       IndexedDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, xs, ys, false, delegate);
+      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(
+        bmp, sprite, bmp->width(), bmp->height(),
+        sprite->width(), sprite->height(), xs, ys, false, delegate);
       break;
     }
 
     case IMAGE_BITMAP: {
       BitmapDelegate delegate;
-      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, xs, ys, false, delegate);
+      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(
+        bmp, sprite, bmp->width(), bmp->height(),
+        sprite->width(), sprite->height(), xs, ys, false, delegate);
       break;
     }
   }
 }
 
+void parallelogram_samples(int bmp_w, int bmp_h, int spr_w, int spr_h,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4,
+  int step, const gfx::Rect& area, std::vector<gfx::Point>& samples)
+{
+  fixed xs[4], ys[4];
+
+  xs[0] = itofix (x1);
+  ys[0] = itofix (y1);
+  xs[1] = itofix (x2);
+  ys[1] = itofix (y2);
+  xs[2] = itofix (x3);
+  ys[2] = itofix (y3);
+  xs[3] = itofix (x4);
+  ys[3] = itofix (y4);
+
+  samples.assign(area.w*area.h, gfx::Point(-1, -1));
+
+  ase_parallelogram_map<RgbTraits>(
+    nullptr, nullptr, bmp_w, bmp_h, spr_w, spr_h, xs, ys, false,
+    SamplesDelegate(step, area, &samples));
+}
+
 /* _rotate_scale_flip_coordinates:
  *  Calculates the coordinates for the rotated, scaled and flipped sprite,
  *  and passes them on to the given function.
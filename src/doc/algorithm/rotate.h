@@ -8,6 +8,11 @@
 #define DOC_ALGORITHM_ROTATE_H_INCLUDED
 #pragma once
 
+#include "gfx/point.h"
+#include "gfx/rect.h"
+
+#include <vector>
+
 namespace doc {
   class Image;
 
@@ -24,6 +29,16 @@ namespace doc {
       int x1, int y1, int x2, int y2,
       int x3, int y3, int x4, int y4);
 
+    // Calculates the sprite pixel (of a spr_w x spr_h sprite) that
+    // parallelogram() would draw in each pixel (u*step, v*step) of a
+    // bmp_w x bmp_h image, for each (u, v) point inside the given
+    // area. "samples" will contain one point for each (u, v) (row by
+    // row), or (-1, -1) if the parallelogram doesn't cover it.
+    void parallelogram_samples(int bmp_w, int bmp_h, int spr_w, int spr_h,
+      int x1, int y1, int x2, int y2,
+      int x3, int y3, int x4, int y4,
+      int step, const gfx::Rect& area, std::vector<gfx::Point>& samples);
+
   } // namespace algorithm
 } // namespace doc
 
@@ -15,6 +15,11 @@
 #include "doc/image_bits.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "gfx/point.h"
+#include "gfx/rect.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -140,6 +145,12 @@ static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h
     }
   }
 
+#undef A
+#undef B
+#undef C
+#undef D
+#undef P
+
 #endif
 }
 
@@ -152,44 +163,242 @@ static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
     case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
   }
 }
-  
-void rotsprite_image(Image* bmp, Image* spr,
-  int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
-{
-  static ImageBufferPtr buf1, buf2, buf3; // TODO non-thread safe
 
-  if (!buf1) buf1.reset(new ImageBuffer(1));
-  if (!buf2) buf2.reset(new ImageBuffer(1));
-  if (!buf3) buf3.reset(new ImageBuffer(1));
+// Each output pixel (u, v) takes the pixel (8u, 8v) of the sprite
+// rotated with parallelogram() after scaling it 8x with three
+// Scale2x passes. Instead of creating the whole 8x sprite (and a 8x
+// destination image), the destination is processed in small tiles,
+// and for each one we scale only the sprite area that the tile needs
+// (just two passes, the third one is calculated on demand for each
+// pixel).
+static const int kScale = 8;
+static const int kTileSize = 32;
+
+// Maximum size of the sprite area used to draw one tile (if a tile
+// needs more than that, e.g. when the sprite is downscaled, the tile
+// is split).
+static const int kMaxTileSourceArea = 64*64;
 
-  int scale = 8;
-  base::UniquePtr<Image> bmp_copy(Image::create(bmp->pixelFormat(), bmp->width()*scale, bmp->height()*scale, buf1));
-  base::UniquePtr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf2));
-  base::UniquePtr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf3));
+// Extra pixels around the sprite area of each tile, so the first two
+// Scale2x passes give the same pixels that we would get scaling the
+// whole sprite.
+static const int kTileSourceBorder = 2;
 
-  color_t maskColor = spr->maskColor();
+// Draws a pixel of the 8x sprite in a pixel of the 8x destination
+// (the same as the delegates used in parallelogram()).
+template<typename ImageTraits>
+static color_t draw_pixel(color_t dst, color_t src, color_t mask);
+
+template<>
+color_t draw_pixel<RgbTraits>(color_t dst, color_t src, color_t mask) {
+  if ((rgba_geta(mask) == 0) || ((src & rgba_rgb_mask) != (mask & rgba_rgb_mask)))
+    return rgba_blenders[BLEND_MODE_NORMAL](dst, src, 255);
+  else
+    return dst;
+}
 
-  bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
-  spr_copy->setMaskColor(maskColor);
+template<>
+color_t draw_pixel<GrayscaleTraits>(color_t dst, color_t src, color_t mask) {
+  if ((graya_geta(mask) == 0) || ((src & graya_v_mask) != (mask & graya_v_mask)))
+    return graya_blenders[BLEND_MODE_NORMAL](dst, src, 255);
+  else
+    return dst;
+}
 
-  bmp_copy->clear(bmp->maskColor());
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
+template<>
+color_t draw_pixel<IndexedTraits>(color_t dst, color_t src, color_t mask) {
+  return (src != mask ? src: dst);
+}
+
+template<>
+color_t draw_pixel<BitmapTraits>(color_t dst, color_t src, color_t mask) {
+  return (src != 0 ? src: dst);
+}
 
-  for (int i=0; i<3; ++i) {
-    tmp_copy->clear(maskColor);
-    image_scale2x(tmp_copy, spr_copy, spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy, gfx::Clip(tmp_copy->bounds()));
+// Draws a pixel of the 8x destination in the final destination (the
+// same as the blenders used in scale_image()).
+template<typename ImageTraits>
+static color_t scale_pixel(color_t dst, color_t src, color_t mask);
+
+template<>
+color_t scale_pixel<RgbTraits>(color_t dst, color_t src, color_t mask) {
+  return rgba_blenders[BLEND_MODE_NORMAL](dst, src, 255);
+}
+
+template<>
+color_t scale_pixel<GrayscaleTraits>(color_t dst, color_t src, color_t mask) {
+  return graya_blenders[BLEND_MODE_NORMAL](dst, src, 255);
+}
+
+template<>
+color_t scale_pixel<IndexedTraits>(color_t dst, color_t src, color_t mask) {
+  return (src != mask ? src: dst);
+}
+
+template<>
+color_t scale_pixel<BitmapTraits>(color_t dst, color_t src, color_t mask) {
+  return (src != 0 ? src: dst);
+}
+
+template<typename ImageTraits>
+class RotSprite {
+public:
+  RotSprite(Image* bmp, const Image* spr,
+            int x1, int y1, int x2, int y2,
+            int x3, int y3, int x4, int y4)
+    : m_bmp(bmp)
+    , m_spr(spr)
+    , m_sprBounds(0, 0, spr->width()*kScale, spr->height()*kScale)
+    , m_bmpMask(bmp->maskColor())
+    , m_sprMask(spr->maskColor())
+    , m_buf0(new ImageBuffer(1))
+    , m_buf1(new ImageBuffer(1))
+    , m_buf2(new ImageBuffer(1)) {
+    m_corners[0] = x1*kScale; m_corners[1] = y1*kScale;
+    m_corners[2] = x2*kScale; m_corners[3] = y2*kScale;
+    m_corners[4] = x3*kScale; m_corners[5] = y3*kScale;
+    m_corners[6] = x4*kScale; m_corners[7] = y4*kScale;
   }
 
-  doc::algorithm::parallelogram(bmp_copy, spr_copy,
-    x1*scale, y1*scale, x2*scale, y2*scale,
-    x3*scale, y3*scale, x4*scale, y4*scale);
+  void draw() {
+    int w = m_bmp->width();
+    int h = m_bmp->height();
+
+    // Sprite coordinates are calculated for a band of tiles each
+    // time, so we don't need a sample for each pixel of the image.
+    for (int y=0; y<h; y+=kTileSize) {
+      m_band = gfx::Rect(0, y, w, std::min(kTileSize, h-y));
+
+      parallelogram_samples(
+        w*kScale, h*kScale, m_sprBounds.w, m_sprBounds.h,
+        m_corners[0], m_corners[1], m_corners[2], m_corners[3],
+        m_corners[4], m_corners[5], m_corners[6], m_corners[7],
+        kScale, m_band, m_samples);
 
-  doc::algorithm::scale_image(bmp, bmp_copy,
-    0, 0, bmp->width(), bmp->height());
+      for (int x=0; x<w; x+=kTileSize)
+        drawTile(gfx::Rect(x, y, std::min(kTileSize, w-x), m_band.h));
+    }
+  }
+
+private:
+  const gfx::Point* sample(int u, int v) const {
+    const gfx::Point& pt = m_samples[(v-m_band.y)*m_band.w + (u-m_band.x)];
+    if (m_sprBounds.contains(pt))
+      return &pt;
+    else
+      return nullptr;
+  }
+
+  void drawTile(const gfx::Rect& tile) {
+    // Sprite area needed to draw this tile.
+    gfx::Rect area;
+    for (int v=tile.y; v<tile.y2(); ++v)
+      for (int u=tile.x; u<tile.x2(); ++u)
+        if (const gfx::Point* pt = sample(u, v))
+          area |= gfx::Rect(pt->x / kScale, pt->y / kScale, 1, 1);
+
+    if (!area.isEmpty()) {
+      area.enlarge(kTileSourceBorder);
+      area &= m_spr->bounds();
+
+      if (area.w*area.h > kMaxTileSourceArea &&
+          (tile.w > 1 || tile.h > 1)) {
+        if (tile.w >= tile.h) {
+          drawTile(gfx::Rect(tile.x, tile.y, tile.w/2, tile.h));
+          drawTile(gfx::Rect(tile.x+tile.w/2, tile.y, tile.w-tile.w/2, tile.h));
+        }
+        else {
+          drawTile(gfx::Rect(tile.x, tile.y, tile.w, tile.h/2));
+          drawTile(gfx::Rect(tile.x, tile.y+tile.h/2, tile.w, tile.h-tile.h/2));
+        }
+        return;
+      }
+
+      // Scale the area 4x (the first two Scale2x passes).
+      base::UniquePtr<Image> l0(crop_image(m_spr, area.x, area.y, area.w, area.h,
+                                           m_sprMask, m_buf0));
+      base::UniquePtr<Image> l1(Image::create(m_spr->pixelFormat(), area.w*2, area.h*2, m_buf1));
+      base::UniquePtr<Image> l2(Image::create(m_spr->pixelFormat(), area.w*4, area.h*4, m_buf2));
+      image_scale2x(l1, l0, area.w, area.h);
+      image_scale2x(l2, l1, area.w*2, area.h*2);
+      m_l2.reset(l2.release());
+      m_l2Origin = gfx::Point(area.x*4, area.y*4);
+    }
+
+    for (int v=tile.y; v<tile.y2(); ++v) {
+      for (int u=tile.x; u<tile.x2(); ++u) {
+        color_t c = m_bmpMask;
+        if (const gfx::Point* pt = sample(u, v))
+          c = draw_pixel<ImageTraits>(c, scale8x_pixel(pt->x, pt->y), m_sprMask);
+
+        put_pixel_fast<ImageTraits>(
+          m_bmp, u, v,
+          scale_pixel<ImageTraits>(get_pixel_fast<ImageTraits>(m_bmp, u, v), c, m_sprMask));
+      }
+    }
+  }
+
+  // Returns the pixel (x, y) of the 8x sprite, applying the last
+  // Scale2x pass to the 4x sprite area in m_l2.
+  color_t scale8x_pixel(int x, int y) const {
+    const Image* l2 = m_l2.get();
+    int w = m_spr->width()*4;
+    int h = m_spr->height()*4;
+    int qx = x/2;
+    int qy = y/2;
+    int lx = qx - m_l2Origin.x;
+    int ly = qy - m_l2Origin.y;
+
+    ASSERT(lx > 0 || qx == 0);
+    ASSERT(ly > 0 || qy == 0);
+    ASSERT(lx < l2->width()-1 || qx == w-1);
+    ASSERT(ly < l2->height()-1 || qy == h-1);
+
+    color_t P = get_pixel_fast<ImageTraits>(l2, lx, ly);
+    color_t A = (qy > 0 ? get_pixel_fast<ImageTraits>(l2, lx, ly-1): P);
+    color_t B = (qx < w-1 ? get_pixel_fast<ImageTraits>(l2, lx+1, ly): P);
+    color_t C = (qx > 0 ? get_pixel_fast<ImageTraits>(l2, lx-1, ly): P);
+    color_t D = (qy < h-1 ? get_pixel_fast<ImageTraits>(l2, lx, ly+1): P);
+
+    switch (((y & 1) << 1) | (x & 1)) {
+      case 0: return (C == A && C != D && A != B ? A: P);
+      case 1: return (A == B && A != C && B != D ? B: P);
+      case 2: return (D == C && D != B && C != A ? C: P);
+      default: return (B == D && B != A && D != C ? D: P);
+    }
+  }
+
+  Image* m_bmp;
+  const Image* m_spr;
+  gfx::Rect m_sprBounds;        // Bounds of the 8x sprite
+  color_t m_bmpMask;
+  color_t m_sprMask;
+  int m_corners[8];
+  gfx::Rect m_band;
+  std::vector<gfx::Point> m_samples;
+  base::UniquePtr<Image> m_l2;
+  gfx::Point m_l2Origin;
+  ImageBufferPtr m_buf0, m_buf1, m_buf2;
+};
+
+void rotsprite_image(Image* bmp, Image* spr,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4)
+{
+  switch (bmp->pixelFormat()) {
+    case IMAGE_RGB:
+      RotSprite<RgbTraits>(bmp, spr, x1, y1, x2, y2, x3, y3, x4, y4).draw();
+      break;
+    case IMAGE_GRAYSCALE:
+      RotSprite<GrayscaleTraits>(bmp, spr, x1, y1, x2, y2, x3, y3, x4, y4).draw();
+      break;
+    case IMAGE_INDEXED:
+      RotSprite<IndexedTraits>(bmp, spr, x1, y1, x2, y2, x3, y3, x4, y4).draw();
+      break;
+    case IMAGE_BITMAP:
+      RotSprite<BitmapTraits>(bmp, spr, x1, y1, x2, y2, x3, y3, x4, y4).draw();
+      break;
+  }
 }
 
 } // namespace algorithm
@@ -0,0 +1,195 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/base.h"
+#include "base/unique_ptr.h"
+#include "doc/algorithm/rotate.h"
+#include "doc/algorithm/rotsprite.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace doc;
+
+typedef base::UniquePtr<Image> ImagePtr;
+
+// Reference implementation: the whole sprite is scaled 8x (three
+// Scale2x passes) and rotated in a 8x copy of the destination, which
+// is scaled down at the end.
+
+template<typename ImageTraits>
+static void ref_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+{
+  for (int y=0; y<src_h; ++y) {
+    for (int x=0; x<src_w; ++x) {
+      color_t P = get_pixel_fast<ImageTraits>(src, x, y);
+      color_t A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
+      color_t B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
+      color_t C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
+      color_t D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
+
+      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y,   (C == A && C != D && A != B ? A: P));
+      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y,   (A == B && A != C && B != D ? B: P));
+      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y+1, (D == C && D != B && C != A ? C: P));
+      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y+1, (B == D && B != A && D != C ? D: P));
+    }
+  }
+}
+
+static void ref_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+{
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       ref_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_GRAYSCALE: ref_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_INDEXED:   ref_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_BITMAP:    ref_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+  }
+}
+
+static void ref_rotsprite_image(Image* bmp, Image* spr,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4)
+{
+  int scale = 8;
+  ImagePtr bmp_copy(Image::create(bmp->pixelFormat(), bmp->width()*scale, bmp->height()*scale));
+  ImagePtr tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale));
+  ImagePtr spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale));
+
+  color_t maskColor = spr->maskColor();
+
+  bmp_copy->setMaskColor(maskColor);
+  tmp_copy->setMaskColor(maskColor);
+  spr_copy->setMaskColor(maskColor);
+
+  bmp_copy->clear(bmp->maskColor());
+  spr_copy->clear(maskColor);
+  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
+
+  for (int i=0; i<3; ++i) {
+    tmp_copy->clear(maskColor);
+    ref_scale2x(tmp_copy, spr_copy, spr->width()*(1<<i), spr->height()*(1<<i));
+    spr_copy->copy(tmp_copy, gfx::Clip(tmp_copy->bounds()));
+  }
+
+  algorithm::parallelogram(bmp_copy, spr_copy,
+    x1*scale, y1*scale, x2*scale, y2*scale,
+    x3*scale, y3*scale, x4*scale, y4*scale);
+
+  algorithm::scale_image(bmp, bmp_copy,
+    0, 0, bmp->width(), bmp->height());
+}
+
+// Returns a random color from a small set of colors (so Scale2x finds
+// equal neighbors).
+static color_t random_color(const color_t* colors)
+{
+  return colors[std::rand() % 3];
+}
+
+static void test_rotsprite(PixelFormat format,
+                           int sprW, int sprH, int bmpW, int bmpH,
+                           double angle, double scale)
+{
+  color_t colors[3];
+  for (int i=0; i<3; ++i) {
+    switch (format) {
+      case IMAGE_RGB:
+        colors[i] = rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256,
+                         (std::rand() % 3) * 127);
+        break;
+      case IMAGE_GRAYSCALE:
+        colors[i] = graya(std::rand() % 256, (std::rand() % 3) * 127);
+        break;
+      case IMAGE_INDEXED:
+        colors[i] = std::rand() % 8;
+        break;
+      case IMAGE_BITMAP:
+        colors[i] = std::rand() % 2;
+        break;
+    }
+  }
+
+  ImagePtr spr(Image::create(format, sprW, sprH));
+  for (int y=0; y<sprH; ++y)
+    for (int x=0; x<sprW; ++x)
+      put_pixel(spr, x, y, random_color(colors));
+  spr->setMaskColor(format == IMAGE_BITMAP ? 0: colors[0]);
+
+  ImagePtr expected(Image::create(format, bmpW, bmpH));
+  for (int y=0; y<bmpH; ++y)
+    for (int x=0; x<bmpW; ++x)
+      put_pixel(expected, x, y, random_color(colors));
+  expected->setMaskColor(format == IMAGE_INDEXED ? 1: 0);
+
+  ImagePtr result(Image::createCopy(expected));
+  result->setMaskColor(expected->maskColor());
+
+  // Corners of the rotated and scaled sprite, centered in the
+  // destination
+  double cx = bmpW / 2.0;
+  double cy = bmpH / 2.0;
+  double hw = sprW * scale / 2.0;
+  double hh = sprH * scale / 2.0;
+  double co = std::cos(angle * PI / 180.0);
+  double si = std::sin(angle * PI / 180.0);
+  double px[4] = { -hw, hw, hw, -hw };
+  double py[4] = { -hh, -hh, hh, hh };
+  int xs[4], ys[4];
+  for (int i=0; i<4; ++i) {
+    xs[i] = int(cx + px[i]*co - py[i]*si);
+    ys[i] = int(cy + px[i]*si + py[i]*co);
+  }
+
+  ref_rotsprite_image(expected, spr,
+    xs[0], ys[0], xs[1], ys[1], xs[2], ys[2], xs[3], ys[3]);
+  algorithm::rotsprite_image(result, spr,
+    xs[0], ys[0], xs[1], ys[1], xs[2], ys[2], xs[3], ys[3]);
+
+  EXPECT_EQ(0, count_diff_between_images(expected, result))
+    << "Format " << int(format)
+    << " sprite " << sprW << "x" << sprH
+    << " in " << bmpW << "x" << bmpH
+    << " angle " << angle << " scale " << scale;
+}
+
+TEST(RotSprite, SameAsScalingTheWholeSprite)
+{
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE,
+                                  IMAGE_INDEXED, IMAGE_BITMAP };
+  const int sizes[][4] = {
+    // Sprite and destination sizes
+    { 1, 1, 4, 4 },
+    { 7, 3, 16, 16 },
+    { 31, 45, 64, 48 },
+    { 40, 40, 70, 90 },       // More than one tile in the destination
+    { 100, 60, 110, 110 },    // Splitted tiles when the sprite is scaled down
+  };
+  const double angles[] = { 0.0, 15.0, 90.0, 133.5, 321.0 };
+  const double scales[] = { 0.3, 1.0, 1.7 };
+
+  std::srand(1);
+  for (PixelFormat format : formats)
+    for (const auto& size : sizes)
+      for (double angle : angles)
+        for (double scale : scales)
+          test_rotsprite(format, size[0], size[1], size[2], size[3],
+                         angle, scale);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -30,8 +30,75 @@ static bool is_same_pixel(PixelFormat pixelFormat, color_t pixel1, color_t pixel
   return pixel1 == pixel2;
 }
 
+template<typename ImageTraits>
+static bool is_empty_row(const Image* image, int y, color_t refpixel)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, y);
+  const pixel_t* end = row + image->width();
+  for (; row != end; ++row)
+    if (!is_same_pixel(image->pixelFormat(), *row, refpixel))
+      return false;
+  return true;
+}
+
+// Finds the bounds with a row by row pass (instead of checking
+// columns, which is slow for big images). After the top and bottom
+// rows are found, only pixels outside the left/right sides found so
+// far are checked in each row.
+template<typename ImageTraits>
+static bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const PixelFormat pixelFormat = image->pixelFormat();
+  const int w = image->width();
+  const int h = image->height();
+
+  int top = 0;
+  while (top < h && is_empty_row<ImageTraits>(image, top, refpixel))
+    ++top;
+
+  if (top == h) {
+    bounds = gfx::Rect();
+    return false;
+  }
+
+  int bottom = h-1;
+  while (bottom > top && is_empty_row<ImageTraits>(image, bottom, refpixel))
+    --bottom;
+
+  int left = w, right = -1;
+  for (int v=top; v<=bottom; ++v) {
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, v);
+
+    for (int u=0; u<left; ++u) {
+      if (!is_same_pixel(pixelFormat, row[u], refpixel)) {
+        left = u;
+        break;
+      }
+    }
+
+    for (int u=w-1; u>right; --u) {
+      if (!is_same_pixel(pixelFormat, row[u], refpixel)) {
+        right = u;
+        break;
+      }
+    }
+  }
+
+  bounds = gfx::Rect(left, top, right-left+1, bottom-top+1);
+  return true;
+}
+
 bool shrink_bounds(Image *image, gfx::Rect& bounds, color_t refpixel)
 {
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB: return shrink_bounds_templ<RgbTraits>(image, bounds, refpixel);
+    case IMAGE_GRAYSCALE: return shrink_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
+    case IMAGE_INDEXED: return shrink_bounds_templ<IndexedTraits>(image, bounds, refpixel);
+  }
+
+  // Bitmaps (8 pixels per byte)
   bool shrink;
   int u, v;
 
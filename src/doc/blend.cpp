@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -9,6 +9,8 @@
 #endif
 
 #include "doc/blend.h"
+
+#include "doc/blend_simd.h"
 #include "doc/image.h"
 
 namespace doc {
@@ -314,4 +316,94 @@ int indexed_blend_direct(int back, int front, int opacity)
   return front;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Span blenders
+
+// The blender is a template argument so it can be inlined in the loop
+template<int (*blend)(int, int, int), typename pixel_t>
+static void blend_span(pixel_t* dst, const pixel_t* back, const pixel_t* front,
+                       int n, pixel_t mask_color, int opacity)
+{
+  for (int i=0; i<n; ++i) {
+    if (front[i] != mask_color)
+      dst[i] = blend(back[i], front[i], opacity);
+    else
+      dst[i] = back[i];
+  }
+}
+
+static RGBA_BLEND_SPAN rgba_span_blenders[] =
+{
+  blend_span<rgba_blend_normal, uint32_t>,
+  blend_span<rgba_blend_copy, uint32_t>,
+  blend_span<rgba_blend_merge, uint32_t>,
+  blend_span<rgba_blend_red_tint, uint32_t>,
+  blend_span<rgba_blend_blue_tint, uint32_t>,
+  blend_span<rgba_blend_blackandwhite, uint32_t>,
+};
+
+static GRAYA_BLEND_SPAN graya_span_blenders[] =
+{
+  blend_span<graya_blend_normal, uint16_t>,
+  blend_span<graya_blend_copy, uint16_t>,
+  blend_span<graya_blend_copy, uint16_t>,
+  blend_span<graya_blend_copy, uint16_t>,
+  blend_span<graya_blend_copy, uint16_t>,
+  blend_span<graya_blend_blackandwhite, uint16_t>,
+};
+
+BlendSpanImpl best_blend_span_impl()
+{
+  static BlendSpanImpl impl =
+#ifdef DOC_HAVE_BLEND_SIMD
+    (cpu_has_avx2() ? BlendSpanImpl::AVX2:
+     cpu_has_sse2() ? BlendSpanImpl::SSE2:
+                      BlendSpanImpl::Scalar);
+#else
+    BlendSpanImpl::Scalar;
+#endif
+  return impl;
+}
+
+RGBA_BLEND_SPAN get_rgba_span_blender(int blend_mode)
+{
+  return get_rgba_span_blender(blend_mode, best_blend_span_impl());
+}
+
+RGBA_BLEND_SPAN get_rgba_span_blender(int blend_mode, BlendSpanImpl impl)
+{
+  ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
+
+  // Only the normal blend mode (the most used one) has SIMD versions
+#ifdef DOC_HAVE_BLEND_SIMD
+  if (blend_mode == BLEND_MODE_NORMAL) {
+    switch (impl) {
+      case BlendSpanImpl::SSE2: return rgba_blend_normal_span_sse2;
+      case BlendSpanImpl::AVX2: return rgba_blend_normal_span_avx2;
+    }
+  }
+#endif
+  return rgba_span_blenders[blend_mode];
+}
+
+GRAYA_BLEND_SPAN get_graya_span_blender(int blend_mode)
+{
+  return get_graya_span_blender(blend_mode, best_blend_span_impl());
+}
+
+GRAYA_BLEND_SPAN get_graya_span_blender(int blend_mode, BlendSpanImpl impl)
+{
+  ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
+
+#ifdef DOC_HAVE_BLEND_SIMD
+  if (blend_mode == BLEND_MODE_NORMAL) {
+    switch (impl) {
+      case BlendSpanImpl::SSE2: return graya_blend_normal_span_sse2;
+      case BlendSpanImpl::AVX2: return graya_blend_normal_span_avx2;
+    }
+  }
+#endif
+  return graya_span_blenders[blend_mode];
+}
+
 } // namespace doc
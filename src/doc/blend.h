@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -44,6 +44,30 @@ namespace doc {
 
   int indexed_blend_direct(int back, int front, int opacity);
 
+  // Span blenders: blend "n" pixels of "front" over "back" and put
+  // the result in "dst" (which can be the same "back" span). Front
+  // pixels equal to "mask_color" leave the back pixel unchanged. The
+  // result is exactly the same as using the BLEND_COLOR functions.
+  typedef void (*RGBA_BLEND_SPAN)(uint32_t* dst, const uint32_t* back, const uint32_t* front,
+                                  int n, uint32_t mask_color, int opacity);
+  typedef void (*GRAYA_BLEND_SPAN)(uint16_t* dst, const uint16_t* back, const uint16_t* front,
+                                   int n, uint16_t mask_color, int opacity);
+
+  // Instruction set used by the span blenders.
+  enum class BlendSpanImpl {
+    Scalar,
+    SSE2,
+    AVX2,
+  };
+
+  // Returns the best implementation supported by the running CPU.
+  BlendSpanImpl best_blend_span_impl();
+
+  RGBA_BLEND_SPAN get_rgba_span_blender(int blend_mode);
+  RGBA_BLEND_SPAN get_rgba_span_blender(int blend_mode, BlendSpanImpl impl);
+  GRAYA_BLEND_SPAN get_graya_span_blender(int blend_mode);
+  GRAYA_BLEND_SPAN get_graya_span_blender(int blend_mode, BlendSpanImpl impl);
+
 } // namespace doc
 
 #endif
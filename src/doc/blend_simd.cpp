@@ -0,0 +1,286 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/blend.h"
+#include "doc/blend_simd.h"
+
+#ifdef DOC_HAVE_BLEND_SIMD
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+#include <immintrin.h>
+
+// GCC/Clang need to know the instruction set of each function (MSVC
+// can use any intrinsic anywhere).
+#if defined(__GNUC__)
+  #define TARGET_SSE2 __attribute__((target("sse2")))
+  #define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+  #define TARGET_SSE2
+  #define TARGET_AVX2
+#endif
+
+// These kernels use the same integer formulas of rgba_blend_normal()
+// and graya_blend_normal() for each pixel:
+//
+//   F_a = INT_MULT(F_a, opacity)
+//   D_a = B_a + F_a - INT_MULT(B_a, F_a)
+//   D_c = B_c + (F_c-B_c) * F_a / D_a
+//
+// All channels are expanded to 32-bit lanes. INT_MULT() of two 8-bit
+// values fits in the lower 16-bits of each lane (so we can use
+// mullo_epi16), and the division is done with floats: the numerator
+// is exact (|x| < 2^24) and the truncated quotient is the same as the
+// integer division because the rounding error is less than 1/D_a.
+
+namespace doc {
+
+//////////////////////////////////////////////////////////////////////
+// CPU detection
+
+#ifdef _MSC_VER
+
+bool cpu_has_sse2()
+{
+  int info[4];
+  __cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+}
+
+bool cpu_has_avx2()
+{
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The OS must save the AVX registers (OSXSAVE + XCR0)
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 ||
+      (info[2] & (1 << 28)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+
+#else
+
+bool cpu_has_sse2()
+{
+  return __builtin_cpu_supports("sse2") ? true: false;
+}
+
+bool cpu_has_avx2()
+{
+  return __builtin_cpu_supports("avx2") ? true: false;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// SSE2 (4 pixels at a time)
+
+TARGET_SSE2
+static inline __m128i int_mult_sse2(__m128i a, __m128i b)
+{
+  __m128i t = _mm_add_epi32(_mm_mullo_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+TARGET_SSE2
+static inline __m128i select_sse2(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// B_c + (F_c-B_c) * F_a / D_a
+TARGET_SSE2
+static inline __m128i blend_channel_sse2(__m128i B_c, __m128i F_c, __m128 F_a, __m128 D_a)
+{
+  __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(F_c, B_c)), F_a);
+  return _mm_add_epi32(B_c, _mm_cvttps_epi32(_mm_div_ps(x, D_a)));
+}
+
+// Blends 4 pixels, each one in a 32-bit lane, with "shift" being the
+// alpha channel position (24 for RGBA and 8 for GRAYA).
+template<int shift>
+TARGET_SSE2
+static inline __m128i blend_normal_sse2(__m128i B, __m128i F,
+                                        __m128i mask_color, __m128i opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ff = _mm_set1_epi32(0xff);
+  const __m128i color_bits = _mm_set1_epi32((1 << shift) - 1);
+
+  __m128i B_a = _mm_srli_epi32(B, shift);
+  __m128i F_a0 = _mm_srli_epi32(F, shift);
+  __m128i F_a = int_mult_sse2(F_a0, opacity);
+  __m128i D_a = _mm_sub_epi32(_mm_add_epi32(B_a, F_a), int_mult_sse2(B_a, F_a));
+
+  // Avoid divisions by zero in lanes that will be discarded (B_a == 0)
+  __m128 fF_a = _mm_cvtepi32_ps(F_a);
+  __m128 fD_a = _mm_cvtepi32_ps(_mm_or_si128(D_a, _mm_cmpeq_epi32(D_a, zero)));
+
+  __m128i D = _mm_slli_epi32(D_a, shift);
+  for (int s=0; s<shift; s+=8) {
+    __m128i B_c = _mm_and_si128(_mm_srli_epi32(B, s), ff);
+    __m128i F_c = _mm_and_si128(_mm_srli_epi32(F, s), ff);
+    D = _mm_or_si128(D, _mm_slli_epi32(blend_channel_sse2(B_c, F_c, fF_a, fD_a), s));
+  }
+
+  // Transparent back: front color with the new alpha
+  __m128i D_transparent_back =
+    _mm_or_si128(_mm_and_si128(F, color_bits), _mm_slli_epi32(F_a, shift));
+
+  D = select_sse2(_mm_cmpeq_epi32(F_a0, zero), B, D);
+  D = select_sse2(_mm_cmpeq_epi32(B_a, zero), D_transparent_back, D);
+  D = select_sse2(_mm_cmpeq_epi32(F, mask_color), B, D);
+  return D;
+}
+
+TARGET_SSE2
+void rgba_blend_normal_span_sse2(uint32_t* dst, const uint32_t* back, const uint32_t* front,
+                                 int n, uint32_t mask_color, int opacity)
+{
+  const __m128i mask = _mm_set1_epi32(mask_color);
+  const __m128i op = _mm_set1_epi32(opacity);
+  int i = 0;
+
+  for (; i+4<=n; i+=4) {
+    __m128i B = _mm_loadu_si128((const __m128i*)(back+i));
+    __m128i F = _mm_loadu_si128((const __m128i*)(front+i));
+    _mm_storeu_si128((__m128i*)(dst+i), blend_normal_sse2<24>(B, F, mask, op));
+  }
+
+  for (; i<n; ++i)
+    dst[i] = (front[i] != mask_color ? rgba_blend_normal(back[i], front[i], opacity): back[i]);
+}
+
+TARGET_SSE2
+void graya_blend_normal_span_sse2(uint16_t* dst, const uint16_t* back, const uint16_t* front,
+                                  int n, uint16_t mask_color, int opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi32(mask_color);
+  const __m128i op = _mm_set1_epi32(opacity);
+  int i = 0;
+
+  for (; i+4<=n; i+=4) {
+    __m128i B = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(back+i)), zero);
+    __m128i F = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(front+i)), zero);
+    __m128i D = blend_normal_sse2<8>(B, F, mask, op);
+
+    // Sign-extend the 16-bit values so packs_epi32 doesn't saturate them
+    D = _mm_srai_epi32(_mm_slli_epi32(D, 16), 16);
+    _mm_storel_epi64((__m128i*)(dst+i), _mm_packs_epi32(D, D));
+  }
+
+  for (; i<n; ++i)
+    dst[i] = (front[i] != mask_color ? graya_blend_normal(back[i], front[i], opacity): back[i]);
+}
+
+//////////////////////////////////////////////////////////////////////
+// AVX2 (8 pixels at a time)
+
+TARGET_AVX2
+static inline __m256i int_mult_avx2(__m256i a, __m256i b)
+{
+  __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(a, b), _mm256_set1_epi32(0x80));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+}
+
+TARGET_AVX2
+static inline __m256i blend_channel_avx2(__m256i B_c, __m256i F_c, __m256 F_a, __m256 D_a)
+{
+  __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(F_c, B_c)), F_a);
+  return _mm256_add_epi32(B_c, _mm256_cvttps_epi32(_mm256_div_ps(x, D_a)));
+}
+
+template<int shift>
+TARGET_AVX2
+static inline __m256i blend_normal_avx2(__m256i B, __m256i F,
+                                        __m256i mask_color, __m256i opacity)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ff = _mm256_set1_epi32(0xff);
+  const __m256i color_bits = _mm256_set1_epi32((1 << shift) - 1);
+
+  __m256i B_a = _mm256_srli_epi32(B, shift);
+  __m256i F_a0 = _mm256_srli_epi32(F, shift);
+  __m256i F_a = int_mult_avx2(F_a0, opacity);
+  __m256i D_a = _mm256_sub_epi32(_mm256_add_epi32(B_a, F_a), int_mult_avx2(B_a, F_a));
+
+  __m256 fF_a = _mm256_cvtepi32_ps(F_a);
+  __m256 fD_a = _mm256_cvtepi32_ps(_mm256_or_si256(D_a, _mm256_cmpeq_epi32(D_a, zero)));
+
+  __m256i D = _mm256_slli_epi32(D_a, shift);
+  for (int s=0; s<shift; s+=8) {
+    __m256i B_c = _mm256_and_si256(_mm256_srli_epi32(B, s), ff);
+    __m256i F_c = _mm256_and_si256(_mm256_srli_epi32(F, s), ff);
+    D = _mm256_or_si256(D, _mm256_slli_epi32(blend_channel_avx2(B_c, F_c, fF_a, fD_a), s));
+  }
+
+  __m256i D_transparent_back =
+    _mm256_or_si256(_mm256_and_si256(F, color_bits), _mm256_slli_epi32(F_a, shift));
+
+  D = _mm256_blendv_epi8(D, B, _mm256_cmpeq_epi32(F_a0, zero));
+  D = _mm256_blendv_epi8(D, D_transparent_back, _mm256_cmpeq_epi32(B_a, zero));
+  D = _mm256_blendv_epi8(D, B, _mm256_cmpeq_epi32(F, mask_color));
+  return D;
+}
+
+TARGET_AVX2
+void rgba_blend_normal_span_avx2(uint32_t* dst, const uint32_t* back, const uint32_t* front,
+                                 int n, uint32_t mask_color, int opacity)
+{
+  const __m256i mask = _mm256_set1_epi32(mask_color);
+  const __m256i op = _mm256_set1_epi32(opacity);
+  int i = 0;
+
+  for (; i+8<=n; i+=8) {
+    __m256i B = _mm256_loadu_si256((const __m256i*)(back+i));
+    __m256i F = _mm256_loadu_si256((const __m256i*)(front+i));
+    _mm256_storeu_si256((__m256i*)(dst+i), blend_normal_avx2<24>(B, F, mask, op));
+  }
+
+  if (i < n)
+    rgba_blend_normal_span_sse2(dst+i, back+i, front+i, n-i, mask_color, opacity);
+}
+
+TARGET_AVX2
+void graya_blend_normal_span_avx2(uint16_t* dst, const uint16_t* back, const uint16_t* front,
+                                  int n, uint16_t mask_color, int opacity)
+{
+  const __m256i mask = _mm256_set1_epi32(mask_color);
+  const __m256i op = _mm256_set1_epi32(opacity);
+  int i = 0;
+
+  for (; i+8<=n; i+=8) {
+    __m256i B = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(back+i)));
+    __m256i F = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(front+i)));
+    __m256i D = blend_normal_avx2<8>(B, F, mask, op);
+
+    // packs_epi32 works in each 128-bit lane, so we have to join the
+    // first 64-bits of both lanes.
+    D = _mm256_srai_epi32(_mm256_slli_epi32(D, 16), 16);
+    D = _mm256_permute4x64_epi64(_mm256_packs_epi32(D, D), 0x08);
+    _mm_storeu_si128((__m128i*)(dst+i), _mm256_castsi256_si128(D));
+  }
+
+  if (i < n)
+    graya_blend_normal_span_sse2(dst+i, back+i, front+i, n-i, mask_color, opacity);
+}
+
+} // namespace doc
+
+#endif // DOC_HAVE_BLEND_SIMD
@@ -0,0 +1,40 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_BLEND_SIMD_H_INCLUDED
+#define DOC_BLEND_SIMD_H_INCLUDED
+#pragma once
+
+// SSE2/AVX2 versions of the span blenders (only for x86/x64). They
+// are selected in runtime by get_rgba/graya_span_blender() depending
+// on the running CPU.
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+  #define DOC_HAVE_BLEND_SIMD 1
+#endif
+
+#ifdef DOC_HAVE_BLEND_SIMD
+
+namespace doc {
+
+  bool cpu_has_sse2();
+  bool cpu_has_avx2();
+
+  void rgba_blend_normal_span_sse2(uint32_t* dst, const uint32_t* back, const uint32_t* front,
+                                   int n, uint32_t mask_color, int opacity);
+  void rgba_blend_normal_span_avx2(uint32_t* dst, const uint32_t* back, const uint32_t* front,
+                                   int n, uint32_t mask_color, int opacity);
+
+  void graya_blend_normal_span_sse2(uint16_t* dst, const uint16_t* back, const uint16_t* front,
+                                    int n, uint16_t mask_color, int opacity);
+  void graya_blend_normal_span_avx2(uint16_t* dst, const uint16_t* back, const uint16_t* front,
+                                    int n, uint16_t mask_color, int opacity);
+
+} // namespace doc
+
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/chrono.h"
+#include "doc/blend.h"
+#include "doc/color.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+static const char* blend_mode_names[] = {
+  "normal", "copy", "merge", "red tint", "blue tint", "black & white"
+};
+
+static const char* impl_names[] = { "scalar", "SSE2", "AVX2" };
+
+// Random pixels with a lot of transparent and opaque values (which
+// are the special cases of the blenders).
+static uint32_t random_rgba()
+{
+  static const int alphas[] = { 0, 0, 1, 127, 128, 254, 255, 255 };
+  int a = (std::rand() % 2 ? alphas[std::rand() % 8]: std::rand() % 256);
+  return rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, a);
+}
+
+static uint16_t random_graya()
+{
+  return uint16_t(random_rgba() >> 16);
+}
+
+template<typename pixel_t, typename Span, typename Blender>
+static void expect_span_matches_pixel_blender(Span span, Blender blender,
+                                              pixel_t (*random_pixel)(),
+                                              pixel_t mask_color)
+{
+  const int n = 67;             // Not multiple of the SIMD width
+  std::vector<pixel_t> back(n), front(n), dst(n);
+
+  for (int opacity=0; opacity<256; ++opacity) {
+    for (int i=0; i<n; ++i) {
+      back[i] = random_pixel();
+      front[i] = (i % 13 == 0 ? mask_color: random_pixel());
+    }
+
+    span(&dst[0], &back[0], &front[0], n, mask_color, opacity);
+
+    for (int i=0; i<n; ++i) {
+      pixel_t expected = (front[i] != mask_color ?
+                          pixel_t(blender(back[i], front[i], opacity)): back[i]);
+      ASSERT_EQ(expected, dst[i])
+        << "back=" << std::hex << back[i] << " front=" << front[i]
+        << std::dec << " opacity=" << opacity;
+    }
+
+    // In-place blending (dst == back)
+    std::vector<pixel_t> inplace(back);
+    span(&inplace[0], &inplace[0], &front[0], n, mask_color, opacity);
+    ASSERT_TRUE(dst == inplace);
+  }
+}
+
+TEST(BlendSpan, RgbaMatchesPixelBlenders)
+{
+  std::srand(1);
+  for (int impl=0; impl<=int(best_blend_span_impl()); ++impl) {
+    for (int mode=0; mode<BLEND_MODE_MAX; ++mode) {
+      SCOPED_TRACE(testing::Message() << impl_names[impl] << " " << blend_mode_names[mode]);
+      expect_span_matches_pixel_blender<uint32_t>(
+        get_rgba_span_blender(mode, BlendSpanImpl(impl)),
+        rgba_blenders[mode], random_rgba, 0);
+    }
+  }
+}
+
+TEST(BlendSpan, GrayaMatchesPixelBlenders)
+{
+  std::srand(2);
+  for (int impl=0; impl<=int(best_blend_span_impl()); ++impl) {
+    for (int mode=0; mode<BLEND_MODE_MAX; ++mode) {
+      SCOPED_TRACE(testing::Message() << impl_names[impl] << " " << blend_mode_names[mode]);
+      expect_span_matches_pixel_blender<uint16_t>(
+        get_graya_span_blender(mode, BlendSpanImpl(impl)),
+        graya_blenders[mode], random_graya, 0);
+    }
+  }
+}
+
+TEST(BlendSpan, MaskColor)
+{
+  uint32_t back = rgba(10, 20, 30, 0);
+  uint32_t front = rgba(1, 2, 3, 0);
+  uint32_t dst;
+
+  for (int impl=0; impl<=int(best_blend_span_impl()); ++impl) {
+    get_rgba_span_blender(BLEND_MODE_NORMAL, BlendSpanImpl(impl))(
+      &dst, &back, &front, 1, front, 255);
+    EXPECT_EQ(back, dst);
+
+    get_rgba_span_blender(BLEND_MODE_NORMAL, BlendSpanImpl(impl))(
+      &dst, &back, &front, 1, 0, 255);
+    EXPECT_EQ(front, dst);
+  }
+}
+
+// Micro-benchmark: time to blend a scanline pixel by pixel (as the
+// renderer did with BLEND_COLOR functions) vs. with span blenders.
+// The bounds are generous, only to catch a span blender that is much
+// slower than the per-pixel one.
+TEST(BlendSpan, Benchmark)
+{
+  const int n = 4096;
+  const int times = 400;
+  std::vector<uint32_t> back(n), front(n), dst(n);
+  for (int i=0; i<n; ++i) {
+    back[i] = random_rgba();
+    front[i] = random_rgba();
+  }
+
+  for (int mode=0; mode<BLEND_MODE_MAX; ++mode) {
+    BLEND_COLOR blender = rgba_blenders[mode];
+    base::Chrono chrono;
+    for (int j=0; j<times; ++j)
+      for (int i=0; i<n; ++i)
+        dst[i] = (front[i] != 0 ? blender(back[i], front[i], 200): back[i]);
+    double t0 = chrono.elapsed();
+
+    std::printf("%-14s per-pixel %7.2f ms", blend_mode_names[mode], t0*1000.0);
+
+    for (int impl=0; impl<=int(best_blend_span_impl()); ++impl) {
+      RGBA_BLEND_SPAN span = get_rgba_span_blender(mode, BlendSpanImpl(impl));
+      chrono.reset();
+      for (int j=0; j<times; ++j)
+        span(&dst[0], &back[0], &front[0], n, 0, 200);
+      double t = chrono.elapsed();
+
+      std::printf("  %s %7.2f ms (x%.2f)", impl_names[impl], t*1000.0, t0 / t);
+
+      // Span blenders cannot be much slower than the per-pixel
+      // blenders (some modes don't have SIMD versions, so they are
+      // only as fast).
+      EXPECT_LT(t, t0 * 2) << blend_mode_names[mode] << " " << impl_names[impl];
+    }
+    std::printf("\n");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
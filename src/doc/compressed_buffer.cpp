@@ -0,0 +1,68 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/compressed_buffer.h"
+
+#include "base/exception.h"
+#include "zlib.h"
+
+namespace doc {
+
+CompressedBuffer::CompressedBuffer()
+  : m_size(0)
+{
+}
+
+void CompressedBuffer::compress(const std::vector<uint8_t>& data)
+{
+  m_size = data.size();
+  if (data.empty()) {
+    m_data.clear();
+    return;
+  }
+
+  uLongf compressedSize = compressBound(data.size());
+  m_data.resize(compressedSize);
+
+  // The fastest compression level, this is used in undo commands
+  // created after each user action.
+  int err = compress2((Bytef*)&m_data[0], &compressedSize,
+                      (const Bytef*)&data[0], data.size(),
+                      Z_BEST_SPEED);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in compress2().", err);
+
+  m_data.resize(compressedSize);
+  m_data.shrink_to_fit();
+}
+
+void CompressedBuffer::uncompress(std::vector<uint8_t>& data) const
+{
+  data.resize(m_size);
+  if (m_size == 0)
+    return;
+
+  uLongf size = m_size;
+  int err = ::uncompress((Bytef*)&data[0], &size,
+                         (const Bytef*)&m_data[0], m_data.size());
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in uncompress().", err);
+
+  if (size != m_size)
+    throw base::Exception("Bad compressed buffer.");
+}
+
+void CompressedBuffer::clear()
+{
+  m_size = 0;
+  m_data.clear();
+}
+
+} // namespace doc
@@ -0,0 +1,43 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_COMPRESSED_BUFFER_H_INCLUDED
+#define DOC_COMPRESSED_BUFFER_H_INCLUDED
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+
+  // Bytes compressed with zlib. It's used to keep data that is not
+  // accessed frequently (e.g. pixels in undo information).
+  class CompressedBuffer {
+  public:
+    CompressedBuffer();
+
+    // Replaces the content of the buffer with the given bytes.
+    void compress(const std::vector<uint8_t>& data);
+
+    // Returns the original bytes in "data".
+    void uncompress(std::vector<uint8_t>& data) const;
+
+    void clear();
+
+    // Size of the original data.
+    size_t size() const { return m_size; }
+
+    // Memory used by the compressed data.
+    size_t compressedSize() const { return m_data.size(); }
+
+  private:
+    size_t m_size;
+    std::vector<uint8_t> m_data;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,67 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/compressed_buffer.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+TEST(CompressedBuffer, Empty)
+{
+  CompressedBuffer buf;
+  EXPECT_EQ(0, buf.size());
+  EXPECT_EQ(0, buf.compressedSize());
+
+  std::vector<uint8_t> data(10, 1);
+  buf.uncompress(data);
+  EXPECT_TRUE(data.empty());
+
+  buf.compress(data);
+  EXPECT_EQ(0, buf.size());
+}
+
+TEST(CompressedBuffer, CompressAndUncompress)
+{
+  std::vector<uint8_t> data(64*1024);
+  for (size_t i=0; i<data.size(); ++i)
+    data[i] = (i / 256) & 0xff;
+
+  CompressedBuffer buf;
+  buf.compress(data);
+  EXPECT_EQ(data.size(), buf.size());
+  EXPECT_LT(buf.compressedSize(), data.size() / 10);
+
+  std::vector<uint8_t> result;
+  buf.uncompress(result);
+  EXPECT_TRUE(data == result);
+
+  // Random data cannot be compressed but it's restored correctly
+  std::srand(1);
+  for (size_t i=0; i<data.size(); ++i)
+    data[i] = std::rand() & 0xff;
+
+  buf.compress(data);
+  EXPECT_EQ(data.size(), buf.size());
+  buf.uncompress(result);
+  EXPECT_TRUE(data == result);
+
+  buf.clear();
+  EXPECT_EQ(0, buf.size());
+  EXPECT_EQ(0, buf.compressedSize());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
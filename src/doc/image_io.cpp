@@ -27,7 +27,12 @@ using namespace base::serialization::little_endian;
 
 void write_image(std::ostream& os, const Image* image)
 {
-  write32(os, image->id());
+  write_image(os, image, image->id());
+}
+
+void write_image(std::ostream& os, const Image* image, ObjectId id)
+{
+  write32(os, id);
   write8(os, image->pixelFormat());    // Pixel format
   write16(os, image->width());         // Width
   write16(os, image->height());        // Height
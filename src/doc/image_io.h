@@ -8,6 +8,8 @@
 #define DOC_IMAGE_IO_H_INCLUDED
 #pragma once
 
+#include "doc/object_id.h"
+
 #include <iosfwd>
 
 namespace doc {
@@ -15,6 +17,10 @@ namespace doc {
   class Image;
 
   void write_image(std::ostream& os, const Image* image);
+
+  // Writes the image with the given ID instead of the image ID (e.g.
+  // to save a copy of an image as the original one).
+  void write_image(std::ostream& os, const Image* image, ObjectId id);
   Image* read_image(std::istream& is, bool setId = true);
 
 } // namespace doc
@@ -11,9 +11,11 @@
 #include <gtest/gtest.h>
 
 #include "base/unique_ptr.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
 #include "doc/primitives.h"
+#include "gfx/region.h"
 
 using namespace base;
 using namespace doc;
@@ -144,6 +146,88 @@ TEST(Image, DiffRgbImages)
   ASSERT_EQ(2, count_diff_between_images(a, b));
 }
 
+TYPED_TEST(ImageAllTypes, ImageHash)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 17, 9));
+  UniquePtr<Image> b(Image::create(ImageTraits::pixel_format, 17, 9));
+  UniquePtr<Image> c(Image::create(ImageTraits::pixel_format, 9, 17));
+  a->clear(0);
+  b->clear(0);
+  c->clear(0);
+
+  EXPECT_EQ(calculate_image_hash(a), calculate_image_hash(b));
+  EXPECT_NE(calculate_image_hash(a), calculate_image_hash(c));
+
+  put_pixel(a, 16, 8, ImageTraits::max_value);
+  EXPECT_NE(calculate_image_hash(a), calculate_image_hash(b));
+
+  put_pixel(b, 16, 8, ImageTraits::max_value);
+  EXPECT_EQ(calculate_image_hash(a), calculate_image_hash(b));
+}
+
+static int region_area(const gfx::Region& rgn)
+{
+  int area = 0;
+  for (const auto& rc : rgn)
+    area += rc.w*rc.h;
+  return area;
+}
+
+TYPED_TEST(ImageAllTypes, DiffRegion)
+{
+  typedef TypeParam ImageTraits;
+
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 64, 48));
+  UniquePtr<Image> b(Image::create(ImageTraits::pixel_format, 64, 48));
+  a->clear(0);
+  b->clear(0);
+
+  gfx::Region region(a->bounds());
+  gfx::Region result;
+  get_diff_region_between_images(a, b, region, result);
+  EXPECT_TRUE(result.isEmpty());
+
+  put_pixel(b, 10, 5, ImageTraits::max_value);
+  fill_rect(b, 20, 20, 29, 24, ImageTraits::max_value);
+  get_diff_region_between_images(a, b, region, result);
+  EXPECT_EQ(1+10*5, region_area(result));
+  EXPECT_EQ(gfx::Region::In, result.contains(gfx::Rect(10, 5, 1, 1)));
+  EXPECT_EQ(gfx::Region::In, result.contains(gfx::Rect(20, 20, 10, 5)));
+
+  // Only the given region is checked
+  get_diff_region_between_images(a, b, gfx::Region(gfx::Rect(0, 0, 15, 48)), result);
+  EXPECT_EQ(1, region_area(result));
+
+  // Close spans in the same row are joined
+  put_pixel(b, 0, 40, ImageTraits::max_value);
+  put_pixel(b, 5, 40, ImageTraits::max_value);
+  put_pixel(b, 63, 40, ImageTraits::max_value);
+  get_diff_region_between_images(a, b, gfx::Region(gfx::Rect(0, 40, 64, 1)), result);
+  EXPECT_EQ(6+1, region_area(result));
+}
+
+TYPED_TEST(ImageAllTypes, DiffRegionIsSmallerThanRegion)
+{
+  typedef TypeParam ImageTraits;
+
+  // A filled shape that changes only a ring of pixels (the inside
+  // was already painted) is saved with the ring area only.
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 100, 100));
+  a->clear(0);
+  fill_ellipse(a, 10, 10, 89, 89, ImageTraits::max_value);
+  UniquePtr<Image> b(Image::createCopy(a));
+  fill_rect(b, 0, 0, 99, 99, ImageTraits::max_value);
+
+  gfx::Region region(a->bounds());
+  gfx::Region result;
+  get_diff_region_between_images(a, b, region, result);
+
+  EXPECT_EQ(count_diff_between_images(a, b), region_area(result));
+  EXPECT_LT(region_area(result), region_area(region) / 2);
+}
+
 TYPED_TEST(ImageAllTypes, DrawHLine)
 {
   typedef TypeParam ImageTraits;
@@ -179,6 +263,36 @@ TYPED_TEST(ImageAllTypes, DrawHLine)
   }
 }
 
+TYPED_TEST(ImageAllTypes, ShrinkBounds)
+{
+  typedef TypeParam ImageTraits;
+
+  int w = 37;
+  int h = 29;
+  UniquePtr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+  image->clear(0);
+
+  gfx::Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(image.get(), bounds, 0));
+
+  std::srand(1);
+  for (int c=0; c<50; ++c) {
+    int n = 1 + (rand() % 4);
+    image->clear(0);
+
+    gfx::Rect expected;
+    for (int i=0; i<n; ++i) {
+      int x = rand() % w;
+      int y = rand() % h;
+      put_pixel(image.get(), x, y, ImageTraits::max_value);
+      expected |= gfx::Rect(x, y, 1, 1);
+    }
+
+    ASSERT_TRUE(algorithm::shrink_bounds(image.get(), bounds, 0));
+    EXPECT_TRUE(expected == bounds);
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -122,18 +122,34 @@ void LayerImage::destroyAllCels()
   m_cels.clear();
 }
 
-Cel* LayerImage::cel(frame_t frame) const
+static bool cel_frame_less(const Cel* cel, frame_t frame)
 {
-  CelConstIterator it = getCelBegin();
-  CelConstIterator end = getCelEnd();
+  return cel->frame() < frame;
+}
 
-  for (; it != end; ++it) {
-    Cel* cel = *it;
-    if (cel->frame() == frame)
-      return cel;
-  }
+static bool frame_cel_less(frame_t frame, const Cel* cel)
+{
+  return frame < cel->frame();
+}
 
-  return NULL;
+CelIterator LayerImage::lowerBound(frame_t frame)
+{
+  return std::lower_bound(m_cels.begin(), m_cels.end(), frame, cel_frame_less);
+}
+
+CelConstIterator LayerImage::lowerBound(frame_t frame) const
+{
+  return std::lower_bound(m_cels.begin(), m_cels.end(), frame, cel_frame_less);
+}
+
+Cel* LayerImage::cel(frame_t frame) const
+{
+  CelConstIterator it = lowerBound(frame);
+
+  if (it != getCelEnd() && (*it)->frame() == frame)
+    return *it;
+  else
+    return NULL;
 }
 
 void LayerImage::getCels(CelList& cels) const
@@ -157,13 +173,9 @@ void LayerImage::addCel(Cel* cel)
 {
   ASSERT(cel->data() && "The cel doesn't contain CelData");
 
-  CelIterator it = getCelBegin();
-  CelIterator end = getCelEnd();
-
-  for (; it != end; ++it) {
-    if ((*it)->frame() > cel->frame())
-      break;
-  }
+  // Insert the cel after all cels in the same or previous frames.
+  CelIterator it = std::upper_bound(m_cels.begin(), m_cels.end(),
+                                    cel->frame(), frame_cel_less);
 
   m_cels.insert(it, cel);
 
@@ -178,7 +190,7 @@ void LayerImage::addCel(Cel* cel)
  */
 void LayerImage::removeCel(Cel* cel)
 {
-  CelIterator it = std::find(m_cels.begin(), m_cels.end(), cel);
+  CelIterator it = std::find(lowerBound(cel->frame()), m_cels.end(), cel);
 
   ASSERT(it != m_cels.end());
 
@@ -137,7 +137,13 @@ namespace doc {
   private:
     void destroyAllCels();
 
-    CelList m_cels;   // List of all cels inside this layer used by frames.
+    // Returns the first cel with a frame >= than the given one.
+    CelIterator lowerBound(frame_t frame);
+    CelConstIterator lowerBound(frame_t frame) const;
+
+    // List of all cels inside this layer used by frames. It's sorted
+    // by frame so we can find a cel with a binary search.
+    CelList m_cels;
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -10,17 +10,33 @@
 
 #include "doc/object.h"
 
-#include "base/mutex.h"
-#include "base/scoped_lock.h"
-
-#include <map>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 namespace doc {
 
-static base::mutex mutex;
-static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map works best.
-static std::map<ObjectId, Object*> objects;
+// The registry of objects is divided in shards, each one with its
+// own mutex and hash table. IDs are consecutive, so objects created
+// at the same time (e.g. from different threads) use different
+// shards and don't block each other.
+static const int kShards = 64;
+
+struct Shard {
+  std::mutex mutex;
+  std::unordered_map<ObjectId, Object*> objects;
+
+  // Avoid false sharing between mutexes of contiguous shards
+  char padding[64];
+};
+
+static Shard shards[kShards];
+static std::atomic<ObjectId> newId(0);
+
+static inline Shard& shard_of(ObjectId id)
+{
+  return shards[id & (kShards-1)];
+}
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -52,30 +68,34 @@ const ObjectId Object::id() const
   // The first time the ID is request, we store the object in the
   // "objects" hash table.
   if (!m_id) {
-    base::scoped_unlock hold(mutex);
-    m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    ObjectId id = ++newId;
+    Shard& shard = shard_of(id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.objects.insert(std::make_pair(id, const_cast<Object*>(this)));
+    m_id = id;
   }
   return m_id;
 }
 
 void Object::setId(ObjectId id)
 {
-  base::scoped_unlock hold(mutex);
-
   if (m_id) {
-    auto it = objects.find(m_id);
-    ASSERT(it != objects.end());
+    Shard& shard = shard_of(m_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto it = shard.objects.find(m_id);
+    ASSERT(it != shard.objects.end());
     ASSERT(it->second == this);
-    if (it != objects.end())
-      objects.erase(it);
+    if (it != shard.objects.end())
+      shard.objects.erase(it);
   }
 
   m_id = id;
 
   if (m_id) {
-    ASSERT(objects.find(m_id) == objects.end());
-    objects.insert(std::make_pair(m_id, this));
+    Shard& shard = shard_of(m_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    ASSERT(shard.objects.find(m_id) == shard.objects.end());
+    shard.objects.insert(std::make_pair(m_id, this));
   }
 }
 
@@ -86,9 +106,10 @@ void Object::setVersion(ObjectVersion version)
 
 Object* get_object(ObjectId id)
 {
-  base::scoped_unlock hold(mutex);
-  auto it = objects.find(id);
-  if (it != objects.end())
+  Shard& shard = shard_of(id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  auto it = shard.objects.find(id);
+  if (it != shard.objects.end())
     return it->second;
   else
     return nullptr;
@@ -0,0 +1,178 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/chrono.h"
+#include "doc/object.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(Object, IdsAreUnique)
+{
+  Object a(ObjectType::Image);
+  Object b(ObjectType::Image);
+  Object c(a);
+
+  EXPECT_NE(NullId, a.id());
+  EXPECT_NE(a.id(), b.id());
+  EXPECT_NE(a.id(), c.id());
+  EXPECT_NE(b.id(), c.id());
+}
+
+TEST(Object, GetObject)
+{
+  ObjectId id;
+  {
+    Object a(ObjectType::Mask);
+    id = a.id();
+    EXPECT_EQ(&a, get_object(id));
+  }
+  EXPECT_EQ(nullptr, get_object(id));
+  EXPECT_EQ(nullptr, get_object(NullId));
+}
+
+TEST(Object, SetId)
+{
+  Object a(ObjectType::Cel);
+  ObjectId oldId = a.id();
+  ObjectId newId = oldId + 1000000;
+
+  a.setId(newId);
+  EXPECT_EQ(newId, a.id());
+  EXPECT_EQ(&a, get_object(newId));
+  EXPECT_EQ(nullptr, get_object(oldId));
+
+  a.setId(oldId);
+  EXPECT_EQ(&a, get_object(oldId));
+  EXPECT_EQ(nullptr, get_object(newId));
+}
+
+TEST(Object, CreateFromThreads)
+{
+  const int nthreads = 8;
+  const int nobjects = 1000;
+
+  std::vector<std::vector<ObjectId> > ids(nthreads);
+  std::vector<std::thread> threads;
+  std::vector<std::unique_ptr<Object> > objects(nthreads*nobjects);
+
+  for (int t=0; t<nthreads; ++t) {
+    threads.push_back(std::thread([&, t]{
+          for (int i=0; i<nobjects; ++i) {
+            Object* obj = new Object(ObjectType::Image);
+            objects[t*nobjects+i].reset(obj);
+            ids[t].push_back(obj->id());
+
+            // Destroy some of them
+            if ((i % 3) == 0)
+              objects[t*nobjects+i].reset();
+          }
+        }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  std::vector<ObjectId> all;
+  for (int t=0; t<nthreads; ++t) {
+    for (int i=0; i<nobjects; ++i) {
+      ObjectId id = ids[t][i];
+      EXPECT_EQ(objects[t*nobjects+i].get(), get_object(id));
+      all.push_back(id);
+    }
+  }
+
+  std::sort(all.begin(), all.end());
+  EXPECT_TRUE(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
+
+// Benchmarks of the objects registry. The bounds are generous, they
+// only catch a registry that serializes all threads or doesn't scale
+// with the number of objects.
+
+static double create_destroy_time(int nthreads, int total)
+{
+  base::Chrono chrono;
+  std::vector<std::thread> threads;
+  for (int t=0; t<nthreads; ++t) {
+    threads.push_back(std::thread([nthreads, total]{
+          for (int i=0; i<total/nthreads; ++i) {
+            Object obj(ObjectType::Image);
+            obj.id();
+          }
+        }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+  return chrono.elapsed();
+}
+
+TEST(Object, CreateDestroyBenchmark)
+{
+  const int total = 200000;
+  double t1 = create_destroy_time(1, total);
+
+  for (int nthreads=1; nthreads<=16; nthreads*=2) {
+    double t = create_destroy_time(nthreads, total);
+    std::printf("%2d threads: %.3f s, %.2f M objects/s\n",
+                nthreads, t, total / t / 1000000.0);
+
+    // Creating the same number of objects from more threads must not
+    // be much slower than from one thread.
+    EXPECT_LT(t, t1 * 4) << nthreads << " threads";
+  }
+}
+
+static double time_per_lookup(int nobjects)
+{
+  const int lookups = 1000000;
+
+  std::vector<std::unique_ptr<Object> > objects;
+  std::vector<ObjectId> ids;
+  for (int i=0; i<nobjects; ++i) {
+    objects.push_back(std::unique_ptr<Object>(new Object(ObjectType::Image)));
+    ids.push_back(objects.back()->id());
+  }
+
+  base::Chrono chrono;
+  std::size_t found = 0;
+  for (int i=0; i<lookups; ++i) {
+    if (get_object(ids[(std::size_t(i)*7919) % nobjects]))
+      ++found;
+  }
+  double t = chrono.elapsed() / lookups;
+  EXPECT_EQ(std::size_t(lookups), found);
+  return t;
+}
+
+TEST(Object, LookupBenchmark)
+{
+  double small = time_per_lookup(1000);
+  double big = time_per_lookup(100000);
+
+  std::printf("get_object(): %.1f ns with 1000 objects, %.1f ns with 100000 objects\n",
+              small * 1e9, big * 1e9);
+
+  // A linear search would be ~100 times slower. A hash table is
+  // slower only because of cache misses (~10 times in some machines).
+  EXPECT_LT(big / small, 25.0);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
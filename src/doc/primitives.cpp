@@ -16,9 +16,13 @@
 #include "doc/image.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
+#include "gfx/region.h"
 
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 
 namespace doc {
 
@@ -330,4 +334,149 @@ int count_diff_between_images(const Image* i1, const Image* i2)
   return -1;
 }
 
+namespace {
+
+// Minimum number of equal pixels between two modified spans of the
+// same row to keep them as two different rectangles.
+const int kMinDiffGap = 8;
+
+struct DiffSpan {
+  int x, w;
+  int rect;                     // Index of the rectangle that contains the span
+};
+
+typedef std::vector<DiffSpan> DiffSpans;
+
+template<typename DiffFunc>
+void add_diff_spans(int x, int w, DiffFunc isDiff, DiffSpans& spans)
+{
+  int i = 0;
+  while (i < w) {
+    while (i < w && !isDiff(i))
+      ++i;
+    if (i == w)
+      break;
+
+    int start = i;
+    int end = ++i;
+    while (i < w && i-end < kMinDiffGap) {
+      if (isDiff(i))
+        end = i+1;
+      ++i;
+    }
+
+    DiffSpan span = { x+start, end-start, -1 };
+    spans.push_back(span);
+  }
+}
+
+template<typename ImageTraits>
+void get_row_diff_spans(const Image* i1, const Image* i2, int x, int y, int w, DiffSpans& spans)
+{
+  typedef typename ImageTraits::const_address_t const_address_t;
+  const_address_t p1 = (const_address_t)i1->getPixelAddress(x, y);
+  const_address_t p2 = (const_address_t)i2->getPixelAddress(x, y);
+
+  // Fast path for rows without changes
+  if (std::memcmp(p1, p2, ImageTraits::getRowStrideBytes(w)) == 0)
+    return;
+
+  add_diff_spans(x, w, [p1, p2](int i){ return p1[i] != p2[i]; }, spans);
+}
+
+template<>
+void get_row_diff_spans<BitmapTraits>(const Image* i1, const Image* i2, int x, int y, int w, DiffSpans& spans)
+{
+  add_diff_spans(
+    x, w,
+    [i1, i2, x, y](int i){
+      return (get_pixel_fast<BitmapTraits>(i1, x+i, y) !=
+              get_pixel_fast<BitmapTraits>(i2, x+i, y));
+    }, spans);
+}
+
+template<typename ImageTraits>
+void get_diff_region_between_images_templ(const Image* i1, const Image* i2,
+                                          const gfx::Region& region,
+                                          gfx::Region& result)
+{
+  std::vector<gfx::Rect> rects;
+  DiffSpans prevSpans, spans;
+
+  for (gfx::Rect rc : region) {
+    rc &= i1->bounds();
+    prevSpans.clear();
+
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      spans.clear();
+      get_row_diff_spans<ImageTraits>(i1, i2, rc.x, y, rc.w, spans);
+
+      // Spans equal to the ones in the previous row extend the same
+      // rectangle.
+      auto prev = prevSpans.begin();
+      for (DiffSpan& span : spans) {
+        while (prev != prevSpans.end() && prev->x < span.x)
+          ++prev;
+
+        if (prev != prevSpans.end() && prev->x == span.x && prev->w == span.w) {
+          span.rect = prev->rect;
+          ++rects[span.rect].h;
+        }
+        else {
+          span.rect = int(rects.size());
+          rects.push_back(gfx::Rect(span.x, y, span.w, 1));
+        }
+      }
+
+      prevSpans.swap(spans);
+    }
+  }
+
+  for (const gfx::Rect& rc : rects)
+    result.createUnion(result, gfx::Region(rc));
+}
+
+} // anonymous namespace
+
+void get_diff_region_between_images(const Image* i1, const Image* i2,
+                                    const gfx::Region& region,
+                                    gfx::Region& result)
+{
+  result.clear();
+
+  if ((i1->pixelFormat() != i2->pixelFormat()) ||
+      (i1->width() != i2->width()) ||
+      (i1->height() != i2->height())) {
+    result = region;
+    return;
+  }
+
+  switch (i1->pixelFormat()) {
+    case IMAGE_RGB:       get_diff_region_between_images_templ<RgbTraits>(i1, i2, region, result); break;
+    case IMAGE_GRAYSCALE: get_diff_region_between_images_templ<GrayscaleTraits>(i1, i2, region, result); break;
+    case IMAGE_INDEXED:   get_diff_region_between_images_templ<IndexedTraits>(i1, i2, region, result); break;
+    case IMAGE_BITMAP:    get_diff_region_between_images_templ<BitmapTraits>(i1, i2, region, result); break;
+  }
+}
+
+uint64_t calculate_image_hash(const Image* image)
+{
+  // 64-bit FNV-1a
+  const uint64_t prime = 1099511628211ULL;
+  uint64_t hash = 14695981039346656037ULL;
+
+  hash = (hash ^ image->pixelFormat()) * prime;
+  hash = (hash ^ image->width()) * prime;
+  hash = (hash ^ image->height()) * prime;
+
+  int rowBytes = calculate_rowstride_bytes(image->pixelFormat(), image->width());
+  for (int y=0; y<image->height(); ++y) {
+    const uint8_t* p = image->getPixelAddress(0, y);
+    for (int i=0; i<rowBytes; ++i, ++p)
+      hash = (hash ^ *p) * prime;
+  }
+
+  return hash;
+}
+
 } // namespace doc
@@ -39,6 +39,18 @@ namespace doc {
 
   int count_diff_between_images(const Image* i1, const Image* i2);
 
+  // Returns in "result" the parts of "region" where the pixels of
+  // both images are different. Close modified spans of the same row
+  // are joined in one rectangle. If the images have different
+  // format or size, the whole region is returned.
+  void get_diff_region_between_images(const Image* i1, const Image* i2,
+                                      const gfx::Region& region,
+                                      gfx::Region& result);
+
+  // Returns a hash of the image pixels. Images with the same pixel
+  // format, size, and pixels have the same hash.
+  uint64_t calculate_image_hash(const Image* image);
+
 } // namespace doc
 
 #endif
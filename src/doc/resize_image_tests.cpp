@@ -10,11 +10,15 @@
 
 #include <gtest/gtest.h>
 
+#include "base/unique_ptr.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/color.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
 
+#include <cmath>
+#include <cstdlib>
+
 using namespace std;
 using namespace doc;
 
@@ -77,6 +81,155 @@ TEST(ResizeImage, NearestNeighborInterp)
   ASSERT_EQ(0, count_diff_between_images(dst, dst_expected));
 }
 
+// Per-pixel implementation of the nearest neighbor method used to
+// check that the optimized version gives the same result.
+static void resize_nearest_reference(const Image* src, Image* dst)
+{
+  int o_width = src->width(), o_height = src->height();
+  int n_width = dst->width(), n_height = dst->height();
+  double x_ratio = o_width / (double)n_width;
+  double y_ratio = o_height / (double)n_height;
+
+  for (int y = 0; y < n_height; y++) {
+    for (int x = 0; x < n_width; x++) {
+      double px = floor(x * x_ratio);
+      double py = floor(y * y_ratio);
+      int i = (int)(py * o_width + px);
+      dst->putPixel(x, y, src->getPixel(i % o_width, i / o_width));
+    }
+  }
+}
+
+static Image* create_random_image(PixelFormat format, int w, int h)
+{
+  Image* image = Image::create(format, w, h);
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x) {
+      color_t c = (color_t(std::rand() & 0xffff) << 16) | color_t(std::rand() & 0xffff);
+      switch (format) {
+        case IMAGE_GRAYSCALE: c &= 0xffff; break;
+        case IMAGE_INDEXED: c &= 0xff; break;
+        case IMAGE_BITMAP: c &= 1; break;
+        default: break;
+      }
+      image->putPixel(x, y, c);
+    }
+  return image;
+}
+
+TEST(ResizeImage, NearestNeighborSameAsReference)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  std::srand(1);
+
+  for (PixelFormat format : formats) {
+    for (int c=0; c<50; ++c) {
+      int sw = 1 + std::rand() % 40;
+      int sh = 1 + std::rand() % 40;
+      int dw = 1 + std::rand() % 100;
+      int dh = 1 + std::rand() % 100;
+
+      base::UniquePtr<Image> src(create_random_image(format, sw, sh));
+      base::UniquePtr<Image> dst(Image::create(format, dw, dh));
+      base::UniquePtr<Image> expected(Image::create(format, dw, dh));
+      dst->clear(0);
+      expected->clear(0);
+
+      algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR, NULL, NULL);
+      resize_nearest_reference(src, expected);
+
+      ASSERT_EQ(0, count_diff_between_images(dst, expected))
+        << "Format " << format << " " << sw << "x" << sh << " -> " << dw << "x" << dh;
+    }
+  }
+}
+
+// Floating point bilinear interpolation to check the fixed point
+// version.
+static color_t bilinear_reference(const Image* src, int dw, int dh, int x, int y)
+{
+  double u = (dw > 1 ? x * (src->width()-1) / double(dw-1): 0.0);
+  double v = (dh > 1 ? y * (src->height()-1) / double(dh-1): 0.0);
+  int u0 = std::min(int(u), src->width()-1);
+  int v0 = std::min(int(v), src->height()-1);
+  int u1 = std::min(u0+1, src->width()-1);
+  int v1 = std::min(v0+1, src->height()-1);
+  double fu = u - u0;
+  double fv = v - v0;
+
+  color_t c[4] = {
+    src->getPixel(u0, v0), src->getPixel(u1, v0),
+    src->getPixel(u0, v1), src->getPixel(u1, v1)
+  };
+
+  color_t result = 0;
+  for (int shift=0; shift<32; shift+=8) {
+    double k =
+      (((c[0] >> shift) & 0xff)*(1-fu) + ((c[1] >> shift) & 0xff)*fu)*(1-fv) +
+      (((c[2] >> shift) & 0xff)*(1-fu) + ((c[3] >> shift) & 0xff)*fu)*fv;
+    result |= color_t(int(k)) << shift;
+  }
+  return result;
+}
+
+TEST(ResizeImage, BilinearRgbCloseToReference)
+{
+  std::srand(2);
+
+  for (int c=0; c<20; ++c) {
+    int sw = 1 + std::rand() % 30;
+    int sh = 1 + std::rand() % 30;
+    int dw = 1 + std::rand() % 90;
+    int dh = 1 + std::rand() % 90;
+
+    base::UniquePtr<Image> src(create_random_image(IMAGE_RGB, sw, sh));
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, dw, dh));
+    algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_BILINEAR, NULL, NULL);
+
+    for (int y=0; y<dh; ++y) {
+      for (int x=0; x<dw; ++x) {
+        color_t a = dst->getPixel(x, y);
+        color_t b = bilinear_reference(src, dw, dh, x, y);
+        for (int shift=0; shift<32; shift+=8)
+          ASSERT_NEAR(int((b >> shift) & 0xff), int((a >> shift) & 0xff), 2)
+            << "Pixel " << x << "," << y << " of " << sw << "x" << sh << " -> " << dw << "x" << dh;
+      }
+    }
+  }
+}
+
+TEST(ResizeImage, BilinearSameSize)
+{
+  std::srand(3);
+  base::UniquePtr<Image> src(create_random_image(IMAGE_RGB, 31, 17));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 31, 17));
+  algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_BILINEAR, NULL, NULL);
+  EXPECT_EQ(0, count_diff_between_images(src, dst));
+}
+
+TEST(ResizeImage, ResizeRows)
+{
+  algorithm::ResizeMethod methods[] = {
+    algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+    algorithm::RESIZE_METHOD_BILINEAR
+  };
+  std::srand(4);
+
+  for (auto method : methods) {
+    base::UniquePtr<Image> src(create_random_image(IMAGE_RGB, 23, 19));
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 57, 41));
+    base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, 57, 41));
+    dst->clear(0);
+
+    algorithm::resize_image(src, expected, method, NULL, NULL);
+    for (int y=0; y<dst->height(); y+=8)
+      algorithm::resize_image_rows(src, dst, y, std::min(8, dst->height()-y),
+                                   method, NULL, NULL);
+
+    EXPECT_EQ(0, count_diff_between_images(dst, expected));
+  }
+}
+
 #if 0                           // TODO complete this test
 TEST(ResizeImage, BilinearInterpRGBType)
 {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,19 +10,62 @@
 
 #include "doc/rgbmap.h"
 
-#include "doc/color_scales.h"
 #include "doc/palette.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace doc {
 
 #define MAPSIZE 32*32*32
 
+// Value of entries that weren't calculated yet
+static const uint16_t kInvalidEntry = 0xffff;
+
+// If more palette entries than this are modified, the whole map is
+// invalidated instead of checking which entries are affected.
+static const int kMaxPartialInvalidation = 16;
+
+// Weights of each RGB component in the distance between two colors
+// (the same weights used in Palette::findBestfit()).
+static const int weights[3] = { 30, 59, 11 };
+
+static inline void weighted_pos(int r, int g, int b, int pos[3])
+{
+  pos[0] = r * weights[0];
+  pos[1] = g * weights[1];
+  pos[2] = b * weights[2];
+}
+
+static inline void weighted_pos(color_t c, int pos[3])
+{
+  weighted_pos(rgba_getr(c)>>3, rgba_getg(c)>>3, rgba_getb(c)>>3, pos);
+}
+
+static inline int distance(const int a[3], const int b[3])
+{
+  int d0 = a[0] - b[0];
+  int d1 = a[1] - b[1];
+  int d2 = a[2] - b[2];
+  return d0*d0 + d1*d1 + d2*d2;
+}
+
+// Closest entry (or the one with the lowest index if both are at the
+// same distance).
+static inline bool is_closer(int dist, int index, int bestDist, int bestIndex)
+{
+  return (dist < bestDist || (dist == bestDist && index < bestIndex));
+}
+
 RgbMap::RgbMap()
   : Object(ObjectType::RgbMap)
   , m_map(MAPSIZE)
   , m_palette(NULL)
   , m_modifications(0)
+  , m_maskIndex(-1)
 {
+  for (auto& entry : m_map)
+    entry.store(kInvalidEntry, std::memory_order_relaxed);
 }
 
 bool RgbMap::match(const Palette* palette) const
@@ -36,15 +79,88 @@ void RgbMap::regenerate(const Palette* palette, int mask_index)
   m_palette = palette;
   m_modifications = palette->getModifications();
 
+  std::vector<color_t> entries(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    entries[i] = (palette->getEntry(i) & rgba_rgb_mask);
+
+  // Collect the palette entries that are different from the last
+  // regeneration.
+  std::vector<bool> changed(MAX(entries.size(), m_entries.size()), false);
+  int nchanged = 0;
+  for (int i=0; i<int(changed.size()); ++i) {
+    if (i >= int(entries.size()) ||
+        i >= int(m_entries.size()) ||
+        entries[i] != m_entries[i] ||
+        ((i == mask_index) != (i == m_maskIndex))) {
+      changed[i] = true;
+      ++nchanged;
+    }
+  }
+
+  m_entries.swap(entries);
+  m_maskIndex = mask_index;
+
+  if (nchanged == 0)
+    return;
+
+  // Rebuild the k-d tree with all entries except the mask
+  m_tree.clear();
+  for (int i=0; i<int(m_entries.size()); ++i) {
+    if (i != mask_index) {
+      Node node;
+      weighted_pos(m_entries[i], node.pos);
+      node.index = i;
+      node.axis = 0;
+      m_tree.push_back(node);
+    }
+  }
+  buildTree(0, int(m_tree.size()));
+
+  if (nchanged > kMaxPartialInvalidation) {
+    for (auto& entry : m_map)
+      entry.store(kInvalidEntry, std::memory_order_relaxed);
+    return;
+  }
+
+  // Invalidate only the entries that were mapped to a modified
+  // palette entry, or that are closer to a modified palette entry.
+  std::vector<int> newEntries;
+  std::vector<int> newPos;
+  for (int i=0; i<int(m_entries.size()); ++i) {
+    if (changed[i] && i != mask_index) {
+      int pos[3];
+      weighted_pos(m_entries[i], pos);
+      newEntries.push_back(i);
+      newPos.insert(newPos.end(), pos, pos+3);
+    }
+  }
+
   int i = 0;
   for (int r=0; r<32; ++r) {
     for (int g=0; g<32; ++g) {
-      for (int b=0; b<32; ++b) {
-        m_map[i++] =
-          palette->findBestfit(
-            scale_5bits_to_8bits(r),
-            scale_5bits_to_8bits(g),
-            scale_5bits_to_8bits(b), mask_index);
+      for (int b=0; b<32; ++b, ++i) {
+        int index = m_map[i].load(std::memory_order_relaxed);
+        if (index == kInvalidEntry)
+          continue;
+
+        // Entries mapped to the mask index are the result of palettes
+        // without other entries.
+        if (changed[index] || index == mask_index) {
+          m_map[i].store(kInvalidEntry, std::memory_order_relaxed);
+          continue;
+        }
+
+        int pos[3], entryPos[3];
+        weighted_pos(r, g, b, pos);
+        weighted_pos(m_entries[index], entryPos);
+        int dist = distance(pos, entryPos);
+
+        for (int j=0; j<int(newEntries.size()); ++j) {
+          if (is_closer(distance(pos, &newPos[j*3]), newEntries[j], dist, index)) {
+            m_map[i].store(kInvalidEntry, std::memory_order_relaxed);
+            break;
+          }
+        }
       }
     }
   }
@@ -55,7 +171,90 @@ int RgbMap::mapColor(int r, int g, int b) const
   ASSERT(r >= 0 && r < 256);
   ASSERT(g >= 0 && g < 256);
   ASSERT(b >= 0 && b < 256);
-  return m_map[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+
+  std::atomic<uint16_t>& entry = m_map[(r << 10) + (g << 5) + b];
+  int index = entry.load(std::memory_order_relaxed);
+  if (index == kInvalidEntry) {
+    index = findBestfit(r, g, b);
+    entry.store(index, std::memory_order_relaxed);
+  }
+  return index;
+}
+
+void RgbMap::buildTree(int begin, int end)
+{
+  if (end - begin < 2)
+    return;
+
+  // Split by the axis with the largest extent
+  int minPos[3], maxPos[3];
+  std::copy(m_tree[begin].pos, m_tree[begin].pos+3, minPos);
+  std::copy(m_tree[begin].pos, m_tree[begin].pos+3, maxPos);
+  for (int i=begin+1; i<end; ++i) {
+    for (int a=0; a<3; ++a) {
+      minPos[a] = MIN(minPos[a], m_tree[i].pos[a]);
+      maxPos[a] = MAX(maxPos[a], m_tree[i].pos[a]);
+    }
+  }
+
+  int axis = 0;
+  for (int a=1; a<3; ++a)
+    if (maxPos[a] - minPos[a] > maxPos[axis] - minPos[axis])
+      axis = a;
+
+  int mid = (begin + end) / 2;
+  std::nth_element(
+    m_tree.begin()+begin, m_tree.begin()+mid, m_tree.begin()+end,
+    [axis](const Node& a, const Node& b) {
+      return a.pos[axis] < b.pos[axis];
+    });
+  m_tree[mid].axis = axis;
+
+  buildTree(begin, mid);
+  buildTree(mid+1, end);
+}
+
+void RgbMap::findNearest(int begin, int end, const int pos[3],
+                         int& bestIndex, int& bestDist) const
+{
+  if (begin >= end)
+    return;
+
+  int mid = (begin + end) / 2;
+  const Node& node = m_tree[mid];
+
+  int dist = distance(pos, node.pos);
+  if (is_closer(dist, node.index, bestDist, bestIndex)) {
+    bestIndex = node.index;
+    bestDist = dist;
+  }
+
+  int delta = pos[node.axis] - node.pos[node.axis];
+  if (delta < 0) {
+    findNearest(begin, mid, pos, bestIndex, bestDist);
+    if (delta*delta <= bestDist)
+      findNearest(mid+1, end, pos, bestIndex, bestDist);
+  }
+  else {
+    findNearest(mid+1, end, pos, bestIndex, bestDist);
+    if (delta*delta <= bestDist)
+      findNearest(begin, mid, pos, bestIndex, bestDist);
+  }
+}
+
+int RgbMap::findBestfit(int r, int g, int b) const
+{
+  int pos[3];
+  weighted_pos(r, g, b, pos);
+
+  int bestIndex = 0;
+  int bestDist = std::numeric_limits<int>::max();
+  findNearest(0, int(m_tree.size()), pos, bestIndex, bestDist);
+  return bestIndex;
 }
 
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -9,14 +9,22 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "doc/color.h"
 #include "doc/object.h"
 
+#include <atomic>
 #include <vector>
 
 namespace doc {
 
   class Palette;
 
+  // Maps RGB colors (with 5 bits per component) to the closest
+  // palette entries (the same entry as Palette::findBestfit()).
+  //
+  // Entries are calculated on demand (mapColor() can be called from
+  // several threads), and regenerate() only invalidates the entries
+  // affected by the palette entries that were modified.
   class RgbMap : public Object {
   public:
     RgbMap();
@@ -27,9 +35,25 @@ namespace doc {
     int mapColor(int r, int g, int b) const;
 
   private:
-    std::vector<uint8_t> m_map;
+    // Node of the k-d tree with palette entries. The tree is stored
+    // in a vector where each node is the median of its subtree range.
+    struct Node {
+      int pos[3];               // Weighted 5-bit RGB components
+      int index;                // Palette entry
+      int axis;                 // Splitting axis of this node
+    };
+
+    void buildTree(int begin, int end);
+    void findNearest(int begin, int end, const int pos[3],
+                     int& bestIndex, int& bestDist) const;
+    int findBestfit(int r, int g, int b) const;
+
+    mutable std::vector<std::atomic<uint16_t> > m_map;
+    std::vector<color_t> m_entries;
+    std::vector<Node> m_tree;
     const Palette* m_palette;
     int m_modifications;
+    int m_maskIndex;
 
     DISABLE_COPYING(RgbMap);
   };
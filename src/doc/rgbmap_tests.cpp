@@ -0,0 +1,172 @@
+// Aseprite Document Library
+// Copyright (c) 2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/chrono.h"
+#include "doc/color_scales.h"
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace doc;
+
+static void expect_same_as_bestfit(const RgbMap& rgbmap, const Palette& pal, int mask_index)
+{
+  for (int r=0; r<32; ++r) {
+    for (int g=0; g<32; ++g) {
+      for (int b=0; b<32; ++b) {
+        int R = scale_5bits_to_8bits(r);
+        int G = scale_5bits_to_8bits(g);
+        int B = scale_5bits_to_8bits(b);
+        ASSERT_EQ(pal.findBestfit(R, G, B, mask_index),
+                  rgbmap.mapColor(R, G, B))
+          << "r=" << R << " g=" << G << " b=" << B;
+      }
+    }
+  }
+}
+
+static color_t random_color()
+{
+  return rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, 255);
+}
+
+TEST(RgbMap, MatchesBestfit)
+{
+  std::srand(1);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, random_color());
+  // Duplicated entries (the first one must be used)
+  pal.setEntry(200, pal.getEntry(100));
+  pal.setEntry(10, pal.getEntry(50));
+
+  for (int mask_index=-1; mask_index<=50; mask_index+=51) {
+    RgbMap rgbmap;
+    rgbmap.regenerate(&pal, mask_index);
+    EXPECT_TRUE(rgbmap.match(&pal));
+    expect_same_as_bestfit(rgbmap, pal, mask_index);
+  }
+}
+
+TEST(RgbMap, SmallPalettes)
+{
+  Palette pal(frame_t(0), 1);
+  pal.setEntry(0, rgba(255, 0, 0, 255));
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+
+  // All entries are the mask
+  rgbmap.regenerate(&pal, 0);
+  expect_same_as_bestfit(rgbmap, pal, 0);
+
+  pal.addEntry(rgba(0, 0, 255, 255));
+  EXPECT_FALSE(rgbmap.match(&pal));
+  rgbmap.regenerate(&pal, 0);
+  expect_same_as_bestfit(rgbmap, pal, 0);
+}
+
+TEST(RgbMap, PaletteChanges)
+{
+  std::srand(2);
+
+  Palette pal(frame_t(0), 32);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, random_color());
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal, 0);
+  expect_same_as_bestfit(rgbmap, pal, 0);
+
+  // Modify one entry, then a few entries, then a lot of entries
+  for (int n : { 1, 3, 8, 20, 32 }) {
+    for (int i=0; i<n; ++i)
+      pal.setEntry(std::rand() % pal.size(), random_color());
+
+    EXPECT_FALSE(rgbmap.match(&pal));
+    rgbmap.regenerate(&pal, 0);
+    expect_same_as_bestfit(rgbmap, pal, 0);
+  }
+
+  // Change the mask index
+  rgbmap.regenerate(&pal, 5);
+  expect_same_as_bestfit(rgbmap, pal, 5);
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+
+  // Add and remove entries
+  pal.addEntry(random_color());
+  pal.addEntry(random_color());
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+
+  pal.resize(10);
+  rgbmap.regenerate(&pal, -1);
+  expect_same_as_bestfit(rgbmap, pal, -1);
+}
+
+TEST(RgbMap, Benchmark)
+{
+  std::srand(3);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, random_color());
+
+  // Old way: calculate all entries with findBestfit()
+  base::Chrono chrono;
+  int sum = 0;
+  for (int r=0; r<32; ++r)
+    for (int g=0; g<32; ++g)
+      for (int b=0; b<32; ++b)
+        sum += pal.findBestfit(r<<3, g<<3, b<<3, -1);
+  double bestfitTime = chrono.elapsed();
+
+  RgbMap rgbmap;
+  chrono.reset();
+  rgbmap.regenerate(&pal, -1);
+  for (int r=0; r<32; ++r)
+    for (int g=0; g<32; ++g)
+      for (int b=0; b<32; ++b)
+        sum -= rgbmap.mapColor(r<<3, g<<3, b<<3);
+  double rgbmapTime = chrono.elapsed();
+  EXPECT_EQ(0, sum);
+
+  // Modify one entry and map all colors again
+  pal.setEntry(128, random_color());
+  chrono.reset();
+  rgbmap.regenerate(&pal, -1);
+  for (int r=0; r<32; ++r)
+    for (int g=0; g<32; ++g)
+      for (int b=0; b<32; ++b)
+        rgbmap.mapColor(r<<3, g<<3, b<<3);
+  double editTime = chrono.elapsed();
+
+  std::printf("findBestfit %.2f ms, RgbMap %.2f ms, RgbMap after one entry change %.2f ms\n",
+              bestfitTime*1000.0, rgbmapTime*1000.0, editTime*1000.0);
+
+  // Colors are mapped lazily, so mapping all colors with the RgbMap
+  // cannot be slower than calling findBestfit() for each color.
+  // Changing one entry must not recalculate the whole table.
+  EXPECT_LT(rgbmapTime, bestfitTime);
+  EXPECT_LT(editTime, rgbmapTime);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,12 +10,16 @@
 
 #include <gtest/gtest.h>
 
+#include "base/chrono.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/layer.h"
 #include "doc/pixel_format.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
+#include <cstdio>
+
 using namespace doc;
 
 // lay1 = A _ B
@@ -101,6 +105,97 @@ TEST(Sprite, CelsRange)
   EXPECT_EQ(2, i);
 }
 
+// Cels are kept sorted by frame, so LayerImage::cel() must be able to
+// find any cel (or the lack of it) without walking the whole list.
+TEST(Sprite, CelLookup)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 4, 4, 256);
+  spr->setTotalFrames(frame_t(64));
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  // Add cels in odd frames in reverse order
+  ImageRef img(Image::create(IMAGE_RGB, 4, 4));
+  for (frame_t f=63; f>=0; --f)
+    if (f & 1)
+      lay->addCel(new Cel(f, img));
+
+  frame_t prev = -1;
+  for (CelIterator it=lay->getCelBegin(), end=lay->getCelEnd(); it!=end; ++it) {
+    EXPECT_LT(prev, (*it)->frame());
+    prev = (*it)->frame();
+  }
+
+  for (frame_t f=0; f<64; ++f) {
+    Cel* cel = lay->cel(f);
+    if (f & 1) {
+      ASSERT_TRUE(cel != NULL);
+      EXPECT_EQ(f, cel->frame());
+    }
+    else
+      EXPECT_EQ(NULL, cel);
+  }
+
+  Cel* cel = lay->cel(frame_t(5));
+  lay->moveCel(cel, frame_t(6));
+  EXPECT_EQ(NULL, lay->cel(frame_t(5)));
+  EXPECT_EQ(cel, lay->cel(frame_t(6)));
+  EXPECT_EQ(lay->cel(frame_t(7)), *(std::find(lay->getCelBegin(), lay->getCelEnd(), cel)+1));
+
+  lay->removeCel(cel);
+  EXPECT_EQ(NULL, lay->cel(frame_t(6)));
+  EXPECT_EQ(31, lay->getCelsCount());
+  delete cel;
+
+  delete spr;
+}
+
+// Benchmark: the time per lookup must grow logarithmically with the
+// number of cels in the layer (as in Render, frames are visited in
+// order).
+static double time_per_cel_lookup(frame_t nframes)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 4, 4, 256);
+  spr->setTotalFrames(nframes);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  ImageRef img(Image::create(IMAGE_RGB, 4, 4));
+  for (frame_t f=0; f<nframes; ++f)
+    lay->addCel(new Cel(f, img));
+
+  const int lookups = 1000000;
+  int found = 0;
+  frame_t frame = 0;
+  base::Chrono chrono;
+  for (int i=0; i<lookups; ++i) {
+    if (lay->cel(frame))
+      ++found;
+    frame = (frame + 1) % nframes;
+  }
+  double t = chrono.elapsed() / lookups;
+
+  EXPECT_EQ(lookups, found);
+  delete spr;
+  return t;
+}
+
+TEST(Sprite, CelLookupBenchmark)
+{
+  double small = time_per_cel_lookup(frame_t(100));
+  double big = time_per_cel_lookup(frame_t(25600));
+
+  std::printf("Cel lookup: %.2f ns with 100 frames, %.2f ns with 25600 frames\n",
+              small * 1e9, big * 1e9);
+
+  // A linear search would be ~256 times slower, a binary search
+  // should be ~2 times slower (plus cache misses, up to ~10 times in
+  // some machines).
+  EXPECT_LT(big / small, 32.0);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -30,6 +30,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool canApplyInParallel() { return true; }
 
   private:
     ColorCurve* m_curve;
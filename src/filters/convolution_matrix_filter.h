@@ -34,6 +34,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool canApplyInParallel() { return true; }
 
   private:
     base::SharedPtr<ConvolutionMatrix> m_matrix;
@@ -38,6 +38,12 @@ namespace filters {
     // each pixel.
     virtual void applyToIndexed(FilterManager* filterMgr) = 0;
 
+    // Returns true if the applyTo*() member functions can be called
+    // from several threads at the same time, each one with its own
+    // FilterManager (i.e. for different rows of the image). Filters
+    // must not modify their own state to apply them in that case.
+    virtual bool canApplyInParallel() { return false; }
+
   };
 
 } // namespace filters
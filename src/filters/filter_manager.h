@@ -24,6 +24,10 @@ namespace filters {
   // colors from getSourceAddress(), applies some kind of transformation
   // to that color, and save the result in getDestinationAddress().
   // This process must be repeated getWidth() times.
+  //
+  // If the Filter can be applied in parallel, each thread uses its own
+  // FilterManager instance (with its own row, addresses, and mask
+  // iterator).
   class FilterManager {
   public:
     virtual ~FilterManager() { }
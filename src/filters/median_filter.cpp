@@ -11,89 +11,204 @@
 
 #include "filters/median_filter.h"
 
-#include "base/memory.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
-#include "filters/neighboring_pixels.h"
 #include "filters/tiled_mode.h"
 #include "doc/image.h"
 #include "doc/palette.h"
-#include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace filters {
 
 using namespace doc;
 
 namespace {
-  struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+  // Returns the position of the source pixel for the given
+  // coordinate, clamping it or wrapping it (in tiled mode) when it's
+  // outside the image.
+  inline int get_coord(int c, int size, bool tiled)
+  {
+    if (c < 0)
+      return (tiled ? size - (-(c+1) % size) - 1: 0);
+    else if (c >= size)
+      return (tiled ? c % size: size-1);
+    else
+      return c;
+  }
+
+  // Histogram of the values of one channel inside the matrix. The
+  // coarse level (16 bins) is used to find the median without
+  // walking all the 256 fine bins.
+  class Histogram {
+  public:
+    Histogram() {
+      std::fill(m_coarse, m_coarse+16, 0);
+      std::fill(m_fine, m_fine+256, 0);
+    }
+
+    void add(int value, int delta) {
+      m_coarse[value >> 4] += delta;
+      m_fine[value] += delta;
+    }
+
+    // Returns the value that would be in the given index if all
+    // values were sorted.
+    int getValueAt(int index) const {
+      int i = 0;
+      for (; i<15 && index >= m_coarse[i]; ++i)
+        index -= m_coarse[i];
 
-    void reset() { c = 0; }
+      int value = i << 4;
+      for (; value<255 && index >= m_fine[value]; ++value)
+        index -= m_fine[value];
 
-    void operator()(RgbTraits::pixel_t color)
-    {
-      channel[0][c] = rgba_getr(color);
-      channel[1][c] = rgba_getg(color);
-      channel[2][c] = rgba_getb(color);
-      channel[3][c] = rgba_geta(color);
-      c++;
+      return value;
     }
+
+  private:
+    int m_coarse[16];
+    int m_fine[256];
   };
 
-  struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+  struct ChannelsRgba {
+    typedef RgbTraits Traits;
+    Target target;
 
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    ChannelsRgba(Target target) : target(target) { }
 
-    void reset() { c = 0; }
+    void add(Histogram* hist, RgbTraits::pixel_t color, int delta) {
+      if (target & TARGET_RED_CHANNEL)   hist[0].add(rgba_getr(color), delta);
+      if (target & TARGET_GREEN_CHANNEL) hist[1].add(rgba_getg(color), delta);
+      if (target & TARGET_BLUE_CHANNEL)  hist[2].add(rgba_getb(color), delta);
+      if (target & TARGET_ALPHA_CHANNEL) hist[3].add(rgba_geta(color), delta);
+    }
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      channel[0][c] = graya_getv(color);
-      channel[1][c] = graya_geta(color);
-      c++;
+    RgbTraits::pixel_t median(const Histogram* hist, int index, RgbTraits::pixel_t color) {
+      return rgba(
+        (target & TARGET_RED_CHANNEL   ? hist[0].getValueAt(index): rgba_getr(color)),
+        (target & TARGET_GREEN_CHANNEL ? hist[1].getValueAt(index): rgba_getg(color)),
+        (target & TARGET_BLUE_CHANNEL  ? hist[2].getValueAt(index): rgba_getb(color)),
+        (target & TARGET_ALPHA_CHANNEL ? hist[3].getValueAt(index): rgba_geta(color)));
     }
   };
 
-  struct GetPixelsDelegateIndexed {
-    const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
+  struct ChannelsGrayscale {
+    typedef GrayscaleTraits Traits;
     Target target;
-    int c;
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
-      : pal(pal), channel(channel), target(target) { }
+    ChannelsGrayscale(Target target) : target(target) { }
+
+    void add(Histogram* hist, GrayscaleTraits::pixel_t color, int delta) {
+      if (target & TARGET_GRAY_CHANNEL)  hist[0].add(graya_getv(color), delta);
+      if (target & TARGET_ALPHA_CHANNEL) hist[1].add(graya_geta(color), delta);
+    }
+
+    GrayscaleTraits::pixel_t median(const Histogram* hist, int index, GrayscaleTraits::pixel_t color) {
+      return graya(
+        (target & TARGET_GRAY_CHANNEL  ? hist[0].getValueAt(index): graya_getv(color)),
+        (target & TARGET_ALPHA_CHANNEL ? hist[1].getValueAt(index): graya_geta(color)));
+    }
+  };
+
+  struct ChannelsIndexed {
+    typedef IndexedTraits Traits;
+    const Palette* pal;
+    const RgbMap* rgbmap;
+    Target target;
 
-    void reset() { c = 0; }
+    ChannelsIndexed(const Palette* pal, const RgbMap* rgbmap, Target target)
+      : pal(pal), rgbmap(rgbmap), target(target) { }
 
-    void operator()(IndexedTraits::pixel_t color)
-    {
+    void add(Histogram* hist, IndexedTraits::pixel_t color, int delta) {
       if (target & TARGET_INDEX_CHANNEL) {
-        channel[0][c] = color;
+        hist[0].add(color, delta);
       }
       else {
-        channel[0][c] = rgba_getr(pal->getEntry(color));
-        channel[1][c] = rgba_getg(pal->getEntry(color));
-        channel[2][c] = rgba_getb(pal->getEntry(color));
+        color_t rgba = pal->getEntry(color);
+        if (target & TARGET_RED_CHANNEL)   hist[0].add(rgba_getr(rgba), delta);
+        if (target & TARGET_GREEN_CHANNEL) hist[1].add(rgba_getg(rgba), delta);
+        if (target & TARGET_BLUE_CHANNEL)  hist[2].add(rgba_getb(rgba), delta);
       }
-      c++;
+    }
+
+    IndexedTraits::pixel_t median(const Histogram* hist, int index, IndexedTraits::pixel_t color) {
+      if (target & TARGET_INDEX_CHANNEL)
+        return hist[0].getValueAt(index);
+
+      color_t rgba = pal->getEntry(color);
+      return rgbmap->mapColor(
+        (target & TARGET_RED_CHANNEL   ? hist[0].getValueAt(index): rgba_getr(rgba)),
+        (target & TARGET_GREEN_CHANNEL ? hist[1].getValueAt(index): rgba_getg(rgba)),
+        (target & TARGET_BLUE_CHANNEL  ? hist[2].getValueAt(index): rgba_getb(rgba)));
     }
   };
-};
+
+  // Applies the median filter to one row using a sliding histogram
+  // (Huang's algorithm): when we move to the next pixel, only the
+  // column that leaves the matrix and the one that enters are
+  // updated, so the cost per pixel doesn't depend on the matrix area.
+  template<typename Channels>
+  void apply_median_to_row(FilterManager* filterMgr,
+                           int width, int height, TiledMode tiledMode,
+                           Channels& channels)
+  {
+    typedef typename Channels::Traits Traits;
+    typedef typename Traits::address_t address_t;
+    typedef typename Traits::const_address_t const_address_t;
+
+    const Image* src = filterMgr->getSourceImage();
+    const bool tiledX = ((int(tiledMode) & int(TiledMode::X_AXIS)) != 0);
+    const bool tiledY = ((int(tiledMode) & int(TiledMode::Y_AXIS)) != 0);
+    const int centerX = width/2;
+    const int centerY = height/2;
+    const int medianIndex = width*height/2;
+    address_t dst_address = (address_t)filterMgr->getDestinationAddress();
+    int x = filterMgr->x();
+    int x2 = x+filterMgr->getWidth();
+    int y = filterMgr->y();
+
+    std::vector<const_address_t> rows(height);
+    for (int v=0; v<height; ++v)
+      rows[v] = (const_address_t)src->getPixelAddress(
+        0, get_coord(y-centerY+v, src->height(), tiledY));
+
+    Histogram hist[4];
+    auto addColumn =
+      [&](int u, int delta) {
+        u = get_coord(u, src->width(), tiledX);
+        for (int v=0; v<height; ++v)
+          channels.add(hist, rows[v][u], delta);
+      };
+
+    for (int u=x-centerX; u<x-centerX+width; ++u)
+      addColumn(u, 1);
+
+    for (; x<x2; ++x) {
+      if (x > filterMgr->x()) {
+        addColumn(x-1-centerX, -1);
+        addColumn(x-centerX+width-1, 1);
+      }
+
+      // Avoid the non-selected region
+      if (filterMgr->skipPixel()) {
+        ++dst_address;
+        continue;
+      }
+
+      *(dst_address++) = channels.median(hist, medianIndex, rows[centerY][x]);
+    }
+  }
+
+}
 
 MedianFilter::MedianFilter()
   : m_tiledMode(TiledMode::NONE)
   , m_width(0)
   , m_height(0)
-  , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -106,10 +221,6 @@ void MedianFilter::setSize(int width, int height)
 {
   m_width = width;
   m_height = height;
-  m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -119,158 +230,23 @@ const char* MedianFilter::getName()
 
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  Target target = filterMgr->getTarget();
-  int color;
-  int r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
-  int x = filterMgr->x();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->y();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
-
-    color = get_pixel_fast<RgbTraits>(src, x, y);
-
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
-    else
-      r = rgba_getr(color);
-
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
-    else
-      g = rgba_getg(color);
-
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
-    else
-      b = rgba_getb(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
-    else
-      a = rgba_geta(color);
-
-    *(dst_address++) = rgba(r, g, b, a);
-  }
+  ChannelsRgba channels(filterMgr->getTarget());
+  apply_median_to_row(filterMgr, m_width, m_height, m_tiledMode, channels);
 }
 
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  Target target = filterMgr->getTarget();
-  int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
-  int x = filterMgr->x();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->y();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
-
-    color = get_pixel_fast<GrayscaleTraits>(src, x, y);
-
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
-    else
-      k = graya_getv(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
-    else
-      a = graya_geta(color);
-
-    *(dst_address++) = graya(k, a);
-  }
+  ChannelsGrayscale channels(filterMgr->getTarget());
+  apply_median_to_row(filterMgr, m_width, m_height, m_tiledMode, channels);
 }
 
 void MedianFilter::applyToIndexed(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint8_t* dst_address = (uint8_t*)filterMgr->getDestinationAddress();
-  const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  Target target = filterMgr->getTarget();
-  int color, r, g, b;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, target);
-  int x = filterMgr->x();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->y();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *(dst_address++) = m_channel[0][m_ncolors/2];
-    }
-    else {
-      color = get_pixel_fast<IndexedTraits>(src, x, y);
-
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
-      else
-        r = rgba_getr(pal->getEntry(color));
-
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
-      else
-        g = rgba_getg(pal->getEntry(color));
-
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
-      else
-        b = rgba_getb(pal->getEntry(color));
-
-      *(dst_address++) = rgbmap->mapColor(r, g, b);
-    }
-  }
+  ChannelsIndexed channels(
+    filterMgr->getIndexedData()->getPalette(),
+    filterMgr->getIndexedData()->getRgbMap(),
+    filterMgr->getTarget());
+  apply_median_to_row(filterMgr, m_width, m_height, m_tiledMode, channels);
 }
 
 } // namespace filters
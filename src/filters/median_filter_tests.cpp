@@ -0,0 +1,285 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+#include "filters/median_filter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+typedef base::UniquePtr<Image> ImagePtr;
+
+// Applies a filter to one row of "dst" reading pixels from "src".
+// Pixels where (x+y) % 5 == 0 are skipped (as if they were outside
+// the selection).
+class TestFilterManager : public FilterManager
+                        , public FilterIndexedData {
+public:
+  TestFilterManager(const Image* src, Image* dst, Target target,
+                    Palette* palette, RgbMap* rgbmap)
+    : m_src(src), m_dst(dst), m_target(target)
+    , m_palette(palette), m_rgbmap(rgbmap)
+    , m_x(0), m_y(0) {
+  }
+
+  void applyToRow(Filter* filter, int y) {
+    m_x = 0;
+    m_y = y;
+    switch (m_src->pixelFormat()) {
+      case IMAGE_RGB:       filter->applyToRgba(this); break;
+      case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+      case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+    }
+  }
+
+  const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_y); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_y); }
+  int getWidth() override { return m_src->width(); }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override { return (((m_x++) + m_y) % 5) == 0; }
+  const Image* getSourceImage() override { return m_src; }
+  int x() override { return 0; }
+  int y() override { return m_y; }
+
+  Palette* getPalette() override { return m_palette; }
+  RgbMap* getRgbMap() override { return m_rgbmap; }
+
+private:
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  Palette* m_palette;
+  RgbMap* m_rgbmap;
+  int m_x, m_y;
+};
+
+class MedianFilterTest : public ::testing::Test {
+protected:
+  MedianFilterTest() : m_palette(frame_t(0), 256) {
+    std::srand(1);
+    for (int i=0; i<256; ++i)
+      m_palette.setEntry(i, rgba(std::rand() % 256,
+                                 std::rand() % 256,
+                                 std::rand() % 256, 255));
+    m_rgbmap.regenerate(&m_palette, 0);
+  }
+
+  Image* createRandomImage(PixelFormat format, int w, int h) {
+    Image* image = Image::create(format, w, h);
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        int c = std::rand();
+        switch (format) {
+          case IMAGE_RGB: c = rgba(c & 255, (c >> 8) & 255, (c >> 16) & 255, (c >> 3) & 255); break;
+          case IMAGE_GRAYSCALE: c = graya(c & 255, (c >> 8) & 255); break;
+          case IMAGE_INDEXED: c = c & 255; break;
+        }
+        put_pixel(image, x, y, c);
+      }
+    }
+    return image;
+  }
+
+  void applyFilter(Filter* filter, const Image* src, Image* dst, Target target) {
+    TestFilterManager mgr(src, dst, target, &m_palette, &m_rgbmap);
+    for (int y=0; y<src->height(); ++y)
+      mgr.applyToRow(filter, y);
+  }
+
+  // Applies the filter in bands of rows from a thread pool (as
+  // FilterManagerImpl does), each band with its own FilterManager.
+  void applyFilterInParallel(Filter* filter, const Image* src, Image* dst, Target target) {
+    ASSERT_TRUE(filter->canApplyInParallel());
+
+    base::thread_pool pool(4);
+    const int rowsPerBand = 3;
+    for (int row=0; row<src->height(); row+=rowsPerBand) {
+      int row2 = std::min(row+rowsPerBand, src->height());
+      pool.execute(
+        [this, filter, src, dst, target, row, row2]{
+          TestFilterManager mgr(src, dst, target, &m_palette, &m_rgbmap);
+          for (int y=row; y<row2; ++y)
+            mgr.applyToRow(filter, y);
+        });
+    }
+    pool.wait_all();
+  }
+
+  // Median of each channel of the neighbors sorting them.
+  color_t bruteForceMedian(const Image* src, int x, int y,
+                           int w, int h, TiledMode tiledMode, Target target) {
+    std::vector<int> channels[4];
+    for (int v=0; v<h; ++v) {
+      for (int u=0; u<w; ++u) {
+        int px = getCoord(x-w/2+u, src->width(), (int(tiledMode) & int(TiledMode::X_AXIS)) != 0);
+        int py = getCoord(y-h/2+v, src->height(), (int(tiledMode) & int(TiledMode::Y_AXIS)) != 0);
+        color_t c = get_pixel(src, px, py);
+
+        switch (src->pixelFormat()) {
+          case IMAGE_RGB:
+            channels[0].push_back(rgba_getr(c));
+            channels[1].push_back(rgba_getg(c));
+            channels[2].push_back(rgba_getb(c));
+            channels[3].push_back(rgba_geta(c));
+            break;
+          case IMAGE_GRAYSCALE:
+            channels[0].push_back(graya_getv(c));
+            channels[1].push_back(graya_geta(c));
+            break;
+          case IMAGE_INDEXED:
+            if (target & TARGET_INDEX_CHANNEL)
+              channels[0].push_back(c);
+            else {
+              color_t rgb = m_palette.getEntry(c);
+              channels[0].push_back(rgba_getr(rgb));
+              channels[1].push_back(rgba_getg(rgb));
+              channels[2].push_back(rgba_getb(rgb));
+            }
+            break;
+        }
+      }
+    }
+
+    int m[4];
+    for (int i=0; i<4; ++i) {
+      std::sort(channels[i].begin(), channels[i].end());
+      m[i] = (channels[i].empty() ? 0: channels[i][w*h/2]);
+    }
+
+    color_t c = get_pixel(src, x, y);
+    switch (src->pixelFormat()) {
+      case IMAGE_RGB:
+        return rgba(target & TARGET_RED_CHANNEL   ? m[0]: rgba_getr(c),
+                    target & TARGET_GREEN_CHANNEL ? m[1]: rgba_getg(c),
+                    target & TARGET_BLUE_CHANNEL  ? m[2]: rgba_getb(c),
+                    target & TARGET_ALPHA_CHANNEL ? m[3]: rgba_geta(c));
+      case IMAGE_GRAYSCALE:
+        return graya(target & TARGET_GRAY_CHANNEL  ? m[0]: graya_getv(c),
+                     target & TARGET_ALPHA_CHANNEL ? m[1]: graya_geta(c));
+      case IMAGE_INDEXED: {
+        if (target & TARGET_INDEX_CHANNEL)
+          return m[0];
+        color_t rgb = m_palette.getEntry(c);
+        return m_rgbmap.mapColor(target & TARGET_RED_CHANNEL   ? m[0]: rgba_getr(rgb),
+                                 target & TARGET_GREEN_CHANNEL ? m[1]: rgba_getg(rgb),
+                                 target & TARGET_BLUE_CHANNEL  ? m[2]: rgba_getb(rgb));
+      }
+    }
+    return 0;
+  }
+
+  // Clamps the coordinate to the image (or wraps it in tiled mode).
+  static int getCoord(int c, int size, bool tiled) {
+    if (tiled)
+      return ((c % size) + size) % size;
+    else
+      return std::max(0, std::min(size-1, c));
+  }
+
+  void testMedian(PixelFormat format, Target target) {
+    const int sizes[][2] = { { 1, 1 }, { 3, 3 }, { 5, 3 }, { 4, 6 }, { 7, 7 } };
+    const TiledMode modes[] = { TiledMode::NONE, TiledMode::X_AXIS,
+                                TiledMode::Y_AXIS, TiledMode::BOTH };
+
+    // A small image (smaller than some matrices) to test the clamping
+    // and wrapping of coordinates in all edges.
+    ImagePtr src(createRandomImage(format, 13, 6));
+
+    for (const auto& size : sizes) {
+      for (TiledMode mode : modes) {
+        MedianFilter filter;
+        filter.setSize(size[0], size[1]);
+        filter.setTiledMode(mode);
+
+        ImagePtr dst(Image::createCopy(src));
+        applyFilter(&filter, src, dst, target);
+
+        for (int y=0; y<src->height(); ++y) {
+          for (int x=0; x<src->width(); ++x) {
+            color_t expected = ((x+y) % 5 == 0 ?
+                                get_pixel(src, x, y):
+                                bruteForceMedian(src, x, y, size[0], size[1], mode, target));
+            ASSERT_EQ(expected, get_pixel(dst, x, y))
+              << "Matrix " << size[0] << "x" << size[1]
+              << " tiled mode " << int(mode)
+              << " pixel " << x << "," << y;
+          }
+        }
+      }
+    }
+  }
+
+  Palette m_palette;
+  RgbMap m_rgbmap;
+};
+
+TEST_F(MedianFilterTest, Rgb)
+{
+  testMedian(IMAGE_RGB, TARGET_ALL_CHANNELS);
+  testMedian(IMAGE_RGB, TARGET_RED_CHANNEL | TARGET_ALPHA_CHANNEL);
+}
+
+TEST_F(MedianFilterTest, Grayscale)
+{
+  testMedian(IMAGE_GRAYSCALE, TARGET_ALL_CHANNELS);
+  testMedian(IMAGE_GRAYSCALE, TARGET_GRAY_CHANNEL);
+}
+
+TEST_F(MedianFilterTest, Indexed)
+{
+  testMedian(IMAGE_INDEXED, TARGET_INDEX_CHANNEL);
+  testMedian(IMAGE_INDEXED, TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL);
+  testMedian(IMAGE_INDEXED, TARGET_GREEN_CHANNEL);
+}
+
+TEST_F(MedianFilterTest, SerialAndParallelAreEqual)
+{
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+
+  for (PixelFormat format : formats) {
+    Target target = (format == IMAGE_INDEXED ?
+                     TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL:
+                     TARGET_ALL_CHANNELS);
+
+    ImagePtr src(createRandomImage(format, 67, 41));
+    ImagePtr serial(Image::createCopy(src));
+    ImagePtr parallel(Image::createCopy(src));
+
+    MedianFilter filter;
+    filter.setSize(5, 5);
+    filter.setTiledMode(TiledMode::BOTH);
+
+    applyFilter(&filter, src, serial, target);
+    applyFilterInParallel(&filter, src, parallel, target);
+
+    EXPECT_EQ(0, count_diff_between_images(serial, parallel));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Gfx Library
-// Copyright (C) 2001-2014 David Capello
+// Copyright (C) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,89 +10,354 @@
 
 #include "gfx/packing_rects.h"
 
-#include "gfx/region.h"
+#include "gfx/point.h"
 #include "gfx/size.h"
 
+#include <algorithm>
+#include <climits>
+
 namespace gfx {
 
+namespace {
+
+// Rules to choose the free rectangle where a new rectangle is placed.
+enum Heuristic {
+  // Top-most position, then left-most (this is the first heuristic
+  // to keep the same layout of the previous packing algorithm).
+  TopLeftRule,
+  // Minimizes the shortest leftover side of the free rectangle.
+  BestShortSideFit,
+  // Minimizes the leftover area of the free rectangle.
+  BestAreaFit,
+};
+
+const Heuristic heuristics[] = {
+  TopLeftRule,
+  BestShortSideFit,
+  BestAreaFit
+};
+
+// List of maximal free rectangles of one texture page.
+class MaxRects {
+public:
+  MaxRects(const Size& size) {
+    m_free.push_back(Rect(size));
+  }
+
+  // Finds the best position for a rectangle of the given size (and
+  // the rotated size if "rotation" is true).
+  bool find(const Size& sz, bool rotation, Heuristic heuristic,
+            Rect& best, bool& rotated) const {
+    if (sz.w <= 0 || sz.h <= 0) {
+      best = Rect(0, 0, sz.w, sz.h);
+      rotated = false;
+      return true;
+    }
+
+    int bestScore1 = INT_MAX;
+    int bestScore2 = INT_MAX;
+
+    for (const auto& free : m_free) {
+      for (int r=0; r<(rotation && sz.w != sz.h ? 2: 1); ++r) {
+        int w = (r == 0 ? sz.w: sz.h);
+        int h = (r == 0 ? sz.h: sz.w);
+        if (w > free.w || h > free.h)
+          continue;
+
+        int leftoverW = free.w - w;
+        int leftoverH = free.h - h;
+        int score1, score2;
+
+        switch (heuristic) {
+          case TopLeftRule:
+            score1 = free.y;
+            score2 = free.x;
+            break;
+          case BestShortSideFit:
+            score1 = std::min(leftoverW, leftoverH);
+            score2 = std::max(leftoverW, leftoverH);
+            break;
+          case BestAreaFit:
+          default:
+            score1 = free.w*free.h - w*h;
+            score2 = std::min(leftoverW, leftoverH);
+            break;
+        }
+
+        if (score1 < bestScore1 ||
+            (score1 == bestScore1 && score2 < bestScore2)) {
+          best = Rect(free.x, free.y, w, h);
+          rotated = (r == 1);
+          bestScore1 = score1;
+          bestScore2 = score2;
+        }
+      }
+    }
+
+    return (bestScore1 != INT_MAX);
+  }
+
+  // Marks the given area as used, splitting all free rectangles that
+  // overlap it.
+  void place(const Rect& rc) {
+    if (rc.isEmpty())
+      return;
+
+    std::size_t n = m_free.size();
+    for (std::size_t i=0; i<n; ) {
+      Rect free = m_free[i];
+      if (!overlap(free, rc)) {
+        ++i;
+        continue;
+      }
+
+      m_free[i] = m_free[--n];
+      m_free[n] = m_free.back();
+      m_free.pop_back();
+
+      if (rc.x > free.x)
+        m_free.push_back(Rect(free.x, free.y, rc.x-free.x, free.h));
+      if (rc.x2() < free.x2())
+        m_free.push_back(Rect(rc.x2(), free.y, free.x2()-rc.x2(), free.h));
+      if (rc.y > free.y)
+        m_free.push_back(Rect(free.x, free.y, free.w, rc.y-free.y));
+      if (rc.y2() < free.y2())
+        m_free.push_back(Rect(free.x, rc.y2(), free.w, free.y2()-rc.y2()));
+    }
+
+    prune();
+  }
+
+private:
+  static bool overlap(const Rect& a, const Rect& b) {
+    return (a.x < b.x2() && b.x < a.x2() &&
+            a.y < b.y2() && b.y < a.y2());
+  }
+
+  static bool inside(const Rect& a, const Rect& b) {
+    return (a.x >= b.x && a.y >= b.y &&
+            a.x2() <= b.x2() && a.y2() <= b.y2());
+  }
+
+  // Removes free rectangles that are inside other free rectangles.
+  void prune() {
+    for (std::size_t i=0; i<m_free.size(); ++i) {
+      for (std::size_t j=i+1; j<m_free.size(); ) {
+        if (inside(m_free[i], m_free[j])) {
+          m_free.erase(m_free.begin()+i);
+          --i;
+          break;
+        }
+        else if (inside(m_free[j], m_free[i]))
+          m_free.erase(m_free.begin()+j);
+        else
+          ++j;
+      }
+    }
+  }
+
+  std::vector<Rect> m_free;
+};
+
+} // anonymous namespace
+
+PackingRects::PackingRects()
+  : m_rotation(false)
+  , m_powerOfTwo(true)
+{
+}
+
 void PackingRects::add(const Size& sz)
 {
   m_rects.push_back(Rect(sz));
+  m_items.push_back(Item(sz));
 }
 
 void PackingRects::add(const Rect& rc)
 {
   m_rects.push_back(rc);
+  m_items.push_back(Item(rc.getSize()));
 }
 
 Size PackingRects::bestFit()
 {
-  Size size(0, 0);
+  Indexes indexes(m_rects.size());
+  for (std::size_t i=0; i<indexes.size(); ++i)
+    indexes[i] = int(i);
+  sortByArea(indexes);
+
+  m_pages.clear();
+  do {
+    Indexes unpacked;
+    Size size = fitPage(indexes, int(m_pages.size()), unpacked);
+    m_pages.push_back(Rect(size));
+    indexes.swap(unpacked);
+  } while (!indexes.empty());
+
+  m_bounds = m_pages[0];
+  return m_bounds.getSize();
+}
+
+bool PackingRects::pack(const Size& size)
+{
+  Indexes indexes(m_rects.size());
+  for (std::size_t i=0; i<indexes.size(); ++i)
+    indexes[i] = int(i);
+  sortByArea(indexes);
+
+  m_bounds = Rect(size);
+  m_pages.assign(1, m_bounds);
+  return packPage(indexes, size, 0, nullptr);
+}
+
+// We cannot sort m_rects because we want to keep the same order
+// given by the user, so we sort indexes to the rectangles (the
+// biggest rectangles go first).
+void PackingRects::sortByArea(Indexes& indexes) const
+{
+  std::stable_sort(
+    indexes.begin(), indexes.end(),
+    [this](int a, int b) {
+      const Size& sa = m_items[a].size;
+      const Size& sb = m_items[b].size;
+      return sa.w*sa.h > sb.w*sb.h;
+    });
+}
+
+// Packs the given rectangles in a page of the given size. If
+// "unpacked" is nullptr, returns true only if all rectangles fit in
+// the page. In other case, the page is filled with the biggest
+// possible area, and rectangles that don't fit are added to
+// "unpacked".
+bool PackingRects::packPage(const Indexes& indexes, const Size& size,
+                            int page, Indexes* unpacked)
+{
+  std::vector<Rect> bestRects;
+  std::vector<bool> bestRotated;
+  std::vector<bool> bestPlaced;
+  int bestArea = -1;
+
+  for (Heuristic heuristic : heuristics) {
+    MaxRects bin(size);
+    std::vector<Rect> rects(indexes.size());
+    std::vector<bool> rotated(indexes.size(), false);
+    std::vector<bool> placed(indexes.size(), false);
+    int area = 0;
+    bool fit = true;
+
+    for (std::size_t k=0; k<indexes.size(); ++k) {
+      const Size& sz = m_items[indexes[k]].size;
+      Rect rc;
+      bool rot = false;
+
+      if (bin.find(sz, m_rotation, heuristic, rc, rot)) {
+        bin.place(rc);
+        rects[k] = rc;
+        rotated[k] = rot;
+        placed[k] = true;
+        area += rc.w*rc.h;
+      }
+      else {
+        fit = false;
+        if (!unpacked)
+          break;
+      }
+    }
+
+    if (area > bestArea && (fit || unpacked)) {
+      bestRects.swap(rects);
+      bestRotated.swap(rotated);
+      bestPlaced.swap(placed);
+      bestArea = area;
+    }
+
+    if (fit)
+      break;
+  }
+
+  if (bestArea < 0)
+    return false;
 
+  bool all = true;
+  for (std::size_t k=0; k<indexes.size(); ++k) {
+    int i = indexes[k];
+    if (bestPlaced[k]) {
+      m_rects[i] = bestRects[k];
+      m_items[i].rotated = bestRotated[k];
+      m_items[i].page = page;
+    }
+    else {
+      unpacked->push_back(i);
+      all = false;
+    }
+  }
+  return all;
+}
+
+// Finds the smallest page that can contain all given rectangles (or
+// a page of the maximum size with as many rectangles as possible).
+Size PackingRects::fitPage(const Indexes& indexes, int page, Indexes& unpacked)
+{
   // Calculate the amount of pixels that we need, the texture cannot
   // be smaller than that.
   int neededArea = 0;
-  for (const auto& rc : m_rects) {
-    neededArea += rc.w * rc.h;
-  }
+  for (int i : indexes)
+    neededArea += m_items[i].size.w * m_items[i].size.h;
 
+  bool limited = (m_maxSize.w > 0 && m_maxSize.h > 0);
   int w = 1;
   int h = 1;
   int z = 0;
-  bool fit = false;
   while (true) {
-    if (w*h >= neededArea) {
-      fit = pack(Size(w, h));
-      if (fit) {
-        size = Size(w, h);
-        break;
+    if (w*h >= neededArea &&
+        packPage(indexes, Size(w, h), page, nullptr))
+      break;
+
+    if (limited && w >= m_maxSize.w && h >= m_maxSize.h) {
+      // There is not enough space in one page, we put all we can in
+      // this one and the rest of rectangles in the next pages.
+      unpacked.clear();
+      packPage(indexes, Size(w, h), page, &unpacked);
+
+      // The biggest rectangle doesn't fit in a page of the maximum
+      // size, so it goes alone in its own page.
+      if (unpacked.size() == indexes.size()) {
+        int i = indexes[0];
+        m_rects[i] = Rect(m_items[i].size);
+        m_items[i].rotated = false;
+        m_items[i].page = page;
+        unpacked.erase(unpacked.begin());
+        return m_items[i].size;
       }
+      break;
+    }
+
+    bool growWidth = (((++z) & 1) == 1);
+    if (limited) {
+      if (w >= m_maxSize.w)
+        growWidth = false;
+      else if (h >= m_maxSize.h)
+        growWidth = true;
     }
 
-    if ((++z) & 1)
-      w *= 2;
+    if (growWidth)
+      w = (limited ? std::min(w*2, m_maxSize.w): w*2);
     else
-      h *= 2;
+      h = (limited ? std::min(h*2, m_maxSize.h): h*2);
   }
 
-  return size;
-}
-
-static bool by_area(const Rect* a, const Rect* b) {
-  return a->w*a->h > b->w*b->h;
-}
-
-bool PackingRects::pack(const Size& size)
-{
-  m_bounds = Rect(size);
-
-  // We cannot sort m_rects because we want to 
-  std::vector<Rect*> rectPtrs(m_rects.size());
-  int i = 0;
-  for (auto& rc : m_rects)
-    rectPtrs[i++] = &rc;
-  std::sort(rectPtrs.begin(), rectPtrs.end(), by_area);
-
-  gfx::Region rgn(m_bounds);
-  for (auto rcPtr : rectPtrs) {
-    gfx::Rect& rc = *rcPtr;
-
-    for (int v=0; v<=m_bounds.h-rc.h; ++v) {
-      for (int u=0; u<=m_bounds.w-rc.w; ++u) {
-        gfx::Rect possible(u, v, rc.w, rc.h);
-        Region::Overlap overlap = rgn.contains(possible);
-        if (overlap == Region::In) {
-          rc = possible;
-          rgn.createSubtraction(rgn, gfx::Region(rc));
-          goto next_rc;
-        }
-      }
-    }
-    return false; // There is not enough room for "rc"
-  next_rc:;
+  // Use only the required area when the size doesn't need to be a
+  // power of two.
+  if (!m_powerOfTwo) {
+    Rect used;
+    for (std::size_t i=0; i<m_rects.size(); ++i)
+      if (m_items[i].page == page)
+        used |= m_rects[i];
+    w = used.x2();
+    h = used.y2();
   }
 
-  return true;
+  return Size(w, h);
 }
 
 } // namespace gfx
@@ -10,16 +10,22 @@
 
 #include "gfx/fwd.h"
 #include "gfx/rect.h"
+#include "gfx/size.h"
 #include <vector>
 
 namespace gfx {
 
-  // TODO add support for rotations
+  // Packs rectangles in one or more textures (pages) using the
+  // MaxRects algorithm (a list of maximal free rectangles is kept for
+  // each page, and each new rectangle is placed in the free area
+  // that gives the best score for the current heuristic).
   class PackingRects {
   public:
     typedef std::vector<Rect> Rects;
     typedef Rects::const_iterator const_iterator;
 
+    PackingRects();
+
     // Iterate over all given rectangles (in the same order they where
     // given in addSize() calls).
     const_iterator begin() const { return m_rects.begin(); }
@@ -28,11 +34,32 @@ namespace gfx {
     std::size_t size() const { return m_rects.size(); }
     const Rect& operator[](int i) const { return m_rects[i]; }
 
+    // Returns true if the i-th rectangle was rotated 90 degrees
+    // clockwise to fit in the texture (its bounds have the width and
+    // height swapped).
+    bool rotated(int i) const { return m_items[i].rotated; }
+
+    // Returns the texture page where the i-th rectangle was placed.
+    int page(int i) const { return m_items[i].page; }
+
     // Adds a new rectangle.
     void add(const Size& sz);
     void add(const Rect& rc);
 
-    // Returns the best size for the texture.
+    // Allows to rotate rectangles 90 degrees to fit them better.
+    void setRotation(bool state) { m_rotation = state; }
+
+    // Texture sizes returned by bestFit() must be a power of two
+    // (true by default).
+    void setPowerOfTwo(bool state) { m_powerOfTwo = state; }
+
+    // Maximum size of each texture page in bestFit(). If there is not
+    // enough space, the remaining rectangles are placed in new pages.
+    // An empty size means that there is no limit (only one page).
+    void setMaxSize(const Size& size) { m_maxSize = size; }
+
+    // Returns the best size for the texture (the size of the first
+    // page when there are several pages).
     Size bestFit();
 
     // Rearrange all given rectangles to best fit a texture size.
@@ -43,9 +70,32 @@ namespace gfx {
     // Returns the bounds of the packed area.
     const Rect& bounds() const { return m_bounds; }
 
+    // Returns the number of texture pages and the bounds of each one.
+    int pages() const { return int(m_pages.size()); }
+    const Rect& pageBounds(int page) const { return m_pages[page]; }
+
   private:
+    struct Item {
+      Size size;                // Original size of the rectangle
+      bool rotated;
+      int page;
+      Item(const Size& size) : size(size), rotated(false), page(0) { }
+    };
+
+    typedef std::vector<int> Indexes;
+
+    void sortByArea(Indexes& indexes) const;
+    bool packPage(const Indexes& indexes, const Size& size,
+                  int page, Indexes* unpacked);
+    Size fitPage(const Indexes& indexes, int page, Indexes& unpacked);
+
     Rect m_bounds;
     Rects m_rects;
+    std::vector<Item> m_items;
+    std::vector<Rect> m_pages;
+    bool m_rotation;
+    bool m_powerOfTwo;
+    Size m_maxSize;
   };
 
 } // namespace gfx
@@ -11,6 +11,7 @@
 #include <gtest/gtest.h>
 
 #include "gfx/packing_rects.h"
+#include "gfx/point.h"
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 
@@ -93,6 +94,122 @@ TEST(PackingRects, KeepSameRectsOrder)
   EXPECT_EQ(Rect(0, 0, 30, 30), pr[2]);
 }
 
+TEST(PackingRects, Rotation)
+{
+  PackingRects pr;
+  pr.add(Size(128, 32));
+  pr.add(Size(32, 128));
+  pr.bestFit();
+  EXPECT_EQ(Rect(0, 0, 256, 128), pr.bounds());
+  EXPECT_FALSE(pr.rotated(0));
+  EXPECT_FALSE(pr.rotated(1));
+
+  pr.setRotation(true);
+  pr.bestFit();
+  EXPECT_EQ(Rect(0, 0, 128, 64), pr.bounds());
+  EXPECT_EQ(Rect(0, 0, 128, 32), pr[0]);
+  EXPECT_EQ(Rect(0, 32, 128, 32), pr[1]);
+  EXPECT_FALSE(pr.rotated(0));
+  EXPECT_TRUE(pr.rotated(1));
+}
+
+TEST(PackingRects, NonPowerOfTwo)
+{
+  PackingRects pr;
+  pr.setPowerOfTwo(false);
+  pr.add(Size(10, 12));
+  pr.add(Size(5, 12));
+  pr.bestFit();
+  EXPECT_EQ(Rect(0, 0, 15, 12), pr.bounds());
+}
+
+TEST(PackingRects, MultiplePages)
+{
+  PackingRects pr;
+  pr.setMaxSize(Size(256, 256));
+  for (int i=0; i<6; ++i)
+    pr.add(Size(100, 100));
+  pr.bestFit();
+
+  EXPECT_EQ(2, pr.pages());
+  EXPECT_EQ(Rect(0, 0, 256, 256), pr.pageBounds(0));
+  EXPECT_EQ(Rect(0, 0, 256, 128), pr.pageBounds(1));
+  EXPECT_EQ(Rect(0, 0, 256, 256), pr.bounds());
+
+  int count[2] = { 0, 0 };
+  for (int i=0; i<6; ++i)
+    ++count[pr.page(i)];
+  EXPECT_EQ(4, count[0]);
+  EXPECT_EQ(2, count[1]);
+}
+
+TEST(PackingRects, RectBiggerThanMaxSize)
+{
+  PackingRects pr;
+  pr.setMaxSize(Size(64, 64));
+  pr.add(Size(32, 32));
+  pr.add(Size(100, 100));
+  pr.bestFit();
+
+  EXPECT_EQ(2, pr.pages());
+  EXPECT_EQ(0, pr.page(0));
+  EXPECT_EQ(1, pr.page(1));
+  EXPECT_EQ(Rect(0, 0, 64, 64), pr.pageBounds(0));
+  EXPECT_EQ(Rect(0, 0, 100, 100), pr.pageBounds(1));
+  EXPECT_EQ(Rect(0, 0, 32, 32), pr[0]);
+  EXPECT_EQ(Rect(0, 0, 100, 100), pr[1]);
+}
+
+static double packing_efficiency(bool rotation, bool powerOfTwo, int& pages)
+{
+  PackingRects pr;
+  pr.setRotation(rotation);
+  pr.setPowerOfTwo(powerOfTwo);
+  pr.setMaxSize(Size(512, 512));
+
+  // Fixed pseudo-random sizes so the result is reproducible
+  unsigned int seed = 1;
+  int area = 0;
+  for (int i=0; i<300; ++i) {
+    seed = seed*1103515245 + 12345;
+    int w = 8 + int((seed >> 16) % 57);
+    seed = seed*1103515245 + 12345;
+    int h = 8 + int((seed >> 16) % 57);
+    pr.add(Size(w, h));
+    area += w*h;
+  }
+  pr.bestFit();
+
+  // All rectangles must be inside their page without overlapping
+  // other rectangles.
+  for (std::size_t i=0; i<pr.size(); ++i) {
+    EXPECT_TRUE(pr.pageBounds(pr.page(i)).contains(pr[i]));
+    for (std::size_t j=i+1; j<pr.size(); ++j) {
+      if (pr.page(i) == pr.page(j)) {
+        EXPECT_TRUE(pr[i].createIntersect(pr[j]).isEmpty());
+      }
+    }
+  }
+
+  int pagesArea = 0;
+  for (int i=0; i<pr.pages(); ++i)
+    pagesArea += pr.pageBounds(i).w * pr.pageBounds(i).h;
+
+  pages = pr.pages();
+  return double(area) / double(pagesArea);
+}
+
+TEST(PackingRects, Efficiency)
+{
+  int pages;
+  double noRotation = packing_efficiency(false, false, pages);
+  double rotation = packing_efficiency(true, false, pages);
+
+  EXPECT_GT(noRotation, 0.9);
+  EXPECT_GE(rotation, noRotation);
+  EXPECT_EQ(2, pages);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -10,12 +10,110 @@
 
 #include "render/render.h"
 
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 namespace render {
 
+// Minimum number of rows of each band when the sprite is rendered
+// in parallel. Smaller areas are not worth the synchronization.
+static const int kMinBandHeight = 16;
+
+// Worker threads shared by all Render instances to render bands.
+static base::thread_pool& bands_pool()
+{
+  static base::thread_pool pool(base::thread_pool::hardware_threads());
+  return pool;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Below layers cache
+
+class Render::BelowLayersCache {
+public:
+  // Composition of the background and all layers below the cached
+  // layer, in "bounds" (zoomed sprite coordinates).
+  ImageRef image;
+  gfx::Rect bounds;
+
+  // State of everything that was used to render "image". If the key
+  // of a new rendering is different, the image must be rendered again.
+  std::vector<uint32_t> key;
+};
+
+// Adds to "key" the state of each layer that is rendered before
+// "cacheLayer" (with the same visibility rules of
+// Render::renderLayer()). Returns true when "cacheLayer" is found.
+static bool add_below_layers_key(const Layer* layer,
+                                 const Layer* cacheLayer,
+                                 frame_t frame,
+                                 std::vector<uint32_t>& key)
+{
+  if (layer == cacheLayer)
+    return true;
+
+  if (!layer->isVisible())
+    return false;
+
+  switch (layer->type()) {
+
+    case ObjectType::LayerImage: {
+      key.push_back(layer->id());
+      key.push_back(layer->isBackground());
+      key.push_back(static_cast<const LayerImage*>(layer)->getBlendMode());
+
+      const Cel* cel = layer->cel(frame);
+      if (cel) {
+        key.push_back(cel->id());
+        key.push_back(cel->x());
+        key.push_back(cel->y());
+        key.push_back(cel->opacity());
+        if (cel->image()) {
+          key.push_back(cel->image()->id());
+          key.push_back(cel->image()->version());
+        }
+      }
+      break;
+    }
+
+    case ObjectType::LayerFolder: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+
+      for (; it != end; ++it) {
+        if (add_below_layers_key(*it, cacheLayer, frame, key))
+          return true;
+      }
+      break;
+    }
+
+  }
+  return false;
+}
+
+// Adds to "key" the state of the sprite (without its layers) that is
+// used to render the given frame.
+static void add_sprite_key(const Sprite* sprite,
+                           frame_t frame,
+                           std::vector<uint32_t>& key)
+{
+  key.push_back(sprite->id());
+  key.push_back(sprite->version());
+  key.push_back(sprite->transparentColor());
+  key.push_back(frame);
+  if (sprite->pixelFormat() == IMAGE_INDEXED) {
+    const Palette* pal = sprite->palette(frame);
+    for (int i=0; i<pal->size(); ++i)
+      key.push_back(pal->getEntry(i));
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
@@ -122,14 +220,74 @@ public:
   }
 };
 
+// Blends whole spans of pixels. By default each pixel is blended
+// with the BlenderHelper, but RGB and grayscale images use the span
+// blenders of doc/blend.h (which can use SIMD instructions).
+template<class DstTraits, class SrcTraits>
+class BlenderSpan {
+  BlenderHelper<DstTraits, SrcTraits> m_blender;
+public:
+  BlenderSpan(const Image* src, const Palette* pal, int blend_mode)
+    : m_blender(src, pal, blend_mode) {
+  }
+  inline void operator()(typename DstTraits::pixel_t* scanline,
+                         const typename DstTraits::pixel_t* dst,
+                         const typename SrcTraits::pixel_t* src,
+                         int n, int opacity)
+  {
+    for (int i=0; i<n; ++i)
+      m_blender(scanline[i], dst[i], src[i], opacity);
+  }
+};
+
+template<>
+class BlenderSpan<RgbTraits, RgbTraits> {
+  RGBA_BLEND_SPAN m_blend_span;
+  color_t m_mask_color;
+public:
+  BlenderSpan(const Image* src, const Palette* pal, int blend_mode)
+  {
+    m_blend_span = get_rgba_span_blender(blend_mode);
+    m_mask_color = src->maskColor();
+  }
+  inline void operator()(RgbTraits::pixel_t* scanline,
+                         const RgbTraits::pixel_t* dst,
+                         const RgbTraits::pixel_t* src,
+                         int n, int opacity)
+  {
+    (*m_blend_span)(scanline, dst, src, n, m_mask_color, opacity);
+  }
+};
+
+template<>
+class BlenderSpan<GrayscaleTraits, GrayscaleTraits> {
+  GRAYA_BLEND_SPAN m_blend_span;
+  GrayscaleTraits::pixel_t m_mask_color;
+public:
+  BlenderSpan(const Image* src, const Palette* pal, int blend_mode)
+  {
+    m_blend_span = get_graya_span_blender(blend_mode);
+    m_mask_color = GrayscaleTraits::pixel_t(src->maskColor());
+  }
+  inline void operator()(GrayscaleTraits::pixel_t* scanline,
+                         const GrayscaleTraits::pixel_t* dst,
+                         const GrayscaleTraits::pixel_t* src,
+                         int n, int opacity)
+  {
+    (*m_blend_span)(scanline, dst, src, n, m_mask_color, opacity);
+  }
+};
+
 template<class DstTraits, class SrcTraits>
 static void compose_scaled_image_scale_up(
   Image* dst, const Image* src, const Palette* pal,
   gfx::Clip area,
   int opacity, int blend_mode, Zoom zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
-  int px_x, px_y;
+  typedef typename DstTraits::pixel_t dst_pixel_t;
+  typedef typename SrcTraits::pixel_t src_pixel_t;
+
+  BlenderSpan<DstTraits, SrcTraits> blender(src, pal, blend_mode);
 
   if (!area.clip(dst->width(), dst->height(),
       zoom.apply(src->width()),
@@ -151,51 +309,42 @@ static void compose_scaled_image_scale_up(
   if (srcBounds.isEmpty())
     return;
 
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(srcBounds.w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
+  // Without zoom we can blend each line directly in 'dst'
+  if (px_w == 1 && px_h == 1) {
+    for (int y=0; y<srcBounds.h; ++y) {
+      const src_pixel_t* src_ptr =
+        (const src_pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y);
+      dst_pixel_t* dst_ptr =
+        (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y+y);
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+      blender(dst_ptr, dst_ptr, src_ptr, srcBounds.w, opacity);
+    }
+    return;
+  }
+
+  // 'back' contains the 'dst' pixels behind each source pixel, and
+  // the 'scanline' is used to blend src/dst pixels one time for each
+  // pixel
+  std::vector<dst_pixel_t> back(srcBounds.w);
+  std::vector<dst_pixel_t> scanline(srcBounds.w);
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
   for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      blender(*scanline_it, *dst_it, *src_it, opacity);
-      ++src_it;
-
-      int delta;
-      if (x == 0)
-        delta = first_px_w;
-      else
-        delta = px_w;
-
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
-
-      ++scanline_it;
+    const src_pixel_t* src_ptr =
+      (const src_pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y);
+    dst_pixel_t* dst_ptr =
+      (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y);
+
+    // Read 'dst' pixels (the last pixels can be outside the 'dst'
+    // line, but they will not be painted)
+    for (int x=0, u=0; x<srcBounds.w; ++x) {
+      back[x] = dst_ptr[MIN(u, dstBounds.w-1)];
+      u += (x == 0 ? first_px_w: px_w);
     }
 
+    // Blend 'src' and 'dst', put the result in `scanline'
+    blender(&scanline[0], &back[0], src_ptr, srcBounds.w, opacity);
+
     // Get the 'height' of the line to be painted in 'dst'
     if ((y == 0) && (first_px_h > 0))
       line_h = first_px_h;
@@ -203,50 +352,20 @@ static void compose_scaled_image_scale_up(
       line_h = px_h;
 
     // Draw the line in 'dst'
-    for (px_y=0; px_y<line_h; ++px_y) {
-      dst_it = dstBits.begin_area(dstBounds);
-      dst_end = dstBits.end_area(dstBounds);
-      scanline_it = scanline.begin();
-
-      int x = 0;
-
-      // first pixel
-      for (px_x=0; px_x<first_px_w; ++px_x) {
-        ASSERT(scanline_it != scanline_end);
-        ASSERT(dst_it != dst_end);
-
-        *dst_it = *scanline_it;
-
-        ++dst_it;
-        if (dst_it == dst_end)
-          goto done_with_line;
+    for (int px_y=0; px_y<line_h; ++px_y) {
+      dst_ptr = (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y);
+
+      for (int x=0, u=0; x<srcBounds.w && u<dstBounds.w; ++x) {
+        int u_end = MIN(dstBounds.w, u + (x == 0 ? first_px_w: px_w));
+        const dst_pixel_t c = scanline[x];
+        for (; u<u_end; ++u)
+          dst_ptr[u] = c;
       }
 
-      ++scanline_it;
-      ++x;
-
-      // the rest of the line
-      for (; x<srcBounds.w; ++x) {
-        for (px_x=0; px_x<px_w; ++px_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
-
-done_with_line:;
       if (++dstBounds.y > bottom)
-        goto done_with_blit;
+        return;
     }
   }
-
-done_with_blit:;
 }
 
 template<class DstTraits, class SrcTraits>
@@ -255,7 +374,10 @@ static void compose_scaled_image_scale_down(
   gfx::Clip area,
   int opacity, int blend_mode, Zoom zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
+  typedef typename DstTraits::pixel_t dst_pixel_t;
+  typedef typename SrcTraits::pixel_t src_pixel_t;
+
+  BlenderSpan<DstTraits, SrcTraits> blender(src, pal, blend_mode);
   int unbox_w = zoom.remove(1);
   int unbox_h = zoom.remove(1);
 
@@ -271,38 +393,25 @@ static void compose_scaled_image_scale_down(
   if (srcBounds.isEmpty())
     return;
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // Number of 'dst' pixels in each line
+  int w = MIN(dstBounds.w, (srcBounds.w + unbox_w - 1) / unbox_w);
+  std::vector<src_pixel_t> front(w);
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
   for (int y=0; y<srcBounds.h; y+=unbox_h) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    for (int x=0; x<srcBounds.w; x+=unbox_w) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
+    const src_pixel_t* src_ptr =
+      (const src_pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y);
+    dst_pixel_t* dst_ptr =
+      (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y);
 
-      blender(*dst_it, *dst_it, *src_it, opacity);
+    // Pick one source pixel for each destination pixel
+    for (int x=0; x<w; ++x)
+      front[x] = src_ptr[x*unbox_w];
 
-      // Skip source pixels
-      for (int delta=0; delta < unbox_w && src_it != src_end; ++delta)
-        ++src_it;
-
-      ++dst_it;
-    }
+    blender(dst_ptr, dst_ptr, &front[0], w, opacity);
 
     if (++dstBounds.y > bottom)
       break;
-
-    // Skip lines
-    for (int delta=0; delta < srcBounds.w * (unbox_h-1) && src_it != src_end; ++delta)
-      ++src_it;
   }
 }
 
@@ -328,7 +437,13 @@ Render::Render()
   , m_bgType(BgType::TRANSPARENT)
   , m_bgCheckedSize(16, 16)
   , m_globalOpacity(255)
+  , m_previewImage(NULL)
   , m_onionskinType(OnionskinType::NONE)
+  , m_threads(1)
+  , m_cacheLayer(NULL)
+  , m_cache(new BelowLayersCache)
+  , m_layerRange(LayerRange::ALL)
+  , m_cacheLayerReached(false)
 {
 }
 
@@ -403,6 +518,28 @@ void Render::disableOnionskin()
   m_onionskinType = OnionskinType::NONE;
 }
 
+void Render::setThreads(int threads)
+{
+  m_threads = MAX(1, threads);
+}
+
+void Render::setBelowLayersCache(const Layer* layer, const gfx::Rect& bounds)
+{
+  m_cacheLayer = layer;
+  m_cacheBounds = bounds;
+}
+
+void Render::removeBelowLayersCache()
+{
+  m_cacheLayer = NULL;
+}
+
+void Render::invalidateBelowLayersCache()
+{
+  m_cache->image.reset();
+  m_cache->key.clear();
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -459,7 +596,95 @@ void Render::renderSprite(
   const gfx::Clip& area,
   Zoom zoom)
 {
+  if (m_cacheLayer &&
+      renderSpriteUsingCache(dstImage, sprite, frame, area, zoom))
+    return;
+
+  renderSpriteArea(dstImage, sprite, frame, area, zoom);
+}
+
+bool Render::renderSpriteUsingCache(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom)
+{
+  gfx::Rect srcBounds = area.srcBounds();
+  if (!m_cacheBounds.contains(srcBounds) ||
+      m_cacheLayer->sprite() != sprite ||
+      m_cacheLayer->type() != ObjectType::LayerImage)
+    return false;
+
+  // Extra cels and preview images can change at any time, they can
+  // be drawn only over the cached layers.
+  if ((m_extraCel && m_currentLayer != m_cacheLayer) ||
+      (m_previewImage && m_selectedLayer != m_cacheLayer))
+    return false;
+
+  // If the layer is inside a hidden folder, all layers are rendered.
+  for (const Layer* parent = m_cacheLayer->parent(); parent; parent = parent->parent())
+    if (!parent->isVisible())
+      return false;
+
+  std::vector<uint32_t> key;
+  add_sprite_key(sprite, frame, key);
+  key.push_back(zoom.numerator());
+  key.push_back(zoom.denominator());
+  key.push_back(dstImage->pixelFormat());
+  key.push_back(int(m_bgType));
+  key.push_back(m_bgZoom);
+  key.push_back(m_bgColor1);
+  key.push_back(m_bgColor2);
+  key.push_back(m_bgCheckedSize.w);
+  key.push_back(m_bgCheckedSize.h);
+  key.push_back(m_cacheBounds.x);
+  key.push_back(m_cacheBounds.y);
+  key.push_back(m_cacheBounds.w);
+  key.push_back(m_cacheBounds.h);
+  add_below_layers_key(sprite->folder(), m_cacheLayer, frame, key);
+
+  BelowLayersCache& cache = *m_cache;
+  if (!cache.image ||
+      cache.image->pixelFormat() != dstImage->pixelFormat() ||
+      cache.key != key) {
+    cache.image.reset(Image::create(dstImage->pixelFormat(),
+                                    m_cacheBounds.w, m_cacheBounds.h));
+    cache.bounds = m_cacheBounds;
+    cache.key.swap(key);
+
+    m_layerRange = LayerRange::BELOW_CACHED_LAYER;
+    renderSpriteArea(cache.image.get(), sprite, frame,
+                     gfx::Clip(0, 0, m_cacheBounds), zoom);
+  }
+
+  dstImage->copy(cache.image.get(),
+                 gfx::Clip(area.dst.x, area.dst.y,
+                           srcBounds.x - cache.bounds.x,
+                           srcBounds.y - cache.bounds.y,
+                           srcBounds.w, srcBounds.h));
+
+  m_layerRange = LayerRange::FROM_CACHED_LAYER;
+  renderSpriteArea(dstImage, sprite, frame, area, zoom);
+  m_layerRange = LayerRange::ALL;
+  return true;
+}
+
+void Render::renderSpriteArea(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom)
+{
+  int bands = MIN(m_threads, area.size.h / kMinBandHeight);
+  if (bands > 1) {
+    renderSpriteBands(dstImage, sprite, frame, area, zoom, bands);
+    return;
+  }
+
   m_sprite = sprite;
+  m_cacheLayerReached = false;
 
   RenderScaledImage scaled_func =
     getRenderScaledImageFunc(
@@ -483,19 +708,22 @@ void Render::renderSprite(
     }
   }
 
-  // Draw checked background
-  switch (m_bgType) {
+  // Draw checked background (it's already in the cached image when
+  // we render from the cached layer)
+  if (m_layerRange != LayerRange::FROM_CACHED_LAYER) {
+    switch (m_bgType) {
 
-    case BgType::CHECKED:
-      if (bgLayer && bgLayer->isVisible())
-        fill_rect(dstImage, area.dstBounds(), bg_color);
-      else
-        renderBackground(dstImage, area, zoom);
-      break;
+      case BgType::CHECKED:
+        if (bgLayer && bgLayer->isVisible())
+          fill_rect(dstImage, area.dstBounds(), bg_color);
+        else
+          renderBackground(dstImage, area, zoom);
+        break;
 
-    case BgType::TRANSPARENT:
-      fill_rect(dstImage, area.dstBounds(), bg_color);
-      break;
+      case BgType::TRANSPARENT:
+        fill_rect(dstImage, area.dstBounds(), bg_color);
+        break;
+    }
   }
 
   // Draw the current frame.
@@ -507,7 +735,8 @@ void Render::renderSprite(
 
   // Onion-skin feature: Draw previous/next frames with different
   // opacity (<255)
-  if (m_onionskinType != OnionskinType::NONE) {
+  if (m_onionskinType != OnionskinType::NONE &&
+      m_layerRange != LayerRange::BELOW_CACHED_LAYER) {
     for (frame_t f = frame - m_onionskinPrevs;
          f <= frame + m_onionskinNexts; ++f) {
       if (f == frame || f < 0 || f > m_sprite->lastFrame())
@@ -534,6 +763,56 @@ void Render::renderSprite(
   }
 }
 
+void Render::renderSpriteBands(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom,
+  int bands)
+{
+  // Each band is rendered by its own copy of this Render (the
+  // rendering process modifies some members like m_globalOpacity).
+  Render bandRender(*this);
+  bandRender.m_threads = 1;
+  std::vector<Render> renders(bands, bandRender);
+  std::vector<gfx::Clip> clips(bands);
+
+  int y = 0;
+  for (int i=0; i<bands; ++i) {
+    int h = (area.size.h - y) / (bands - i);
+    clips[i] = gfx::Clip(
+      area.dst.x, area.dst.y + y,
+      area.src.x, area.src.y + y,
+      area.size.w, h);
+    y += h;
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  int pending = bands-1;
+
+  for (int i=1; i<bands; ++i) {
+    Render* render = &renders[i];
+    const gfx::Clip* clip = &clips[i];
+
+    bands_pool().execute(
+      [render, clip, dstImage, sprite, frame, zoom, &mutex, &cv, &pending]{
+        render->renderSpriteArea(dstImage, sprite, frame, *clip, zoom);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (--pending == 0)
+          cv.notify_one();
+      });
+  }
+
+  // The first band is rendered in this same thread
+  renders[0].renderSpriteArea(dstImage, sprite, frame, clips[0], zoom);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&pending]{ return pending == 0; });
+}
+
 void Render::renderBackground(Image* image,
   const gfx::Clip& area,
   Zoom zoom)
@@ -559,8 +838,8 @@ void Render::renderBackground(Image* image,
   v = (area.src.y / tile_h);
 
   // Position where we start drawing the first tile in "image"
-  int x_start = -(area.src.x % tile_w);
-  int y_start = -(area.src.y % tile_h);
+  int x_start = area.dst.x - (area.src.x % tile_w);
+  int y_start = area.dst.y - (area.src.y % tile_h);
 
   gfx::Rect dstBounds = area.dstBounds();
 
@@ -606,6 +885,15 @@ void Render::renderLayer(
   bool render_transparent,
   int blend_mode)
 {
+  if (m_layerRange != LayerRange::ALL) {
+    if (layer == m_cacheLayer)
+      m_cacheLayerReached = true;
+
+    if (layer->type() == ObjectType::LayerImage &&
+        m_cacheLayerReached != (m_layerRange == LayerRange::FROM_CACHED_LAYER))
+      return;
+  }
+
   // we can't read from this layer
   if (!layer->isVisible())
     return;
@@ -805,4 +1093,11 @@ void composite_image(Image* dst, const Image* src,
     opacity, blend_mode);
 }
 
+void add_sprite_frame_key(const Sprite* sprite, frame_t frame,
+  std::vector<uint32_t>& key)
+{
+  add_sprite_key(sprite, frame, key);
+  add_below_layers_key(sprite->folder(), nullptr, frame, key);
+}
+
 } // namespace render
@@ -8,14 +8,18 @@
 #define RENDER_RENDER_H_INCLUDED
 #pragma once
 
+#include "base/shared_ptr.h"
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/pixel_format.h"
 #include "gfx/fwd.h"
+#include "gfx/rect.h"
 #include "gfx/size.h"
 #include "render/extra_type.h"
 #include "render/zoom.h"
 
+#include <vector>
+
 namespace gfx {
   class Clip;
 }
@@ -72,6 +76,25 @@ namespace render {
       int prevs, int nexts, int opacityBase, int opacityStep);
     void disableOnionskin();
 
+    // Number of threads used to render the sprite. If it's greater
+    // than 1, the destination area is split in horizontal bands that
+    // are rendered in parallel (the output is the same as the serial
+    // rendering).
+    void setThreads(int threads);
+    int threads() const { return m_threads; }
+
+    // Caches the composition of the background and all layers below
+    // the given one in the given area (zoomed sprite coordinates).
+    // Then renderSprite() only blends the given layer and the layers
+    // above it over the cached image. The cached image is rendered
+    // again when a layer below changes (cel image versions,
+    // visibility, opacity, blend mode, etc.).
+    void setBelowLayersCache(const Layer* layer, const gfx::Rect& bounds);
+    void removeBelowLayersCache();
+
+    // Frees the cached image of layers below the current one.
+    void invalidateBelowLayersCache();
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -115,6 +138,37 @@ namespace render {
       int opacity, int blend_mode);
 
   private:
+    class BelowLayersCache;
+
+    // What layers are rendered by renderSpriteArea().
+    enum class LayerRange {
+      ALL,                      // All layers
+      BELOW_CACHED_LAYER,       // Background and layers below m_cacheLayer
+      FROM_CACHED_LAYER,        // m_cacheLayer, layers above it, and onionskin
+    };
+
+    bool renderSpriteUsingCache(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom);
+
+    void renderSpriteArea(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom);
+
+    void renderSpriteBands(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom,
+      int bands);
+
     typedef void (*RenderScaledImage)(
       Image* dst, const Image* src, const Palette* pal,
       const gfx::Clip& area,
@@ -166,11 +220,26 @@ namespace render {
     int m_onionskinNexts;
     int m_onionskinOpacityBase;
     int m_onionskinOpacityStep;
+
+    int m_threads;
+
+    const Layer* m_cacheLayer;
+    gfx::Rect m_cacheBounds;
+    base::SharedPtr<BelowLayersCache> m_cache;
+    LayerRange m_layerRange;
+    bool m_cacheLayerReached;
   };
 
   void composite_image(Image* dst, const Image* src,
     int x, int y, int opacity, int blend_mode);
 
+  // Adds to "key" the state of everything that is used to render the
+  // given frame of the sprite (layers, cels, image versions, palette,
+  // etc.). If the key doesn't change, a new rendering of the frame
+  // (with the same Render configuration) gives the same result.
+  void add_sprite_frame_key(const Sprite* sprite, frame_t frame,
+    std::vector<uint32_t>& key);
+
 } // namespace render
 
 #endif
@@ -21,6 +21,9 @@
 #include "doc/palette.h"
 #include "doc/primitives.h"
 
+#include <cstdlib>
+#include <vector>
+
 using namespace doc;
 using namespace render;
 
@@ -214,6 +217,191 @@ TEST(Render, ZoomAndDstBounds)
     0, 0, 0, 0);
 }
 
+// Fills the image with pseudo-random pixels (including transparent
+// ones) so each layer blends in a different way.
+static void fill_random_pixels(Image* image, int seed)
+{
+  std::srand(seed);
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      color_t c;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB: c = rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, std::rand() % 256); break;
+        case IMAGE_GRAYSCALE: c = graya(std::rand() % 256, std::rand() % 256); break;
+        default: c = std::rand() % 256; break;
+      }
+      put_pixel(image, x, y, c);
+    }
+}
+
+static void expect_same_images(const Image* a, const Image* b)
+{
+  ASSERT_EQ(a->width(), b->width());
+  ASSERT_EQ(a->height(), b->height());
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      ASSERT_EQ(get_pixel(a, x, y), get_pixel(b, x, y)) << "Pixel " << x << "," << y;
+}
+
+TYPED_TEST(RenderAllModes, ParallelBandsMatchSerialRender)
+{
+  typedef TypeParam ImageTraits;
+
+  Context ctx;
+  Document* doc = ctx.documents().add(67, 131,
+    ColorMode(ImageTraits::pixel_format));
+  Sprite* sprite = doc->sprite();
+  fill_random_pixels(sprite->layer(0)->cel(0)->image(), 1);
+
+  // Add two more layers with cels in different positions/opacities
+  for (int i=1; i<3; ++i) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->folder()->addLayer(layer);
+
+    ImageRef image(Image::create(ImageTraits::pixel_format, 40+i, 90+i));
+    fill_random_pixels(image.get(), i+1);
+
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition(i*7-3, i*11);
+    cel->setOpacity(255 - i*60);
+    layer->addCel(cel);
+  }
+
+  const Zoom zooms[] = { Zoom(1, 1), Zoom(3, 1), Zoom(1, 2), Zoom(1, 3) };
+  const BgType bgs[] = { BgType::TRANSPARENT, BgType::CHECKED };
+
+  for (const Zoom& zoom : zooms) {
+    for (BgType bg : bgs) {
+      gfx::Rect bounds = zoom.apply(sprite->bounds());
+      const gfx::Clip areas[] = {
+        gfx::Clip(bounds),
+        gfx::Clip(3, 5, 1, 7, bounds.w-5, bounds.h-11)
+      };
+
+      for (const gfx::Clip& area : areas) {
+        base::UniquePtr<Image> serial(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+        base::UniquePtr<Image> parallel(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+        clear_image(serial, 0);
+        clear_image(parallel, 0);
+
+        Render render;
+        render.setBgType(bg);
+        render.setBgZoom(true);
+        render.setBgColor1(rgba(128, 128, 128, 255));
+        render.setBgColor2(rgba(196, 196, 196, 255));
+        render.setBgCheckedSize(gfx::Size(5, 5));
+
+        EXPECT_EQ(1, render.threads());
+        render.renderSprite(serial, sprite, frame_t(0), area, zoom);
+
+        for (int threads=2; threads<=7; threads+=5) {
+          render.setThreads(threads);
+          EXPECT_EQ(threads, render.threads());
+          render.renderSprite(parallel, sprite, frame_t(0), area, zoom);
+          SCOPED_TRACE(testing::Message()
+                       << "zoom=" << zoom.scale()
+                       << " bg=" << int(bg)
+                       << " threads=" << threads);
+          expect_same_images(serial, parallel);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(RenderAllModes, BelowLayersCacheMatchesFullRender)
+{
+  typedef TypeParam ImageTraits;
+
+  Context ctx;
+  Document* doc = ctx.documents().add(53, 47,
+    ColorMode(ImageTraits::pixel_format));
+  Sprite* sprite = doc->sprite();
+  fill_random_pixels(sprite->layer(0)->cel(0)->image(), 1);
+
+  Palette* pal = sprite->palette(frame_t(0));
+  for (int i=0; i<pal->size(); ++i)
+    pal->setEntry(i, rgba(i, 255-i, (i*7) & 255, 255));
+
+  std::vector<LayerImage*> layers;
+  layers.push_back(static_cast<LayerImage*>(sprite->layer(0)));
+  for (int i=1; i<4; ++i) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->folder()->addLayer(layer);
+    layers.push_back(layer);
+
+    ImageRef image(Image::create(ImageTraits::pixel_format, 20+i, 30+i));
+    fill_random_pixels(image.get(), i+1);
+
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition(i*9-5, i*4);
+    cel->setOpacity(255 - i*50);
+    layer->addCel(cel);
+  }
+
+  const Zoom zoom(2, 1);
+  const gfx::Rect bounds = zoom.apply(sprite->bounds());
+  const gfx::Clip area(1, 2, 4, 6, 60, 50);
+
+  Render render;
+  render.setBgType(BgType::CHECKED);
+  render.setBgColor1(rgba(128, 128, 128, 255));
+  render.setBgColor2(rgba(196, 196, 196, 255));
+  render.setThreads(3);
+  render.setBelowLayersCache(layers[2], bounds);
+
+  base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+  base::UniquePtr<Image> cached(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+
+  auto check = [&]{
+    clear_image(expected, 0);
+    clear_image(cached, 0);
+    render.renderSprite(cached, sprite, frame_t(0), area, zoom);
+
+    render.removeBelowLayersCache();
+    render.renderSprite(expected, sprite, frame_t(0), area, zoom);
+    render.setBelowLayersCache(layers[2], bounds);
+
+    expect_same_images(expected, cached);
+  };
+
+  check();
+
+  // Modify the cached layer and the layer above it
+  fill_random_pixels(layers[2]->cel(0)->image(), 10);
+  fill_random_pixels(layers[3]->cel(0)->image(), 11);
+  check();
+
+  // Modify a layer below (incrementing its version)
+  fill_random_pixels(layers[1]->cel(0)->image(), 12);
+  layers[1]->cel(0)->image()->incrementVersion();
+  check();
+
+  // Hide and show layers below
+  layers[0]->setVisible(false);
+  check();
+  layers[0]->setVisible(true);
+  check();
+
+  // Change opacity of a cel below
+  layers[1]->cel(0)->setOpacity(32);
+  check();
+
+  // If the image is modified without incrementing its version, the
+  // cached image is used (and the result is not updated).
+  fill_random_pixels(layers[1]->cel(0)->image(), 13);
+  render.renderSprite(cached, sprite, frame_t(0), area, zoom);
+  render.removeBelowLayersCache();
+  render.renderSprite(expected, sprite, frame_t(0), area, zoom);
+  EXPECT_NE(0, count_diff_between_images(expected, cached));
+
+  // After invalidating the cache everything is rendered again.
+  render.invalidateBelowLayersCache();
+  render.setBelowLayersCache(layers[2], bounds);
+  render.renderSprite(cached, sprite, frame_t(0), area, zoom);
+  expect_same_images(expected, cached);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -21,6 +21,8 @@ namespace render {
     }
 
     double scale() const { return static_cast<double>(m_num) / static_cast<double>(m_den); }
+    int numerator() const { return m_num; }
+    int denominator() const { return m_den; }
 
     int apply(int x) const { return x * m_num / m_den; }
     int remove(int x) const { return x * m_den / m_num; }
@@ -67,6 +67,13 @@ static WidgetsList mouse_widgets_list; // List of widgets to send mouse events
 static Messages msg_queue;             // Messages queue
 static Filters msg_filters[NFILTERS]; // Filters for every enqueued message
 
+#ifdef REPORT_EVENTS
+// Counters of messages in the current frame
+static int enqueued_msgs = 0;
+static int collapsed_msgs = 0;
+static int dispatched_msgs = 0;
+#endif
+
 static Widget* focus_widget;    // The widget with the focus
 static Widget* mouse_widget;    // The widget with the mouse
 static Widget* capture_widget;  // The widget that captures the mouse
@@ -454,6 +461,13 @@ void Manager::dispatchMessages()
       get_mouse_position(), _internal_get_mouse_buttons()));
 
   pumpQueue();
+
+#ifdef REPORT_EVENTS
+  std::cout << "Frame: " << enqueued_msgs << " enqueued messages, "
+            << collapsed_msgs << " collapsed mouse movements, "
+            << dispatched_msgs << " dispatched messages" << std::endl;
+  enqueued_msgs = collapsed_msgs = dispatched_msgs = 0;
+#endif
 }
 
 void Manager::addToGarbage(Widget* widget)
@@ -487,10 +501,39 @@ void Manager::enqueueMessage(Message* msg)
     }
   }
 
-  if (msg->hasRecipients())
-    msg_queue.push_back(msg);
-  else
+  if (!msg->hasRecipients()) {
     delete msg;
+    return;
+  }
+
+#ifdef REPORT_EVENTS
+  ++enqueued_msgs;
+#endif
+
+  // Consecutive mouse movements for the same widgets are collapsed
+  // in the last one (e.g. when we move the mouse over the editor).
+  // Movements are not collapsed while the mouse is captured or a
+  // button is pressed, as each point is needed (e.g. to draw a
+  // freehand stroke).
+  if (msg->type() == kMouseMoveMessage && !msg_queue.empty() &&
+      !capture_widget &&
+      static_cast<MouseMessage*>(msg)->buttons() == kButtonNone) {
+    Message*& last = msg_queue.back();
+    if (last->type() == kMouseMoveMessage &&
+        !last->isUsed() &&
+        static_cast<MouseMessage*>(last)->buttons() == kButtonNone &&
+        last->recipients() == msg->recipients()) {
+      delete last;
+      last = msg;
+
+#ifdef REPORT_EVENTS
+      ++collapsed_msgs;
+#endif
+      return;
+    }
+  }
+
+  msg_queue.push_back(msg);
 }
 
 Window* Manager::getTopWindow()
@@ -1157,6 +1200,10 @@ void Manager::pumpQueue()
         break;
     }
 
+#ifdef REPORT_EVENTS
+    ++dispatched_msgs;
+#endif
+
     // Remove the message from the msg_queue
     it = msg_queue.erase(it);
 
@@ -18,6 +18,56 @@
 
 namespace ui {
 
+namespace {
+
+// Free blocks are grouped by size in classes of 16 bytes. Bigger
+// messages use the global operator new.
+const std::size_t kBlockGranularity = 16;
+const std::size_t kMaxPooledSize = 256;
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+FreeBlock* free_blocks[kMaxPooledSize / kBlockGranularity];
+
+inline int block_class(std::size_t size) {
+  return int((size + kBlockGranularity - 1) / kBlockGranularity) - 1;
+}
+
+} // anonymous namespace
+
+// static
+void* Message::operator new(std::size_t size)
+{
+  if (size > kMaxPooledSize)
+    return ::operator new(size);
+
+  int i = block_class(size);
+  if (FreeBlock* block = free_blocks[i]) {
+    free_blocks[i] = block->next;
+    return block;
+  }
+  return ::operator new((i+1) * kBlockGranularity);
+}
+
+// static
+void Message::operator delete(void* ptr, std::size_t size)
+{
+  if (!ptr)
+    return;
+
+  if (size > kMaxPooledSize) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  int i = block_class(size);
+  FreeBlock* block = static_cast<FreeBlock*>(ptr);
+  block->next = free_blocks[i];
+  free_blocks[i] = block;
+}
+
 Message::Message(MessageType type)
   : m_type(type)
   , m_used(false)
@@ -16,6 +16,7 @@
 #include "ui/mouse_buttons.h"
 #include "ui/widgets_list.h"
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,12 @@ namespace ui {
     Message(MessageType type);
     virtual ~Message();
 
+    // Messages are created and destroyed several times per frame, so
+    // they are allocated from a pool of free blocks. Messages must be
+    // created in the UI thread.
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
+
     MessageType type() const { return m_type; }
     const WidgetsList& recipients() const { return m_recipients; }
     bool hasRecipients() const { return !m_recipients.empty(); }
@@ -5,6 +5,7 @@
 // Read LICENSE.txt for more information.
 
 /* #define REPORT_SIGNALS */
+/* #define REPORT_EVENTS */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -41,6 +42,12 @@
 #include <cstring>
 #include <queue>
 #include <sstream>
+#include <vector>
+
+#ifdef REPORT_EVENTS
+#include <iostream>
+#include <typeinfo>
+#endif
 
 namespace ui {
 
@@ -884,6 +891,44 @@ void Widget::setMaxSize(const gfx::Size& sz)
   max_h = sz.h;
 }
 
+// Joins consecutive rectangles of the region (to send less paint
+// messages) when their union doesn't add too much area (25%) to
+// paint. The union must be completely inside the "drawable" region,
+// so we never paint over top windows.
+static void coalesce_paint_rects(const Region& region,
+                                 const Region& drawable,
+                                 std::vector<gfx::Rect>& rects)
+{
+  gfx::Rect cur;
+  int curArea = 0;
+
+  for (Region::const_iterator it=region.begin(), end=region.end();
+       it != end; ++it) {
+    const gfx::Rect& rc = *it;
+    int area = rc.w*rc.h;
+
+    if (!cur.isEmpty()) {
+      gfx::Rect u = cur.createUnion(rc);
+      int unionArea = u.w*u.h;
+
+      if (4*(unionArea - curArea - area) <= unionArea &&
+          drawable.contains(u) == Region::In) {
+        cur = u;
+        curArea += area;
+        continue;
+      }
+
+      rects.push_back(cur);
+    }
+
+    cur = rc;
+    curArea = area;
+  }
+
+  if (!cur.isEmpty())
+    rects.push_back(cur);
+}
+
 void Widget::flushRedraw()
 {
   std::queue<Widget*> processing;
@@ -914,20 +959,24 @@ void Widget::flushRedraw()
 
     if (!widget->m_updateRegion.isEmpty()) {
       // Intersect m_updateRegion with drawable area.
-      {
-        Region region;
-        widget->getDrawableRegion(region, kCutTopWindows);
-        widget->m_updateRegion.createIntersection(widget->m_updateRegion, region);
-      }
+      Region drawable;
+      widget->getDrawableRegion(drawable, kCutTopWindows);
+      widget->m_updateRegion.createIntersection(widget->m_updateRegion, drawable);
 
-      std::size_t c, nrects = widget->m_updateRegion.size();
-      Region::const_iterator it = widget->m_updateRegion.begin();
+      std::vector<gfx::Rect> rects;
+      coalesce_paint_rects(widget->m_updateRegion, drawable, rects);
+
+#ifdef REPORT_EVENTS
+      std::cout << "flushRedraw: " << widget->m_updateRegion.size()
+                << " rects -> " << rects.size() << " paint messages for "
+                << typeid(*widget).name() << std::endl;
+#endif
 
       // Draw the widget
-      int count = nrects-1;
-      for (c=0; c<nrects; ++c, ++it, --count) {
+      int count = int(rects.size())-1;
+      for (const gfx::Rect& rc : rects) {
         // Create the draw message
-        msg = new PaintMessage(count, *it);
+        msg = new PaintMessage(count--, rc);
         msg->addRecipient(widget);
 
         // Enqueue the draw message
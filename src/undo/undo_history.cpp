@@ -14,12 +14,14 @@
 #include "undo/undo_state.h"
 
 #include <cassert>
+#include <set>
 #include <stack>
 
 namespace undo {
 
-UndoHistory::UndoHistory()
-  : m_first(nullptr)
+UndoHistory::UndoHistory(UndoHistoryDelegate* delegate)
+  : m_delegate(delegate)
+  , m_first(nullptr)
   , m_last(nullptr)
   , m_cur(nullptr)
 {
@@ -68,7 +70,7 @@ void UndoHistory::clearRedo()
        state && state != m_cur;
        state = prev) {
     prev = state->m_prev;
-    delete state;
+    deleteState(state);
   }
 
   if (m_cur) {
@@ -99,6 +101,60 @@ void UndoHistory::add(UndoCommand* cmd)
   }
 }
 
+bool UndoHistory::deleteFirstState()
+{
+  UndoState* first = m_first;
+  if (!first || first == m_cur)
+    return false;
+
+  // States are sorted by creation time, so the parent of each state
+  // is before it in the list.
+  std::set<const UndoState*> descendants;
+  descendants.insert(first);
+  for (UndoState* state = first->m_next; state; state = state->m_next) {
+    if (state->m_parent && descendants.count(state->m_parent))
+      descendants.insert(state);
+  }
+
+  // If the current state doesn't depend on the first one, we would
+  // have to delete the current state.
+  if (!descendants.count(m_cur))
+    return false;
+
+  // Delete the first state and all states that don't depend on it
+  // (they are in other branches from the initial state).
+  for (UndoState* state = m_first, *next; state; state = next) {
+    next = state->m_next;
+
+    if (state != first && descendants.count(state)) {
+      if (state->m_parent == first)
+        state->m_parent = nullptr;
+      continue;
+    }
+
+    if (state->m_prev)
+      state->m_prev->m_next = state->m_next;
+    else
+      m_first = state->m_next;
+
+    if (state->m_next)
+      state->m_next->m_prev = state->m_prev;
+    else
+      m_last = state->m_prev;
+
+    deleteState(state);
+  }
+  return true;
+}
+
+void UndoHistory::deleteState(UndoState* state)
+{
+  if (m_delegate)
+    m_delegate->onDeleteUndoState(state);
+
+  delete state;
+}
+
 UndoState* UndoHistory::findCommonParent(UndoState* a, UndoState* b)
 {
   UndoState* pA = a;
@@ -127,6 +183,8 @@ void UndoHistory::moveTo(UndoState* new_state)
   if (m_cur) {
     while (m_cur != common) {
       m_cur->m_cmd->undo();
+      if (m_delegate)
+        m_delegate->onUndoRedoState(m_cur);
       m_cur = m_cur->m_parent;
     }
   }
@@ -144,6 +202,8 @@ void UndoHistory::moveTo(UndoState* new_state)
       redo_parents.pop();
 
       p->m_cmd->redo();
+      if (m_delegate)
+        m_delegate->onUndoRedoState(p);
     }
   }
 
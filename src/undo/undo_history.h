@@ -13,9 +13,22 @@ namespace undo {
   class UndoCommand;
   class UndoState;
 
+  class UndoHistoryDelegate {
+  public:
+    virtual ~UndoHistoryDelegate() { }
+
+    // Called before an undo state (and its command) is removed from
+    // the history. The command isn't used by the history anymore.
+    virtual void onDeleteUndoState(UndoState* state) = 0;
+
+    // Called after the command of the given state is undone or
+    // redone (e.g. the memory used by the command could change).
+    virtual void onUndoRedoState(UndoState* state) { }
+  };
+
   class UndoHistory {
   public:
-    UndoHistory();
+    UndoHistory(UndoHistoryDelegate* delegate = nullptr);
     virtual ~UndoHistory();
 
     const UndoState* firstState()   const { return m_first; }
@@ -30,9 +43,18 @@ namespace undo {
 
     void clearRedo();
 
+    // Deletes the oldest state (it cannot be undone anymore), and all
+    // states in other branches that depend on the initial state.
+    // Returns false if the oldest state is the current one, or if the
+    // current state doesn't depend on it.
+    bool deleteFirstState();
+
   private:
     UndoState* findCommonParent(UndoState* a, UndoState* b);
     void moveTo(UndoState* new_state);
+    void deleteState(UndoState* state);
+
+    UndoHistoryDelegate* m_delegate;
 
     UndoState* m_first;
     UndoState* m_last;
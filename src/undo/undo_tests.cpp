@@ -12,6 +12,9 @@
 
 #include "undo/undo_command.h"
 #include "undo/undo_history.h"
+#include "undo/undo_state.h"
+
+#include <vector>
 
 #ifdef _WIN32
   #include <functional>
@@ -189,6 +192,129 @@ TEST(Undo, ComplexTree)
   EXPECT_FALSE(history.canRedo());
 }
 
+TEST(Undo, DeleteFirstState)
+{
+  UndoHistory history;
+  int model = 0;
+
+  Cmd cmd1([&]{ model = 1; }, [&]{ model = 0; });
+  Cmd cmd2([&]{ model = 2; }, [&]{ model = 1; });
+  Cmd cmd3([&]{ model = 3; }, [&]{ model = 2; });
+
+  EXPECT_FALSE(history.deleteFirstState());
+
+  cmd1.redo(); history.add(&cmd1);
+  // The current state cannot be deleted
+  EXPECT_FALSE(history.deleteFirstState());
+
+  cmd2.redo(); history.add(&cmd2);
+  cmd3.redo(); history.add(&cmd3);
+
+  EXPECT_TRUE(history.deleteFirstState());
+  EXPECT_EQ(&cmd2, history.firstState()->cmd());
+  EXPECT_EQ(&cmd3, history.lastState()->cmd());
+  EXPECT_EQ(nullptr, history.firstState()->prev());
+
+  history.undo();
+  EXPECT_EQ(2, model);
+  history.undo();
+  EXPECT_EQ(1, model);
+  EXPECT_FALSE(history.canUndo());
+  // The current state (the initial one) doesn't depend on cmd2
+  EXPECT_FALSE(history.deleteFirstState());
+
+  history.redo();
+  EXPECT_EQ(2, model);
+  history.redo();
+  EXPECT_EQ(3, model);
+  EXPECT_FALSE(history.canRedo());
+}
+
+TEST(Undo, DeleteFirstStateWithBranches)
+{
+  class Delegate : public UndoHistoryDelegate {
+  public:
+    std::vector<UndoCommand*> deleted;
+    void onDeleteUndoState(UndoState* state) override {
+      deleted.push_back(state->cmd());
+    }
+  } delegate;
+
+  UndoHistory history(&delegate);
+  int model = 0;
+
+  // 1 --- 2 --- 4
+  //
+  // 3
+  Cmd cmd1([&]{ model = 1; }, [&]{ model = 0; });
+  Cmd cmd2([&]{ model = 2; }, [&]{ model = 1; });
+  Cmd cmd3([&]{ model = 3; }, [&]{ model = 0; });
+  Cmd cmd4([&]{ model = 4; }, [&]{ model = 2; });
+
+  cmd1.redo(); history.add(&cmd1);
+  history.undo();
+  cmd3.redo(); history.add(&cmd3); // Branch from the initial state
+  history.undo();                  // Go to cmd1
+  EXPECT_EQ(1, model);
+  cmd2.redo(); history.add(&cmd2);
+  cmd4.redo(); history.add(&cmd4);
+
+  // cmd1 and cmd3 are deleted (cmd3 needs the initial state)
+  EXPECT_TRUE(history.deleteFirstState());
+  ASSERT_EQ(2, delegate.deleted.size());
+  EXPECT_EQ(&cmd1, delegate.deleted[0]);
+  EXPECT_EQ(&cmd3, delegate.deleted[1]);
+  EXPECT_EQ(&cmd2, history.firstState()->cmd());
+  EXPECT_EQ(&cmd4, history.lastState()->cmd());
+
+  history.undo();
+  EXPECT_EQ(2, model);
+  history.undo();
+  EXPECT_EQ(1, model);
+  EXPECT_FALSE(history.canUndo());
+  history.redo();
+  EXPECT_EQ(2, model);
+  history.redo();
+  EXPECT_EQ(4, model);
+  EXPECT_FALSE(history.canRedo());
+}
+
+TEST(Undo, UndoRedoStateWithBranches)
+{
+  class Delegate : public UndoHistoryDelegate {
+  public:
+    std::vector<UndoCommand*> changed;
+    void onDeleteUndoState(UndoState* state) override { }
+    void onUndoRedoState(UndoState* state) override {
+      changed.push_back(state->cmd());
+    }
+  } delegate;
+
+  UndoHistory history(&delegate);
+  int model = 0;
+
+  // 1
+  //
+  // 2
+  Cmd cmd1([&]{ model = 1; }, [&]{ model = 0; });
+  Cmd cmd2([&]{ model = 2; }, [&]{ model = 0; });
+
+  cmd1.redo(); history.add(&cmd1);
+  history.undo();
+  ASSERT_EQ(1, delegate.changed.size());
+  EXPECT_EQ(&cmd1, delegate.changed[0]);
+
+  cmd2.redo(); history.add(&cmd2); // Branch from the initial state
+  delegate.changed.clear();
+
+  // Going back to cmd1 undoes cmd2 and redoes cmd1
+  history.undo();
+  EXPECT_EQ(1, model);
+  ASSERT_EQ(2, delegate.changed.size());
+  EXPECT_EQ(&cmd2, delegate.changed[0]);
+  EXPECT_EQ(&cmd1, delegate.changed[1]);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -14,12 +14,20 @@
 #include "base/bind.h"
 #include "mongoose.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 namespace webserver {
 
 static int begin_request_handler(mg_connection* conn);
 
+// Only local connections are accepted
+static const char* kListeningPorts = "127.0.0.1:10453";
+
+// Maximum size of a request body
+static const std::size_t kMaxBodySize = 1024*1024;
+
 class RequestResponseImpl : public IRequest
                           , public IResponse
 {
@@ -52,6 +60,26 @@ public:
     return m_requestInfo->query_string;
   }
 
+  virtual const char* getHeader(const char* name) override {
+    return mg_get_header(m_conn, name);
+  }
+
+  virtual bool getBody(std::string& body) override {
+    const char* contentLength = mg_get_header(m_conn, "Content-Length");
+    if (contentLength && std::strtoul(contentLength, NULL, 10) > kMaxBodySize)
+      return false;
+
+    body.clear();
+    char buf[4096];
+    int n;
+    while ((n = mg_read(m_conn, buf, sizeof(buf))) > 0) {
+      if (body.size() + n > kMaxBodySize)
+        return false;
+      body.append(buf, n);
+    }
+    return true;
+  }
+
   // IResponse implementation
 
   virtual void setStatusCode(int code) override {
@@ -98,7 +126,7 @@ public:
   WebServerImpl(IDelegate* delegate)
     : m_delegate(delegate) {
     const char* options[] = {
-      "listening_ports", "10453",
+      "listening_ports", kListeningPorts,
       NULL
     };
 
@@ -244,4 +272,9 @@ std::string WebServer::getName() const
   return m_impl->getName();
 }
 
+std::string WebServer::getUrl() const
+{
+  return std::string("http://") + kListeningPorts + "/";
+}
+
 }
@@ -22,6 +22,13 @@ namespace webserver {
     virtual const char* getUri() = 0;
     virtual const char* getHttpVersion() = 0;
     virtual const char* getQueryString() = 0;
+
+    // Returns NULL if the request doesn't have the given header.
+    virtual const char* getHeader(const char* name) = 0;
+
+    // Reads the body of the request. Returns false if it's bigger
+    // than the accepted limit.
+    virtual bool getBody(std::string& body) = 0;
   };
 
   class IResponse {
@@ -48,6 +55,9 @@ namespace webserver {
 
     std::string getName() const;
 
+    // Returns the URL of the local server (e.g. "http://127.0.0.1:port/").
+    std::string getUrl() const;
+
   private:
     WebServerImpl* m_impl;
 